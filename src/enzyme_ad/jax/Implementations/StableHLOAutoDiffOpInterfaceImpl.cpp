@@ -1746,10 +1746,11 @@ struct SHLOConstantOpBatchInterface
     shape.append(T.getShape().begin(), T.getShape().end());
     auto Ty = T.clone(shape);
 
-    // If splatted attr then we can easily batch it
-    auto eattr = cast<DenseElementsAttr>(constOp.getValue());
-    if (eattr.isSplat()) {
-      auto splatAttr = cast<SplatElementsAttr>(constOp.getValue());
+    // If splatted attr then we can easily batch it. Other constants, including
+    // dense_resource blobs, are broadcast.
+    auto eattr = dyn_cast<DenseElementsAttr>(constOp.getValue());
+    if (eattr && eattr.isSplat()) {
+      auto splatAttr = cast<SplatElementsAttr>(eattr);
       auto newSplattedConstOp = ConstantOp::create(
           builder, constOp->getLoc(), Ty,
           cast<ElementsAttr>(splatAttr.resizeSplat(cast<ShapedType>(Ty))));
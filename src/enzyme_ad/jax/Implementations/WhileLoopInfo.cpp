@@ -222,12 +222,136 @@ bool WhileLoopInfo::isConstantValue(Value v, llvm::APInt &constVal) {
 
   Value outerValue;
   SmallVector<Operation *> canBeHoisted;
-  if (isConstantAcrossIterations(v, outerValue, canBeHoisted, false) &&
-      matchPattern(outerValue, m_ConstantInt(&constVal)))
-    return true;
+  if (isConstantAcrossIterations(v, outerValue, canBeHoisted, false)) {
+    if (matchPattern(outerValue, m_ConstantInt(&constVal)))
+      return true;
+
+    // e.g. limits computed from static dimension sizes
+    auto bounds = computeOuterBounds(outerValue);
+    if (bounds && bounds->min == bounds->max) {
+      constVal = bounds->min.sextOrTrunc(constVal.getBitWidth());
+      return true;
+    }
+  }
   return false;
 }
 
+std::optional<WhileLoopInfo::Bounds>
+WhileLoopInfo::computeOuterBounds(Value v, unsigned depth) {
+  constexpr unsigned bitWidth = 64;
+  if (depth > 8 || !definedOutside(v, op))
+    return std::nullopt;
+
+  auto ty = dyn_cast<RankedTensorType>(v.getType());
+  if (!ty || !ty.hasStaticShape() || ty.getNumElements() != 1)
+    return std::nullopt;
+  auto intTy = dyn_cast<IntegerType>(ty.getElementType());
+  if (!intTy || intTy.isUnsigned() || intTy.getWidth() > bitWidth)
+    return std::nullopt;
+
+  APInt constVal;
+  if (matchPattern(v, m_ConstantInt(&constVal))) {
+    auto c = constVal.sextOrTrunc(bitWidth);
+    return Bounds{c, c};
+  }
+
+  if (auto irBounds = enzyme::getBoundsFromIR(v, bitWidth))
+    return Bounds{irBounds->first, irBounds->second};
+
+  auto defOp = v.getDefiningOp();
+  if (!defOp)
+    return std::nullopt;
+
+  if (auto dimSize = dyn_cast<stablehlo::GetDimensionSizeOp>(defOp)) {
+    auto operandTy = cast<RankedTensorType>(dimSize.getOperand().getType());
+    int64_t size = operandTy.getDimSize(dimSize.getDimension());
+    if (ShapedType::isDynamic(size))
+      return Bounds{APInt(bitWidth, 0),
+                    APInt::getSignedMaxValue(intTy.getWidth()).sext(bitWidth)};
+    APInt c(bitWidth, size, true);
+    return Bounds{c, c};
+  }
+
+  if (isa<stablehlo::ConvertOp, stablehlo::ReshapeOp>(defOp)) {
+    auto bounds = computeOuterBounds(defOp->getOperand(0), depth + 1);
+    if (!bounds)
+      return std::nullopt;
+    // narrowing conversions may wrap
+    APInt typeMin =
+        APInt::getSignedMinValue(intTy.getWidth()).sext(bitWidth);
+    APInt typeMax =
+        APInt::getSignedMaxValue(intTy.getWidth()).sext(bitWidth);
+    if (bounds->min.slt(typeMin) || bounds->max.sgt(typeMax))
+      return std::nullopt;
+    return bounds;
+  }
+
+  if (!isa<stablehlo::AddOp, stablehlo::SubtractOp, stablehlo::MulOp,
+           stablehlo::MinOp, stablehlo::MaxOp>(defOp))
+    return std::nullopt;
+
+  auto lhs = computeOuterBounds(defOp->getOperand(0), depth + 1);
+  auto rhs = computeOuterBounds(defOp->getOperand(1), depth + 1);
+  if (!lhs || !rhs)
+    return std::nullopt;
+
+  // Give up on overflow rather than producing a wrapped range.
+  bool overflow = false;
+  auto add = [&](const APInt &a, const APInt &b) {
+    bool ov;
+    auto r = a.sadd_ov(b, ov);
+    overflow |= ov;
+    return r;
+  };
+  auto sub = [&](const APInt &a, const APInt &b) {
+    bool ov;
+    auto r = a.ssub_ov(b, ov);
+    overflow |= ov;
+    return r;
+  };
+  auto mul = [&](const APInt &a, const APInt &b) {
+    bool ov;
+    auto r = a.smul_ov(b, ov);
+    overflow |= ov;
+    return r;
+  };
+
+  std::optional<Bounds> result =
+      TypeSwitch<Operation *, std::optional<Bounds>>(defOp)
+          .Case<stablehlo::AddOp>([&](auto) {
+            return Bounds{add(lhs->min, rhs->min), add(lhs->max, rhs->max)};
+          })
+          .Case<stablehlo::SubtractOp>([&](auto) {
+            return Bounds{sub(lhs->min, rhs->max), sub(lhs->max, rhs->min)};
+          })
+          .Case<stablehlo::MulOp>([&](auto) {
+            auto p1 = mul(lhs->min, rhs->min);
+            auto p2 = mul(lhs->min, rhs->max);
+            auto p3 = mul(lhs->max, rhs->min);
+            auto p4 = mul(lhs->max, rhs->max);
+            auto lo = p1.slt(p2) ? p1 : p2;
+            lo = lo.slt(p3) ? lo : p3;
+            lo = lo.slt(p4) ? lo : p4;
+            auto hi = p1.sgt(p2) ? p1 : p2;
+            hi = hi.sgt(p3) ? hi : p3;
+            hi = hi.sgt(p4) ? hi : p4;
+            return Bounds{lo, hi};
+          })
+          .Case<stablehlo::MinOp>([&](auto) {
+            return Bounds{lhs->min.slt(rhs->min) ? lhs->min : rhs->min,
+                          lhs->max.slt(rhs->max) ? lhs->max : rhs->max};
+          })
+          .Case<stablehlo::MaxOp>([&](auto) {
+            return Bounds{lhs->min.sgt(rhs->min) ? lhs->min : rhs->min,
+                          lhs->max.sgt(rhs->max) ? lhs->max : rhs->max};
+          })
+          .Default([](Operation *) { return std::nullopt; });
+
+  if (overflow)
+    return std::nullopt;
+  return result;
+}
+
 void WhileLoopInfo::propagateAffineIndexInfo() {
   auto inductionVar = getInductionVariable();
 
@@ -818,8 +942,8 @@ bool WhileLoopInfo::hoistOperationFromLoop(
 }
 
 void WhileLoopInfo::propagateBounds() {
-  if (!isConstant()) {
-    return; // need constant bounds
+  if (!isConstantStep()) {
+    return; // need a constant step
   }
 
   auto inductionVariable = getInductionVariable();
@@ -834,18 +958,37 @@ void WhileLoopInfo::propagateBounds() {
   this->boundsBitWidth = bitWidth;
 
   SmallVector<Value> newPropagated;
-  auto start = getConstantStart().value();
-  auto limit = getConstantLimit().value();
   auto step = getConstantStep().value();
 
   // Initialize bounds for the induction variable
   Bounds inductionBounds;
-  if (step > 0) {
-    inductionBounds =
-        Bounds{APInt(bitWidth, start, true), APInt(bitWidth, limit - 1, true)};
+  if (isConstant()) {
+    auto start = getConstantStart().value();
+    auto limit = getConstantLimit().value();
+    auto numIters = getConstantNumIters();
+    if (step > 0 && numIters > 0) {
+      // the last value taken inside the body, not just limit - 1
+      inductionBounds =
+          Bounds{APInt(bitWidth, start, true),
+                 APInt(bitWidth, start + (numIters - 1) * step, true)};
+    } else if (step > 0) {
+      inductionBounds = Bounds{APInt(bitWidth, start, true),
+                               APInt(bitWidth, limit - 1, true)};
+    } else {
+      inductionBounds = Bounds{APInt(bitWidth, limit + 1, true),
+                               APInt(bitWidth, start, true)};
+    }
   } else {
-    inductionBounds =
-        Bounds{APInt(bitWidth, limit + 1, true), APInt(bitWidth, start, true)};
+    // Fall back to the ranges of start and limit: an increasing induction
+    // variable stays within [min(start), max(limit) - 1] in the body.
+    auto startBounds = computeOuterBounds(start);
+    auto limitBounds = computeOuterBounds(limit);
+    if (step <= 0 || !startBounds || !limitBounds)
+      return;
+    inductionBounds = Bounds{startBounds->min.sextOrTrunc(bitWidth),
+                             (limitBounds->max - 1).sextOrTrunc(bitWidth)};
+    if (inductionBounds.min.sgt(inductionBounds.max))
+      return;
   }
 
   propagateBounds(inductionVariable, inductionBounds, newPropagated);
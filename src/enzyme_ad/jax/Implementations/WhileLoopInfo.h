@@ -48,6 +48,7 @@ struct WhileLoopInfo {
   bool isStepOne();
 
   mlir::Value getStart() { return start; }
+  mlir::Value getLimit() { return limit; }
 
   mlir::Value getStep(OpBuilder &builder);
 
@@ -135,6 +136,9 @@ private:
 
   std::optional<Bounds> computeBounds(Operation *op);
 
+  // Conservative 64-bit range of a scalar integer defined outside the loop.
+  std::optional<Bounds> computeOuterBounds(Value v, unsigned depth = 0);
+
   void computeConstantValues();
 
   bool isConstantValue(Value v, llvm::APInt &constVal);
@@ -10,6 +10,8 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "../polymer/mlir/include/mlir/Conversion/Polymer/Support/IslScop.h"
+#include "../polymer/mlir/include/mlir/Conversion/Polymer/Target/ISL.h"
 #include "src/enzyme_ad/jax/Passes/AffineUtils.h"
 #include "src/enzyme_ad/jax/Passes/Passes.h"
 #include "src/enzyme_ad/jax/Utils.h"
@@ -261,6 +263,9 @@ struct ParallelContext {
     bool dump_failed_lockstep = false;
     bool preferWhileRaising = true;
     bool strip_llvm_debuginfo = false;
+    // Loops which the polyhedral dependence analysis proved to carry no
+    // memory dependences, see IslLoopDependences.
+    const llvm::SmallPtrSetImpl<Operation *> *islParallelLoops = nullptr;
   } options;
 
   explicit ParallelContext(Options &options) : options(options) {}
@@ -1261,6 +1266,319 @@ static LogicalResult tryRaisingForOpToStableHLOWhile(
   return success();
 }
 
+// Collects the iv of every result of `map`, failing if a result is not a plain
+// dim or if an iv is repeated.
+static bool getDimIVs(affine::AffineValueMap map, SmallVectorImpl<Value> &ivs) {
+  for (auto E : map.getAffineMap().getResults()) {
+    auto dim = dyn_cast<AffineDimExpr>(E);
+    if (!dim)
+      return false;
+    Value iv = map.getOperand(dim.getPosition());
+    if (llvm::is_contained(ivs, iv))
+      return false;
+    ivs.push_back(iv);
+  }
+  return true;
+}
+
+// Emits sum_k lhs * rhs over the induction variable k of `forOp` as a
+// dot_general. Ivs indexing both operands become batch dimensions, the
+// remaining ones free dimensions. Returns a null value if k does not index
+// both operands.
+static Value
+emitContractionAsDotGeneral(affine::AffineForOp forOp, Value lhs, Value rhs,
+                            affine::AffineValueMap &resultMap,
+                            llvm::DenseMap<Value, affine::AffineValueMap> &maps,
+                            OpBuilder &builder, Location loc) {
+  SmallVector<Value> lhsIVs, rhsIVs;
+  if (!getDimIVs(maps.lookup(lhs), lhsIVs) ||
+      !getDimIVs(maps.lookup(rhs), rhsIVs))
+    return nullptr;
+
+  auto lhsTy = cast<RankedTensorType>(lhs.getType());
+  auto rhsTy = cast<RankedTensorType>(rhs.getType());
+  if (lhsTy.getElementType() != rhsTy.getElementType())
+    return nullptr;
+
+  Value iv = forOp.getInductionVar();
+  SmallVector<int64_t> lhsBatch, rhsBatch, lhsContract, rhsContract;
+  SmallVector<int64_t> resultShape;
+  SmallVector<Value> resultIVs;
+  for (auto [i, lhsIV] : llvm::enumerate(lhsIVs)) {
+    auto it = llvm::find(rhsIVs, lhsIV);
+    if (it == rhsIVs.end())
+      continue;
+    int64_t j = std::distance(rhsIVs.begin(), it);
+    if (lhsTy.getDimSize(i) != rhsTy.getDimSize(j))
+      return nullptr;
+    if (lhsIV == iv) {
+      lhsContract.push_back(i);
+      rhsContract.push_back(j);
+      continue;
+    }
+    lhsBatch.push_back(i);
+    rhsBatch.push_back(j);
+    resultShape.push_back(lhsTy.getDimSize(i));
+    resultIVs.push_back(lhsIV);
+  }
+  if (lhsContract.empty())
+    return nullptr;
+
+  for (auto [i, lhsIV] : llvm::enumerate(lhsIVs)) {
+    if (llvm::is_contained(rhsIVs, lhsIV))
+      continue;
+    resultShape.push_back(lhsTy.getDimSize(i));
+    resultIVs.push_back(lhsIV);
+  }
+  for (auto [j, rhsIV] : llvm::enumerate(rhsIVs)) {
+    if (llvm::is_contained(lhsIVs, rhsIV))
+      continue;
+    resultShape.push_back(rhsTy.getDimSize(j));
+    resultIVs.push_back(rhsIV);
+  }
+
+  auto dotDims = stablehlo::DotDimensionNumbersAttr::get(
+      builder.getContext(), lhsBatch, rhsBatch, lhsContract, rhsContract);
+  Value res = stablehlo::DotGeneralOp::create(
+      builder, loc, RankedTensorType::get(resultShape, lhsTy.getElementType()),
+      lhs, rhs, dotDims, nullptr, nullptr);
+
+  resultMap = affine::AffineValueMap(
+      AffineMap::getMultiDimIdentityMap(resultIVs.size(), builder.getContext()),
+      resultIVs);
+  return res;
+}
+
+// Emits sum_k input[..., o + k + c, ...] * filter[k] over the induction
+// variable k of `forOp` as a one dimensional convolution, where `load` reads
+// input and o is a parallel iv. At most one other parallel iv may index
+// input, it becomes the batch dimension of the convolution. Returns a null
+// value if the access does not have this form.
+static Value emitContractionAsConvolution(
+    affine::AffineForOp forOp, affine::AffineLoadOp load, Value filter,
+    affine::AffineValueMap &resultMap, IRMapping &mapping,
+    llvm::DenseMap<Value, affine::AffineValueMap> &maps, OpBuilder &builder,
+    Location loc, ParallelContext pc) {
+  Value iv = forOp.getInductionVar();
+  auto kRange = getIVRange(iv);
+  if (!kRange || kRange->step != 1)
+    return nullptr;
+
+  Value kernel = mapping.lookup(filter);
+  SmallVector<Value> filterIVs;
+  if (!getDimIVs(maps.lookup(kernel), filterIVs) || filterIVs.size() != 1 ||
+      filterIVs[0] != iv)
+    return nullptr;
+
+  affine::MemRefAccess access(load);
+  affine::AffineValueMap accessValueMap;
+  access.getAccessMap(&accessValueMap);
+  accessValueMap.composeSimplifyAndCanonicalize();
+  AffineMap accessMap = accessValueMap.getAffineMap();
+  if (accessMap.getNumSymbols() != 0)
+    return nullptr;
+
+  Value input = mapping.lookup(access.memref);
+  auto inputTy = cast<RankedTensorType>(input.getType());
+  if (inputTy.getElementType() !=
+      cast<RankedTensorType>(kernel.getType()).getElementType())
+    return nullptr;
+
+  SmallVector<int64_t> startIndices, limitIndices, strides;
+  std::optional<unsigned> spatialIdx, batchIdx;
+  Value outIV, batchIV;
+  int64_t numOut = 0, numBatch = 1;
+  for (auto [i, E] : llvm::enumerate(accessMap.getResults())) {
+    strides.push_back(1);
+    if (auto constExpr = dyn_cast<AffineConstantExpr>(E)) {
+      startIndices.push_back(constExpr.getValue());
+      limitIndices.push_back(constExpr.getValue() + 1);
+      continue;
+    }
+
+    SmallVector<unsigned> dims;
+    for (unsigned d = 0, e = accessMap.getNumDims(); d < e; ++d)
+      if (E.isFunctionOfDim(d))
+        dims.push_back(d);
+
+    if (auto dimExpr = dyn_cast<AffineDimExpr>(E)) {
+      Value v = accessValueMap.getOperand(dimExpr.getPosition());
+      auto range = getIVRange(v);
+      if (batchIdx || v == iv || !pc.isParallelIV(v) || !range ||
+          range->step != 1)
+        return nullptr;
+      batchIdx = i;
+      batchIV = v;
+      numBatch = range->getNumIters();
+      startIndices.push_back(range->lb);
+      limitIndices.push_back(range->ub);
+      continue;
+    }
+
+    // The window expression o + k + c.
+    if (spatialIdx || dims.size() != 2)
+      return nullptr;
+    unsigned kPos = dims[0], oPos = dims[1];
+    if (accessValueMap.getOperand(oPos) == iv)
+      std::swap(kPos, oPos);
+    Value o = accessValueMap.getOperand(oPos);
+    if (accessValueMap.getOperand(kPos) != iv || o == iv ||
+        !pc.isParallelIV(o))
+      return nullptr;
+    auto oRange = getIVRange(o);
+    if (!oRange || oRange->step != 1)
+      return nullptr;
+    auto offset = dyn_cast<AffineConstantExpr>(simplifyAffineExpr(
+        E - builder.getAffineDimExpr(oPos) - builder.getAffineDimExpr(kPos),
+        accessMap.getNumDims(), 0));
+    if (!offset)
+      return nullptr;
+    spatialIdx = i;
+    outIV = o;
+    numOut = oRange->getNumIters();
+    int64_t start = oRange->lb + kRange->lb + offset.getValue();
+    startIndices.push_back(start);
+    limitIndices.push_back(start + numOut + kRange->getNumIters() - 1);
+  }
+  if (!spatialIdx || batchIV == outIV)
+    return nullptr;
+  for (auto [start, limit, size] :
+       llvm::zip_equal(startIndices, limitIndices, inputTy.getShape()))
+    if (start < 0 || limit > size)
+      return nullptr;
+
+  Value window = stablehlo::SliceOp::create(builder, loc, input, startIndices,
+                                            limitIndices, strides);
+
+  // Keep the relative order of the batch and spatial dimensions so the
+  // reshapes below do not need a transpose.
+  bool batchFirst = !batchIdx || *batchIdx < *spatialIdx;
+  int64_t numWindow = numOut + kRange->getNumIters() - 1;
+  int64_t batchDim = batchFirst ? 0 : 1, spatialDim = batchFirst ? 1 : 0;
+  SmallVector<int64_t> inShape(3, 1), outShape(3, 1);
+  inShape[batchDim] = outShape[batchDim] = numBatch;
+  inShape[spatialDim] = numWindow;
+  outShape[spatialDim] = numOut;
+
+  auto ET = inputTy.getElementType();
+  window = stablehlo::ReshapeOp::create(
+      builder, loc, RankedTensorType::get(inShape, ET), window);
+  kernel = stablehlo::ReshapeOp::create(
+      builder, loc, RankedTensorType::get({kRange->getNumIters(), 1, 1}, ET),
+      kernel);
+
+  auto convDims = stablehlo::ConvDimensionNumbersAttr::get(
+      builder.getContext(),
+      /*input_batch_dimension=*/batchDim,
+      /*input_feature_dimension=*/2,
+      /*input_spatial_dimensions=*/{spatialDim},
+      /*kernel_input_feature_dimension=*/1,
+      /*kernel_output_feature_dimension=*/2,
+      /*kernel_spatial_dimensions=*/{0},
+      /*output_batch_dimension=*/batchDim,
+      /*output_feature_dimension=*/2,
+      /*output_spatial_dimensions=*/{spatialDim});
+  Value conv = stablehlo::ConvolutionOp::create(
+      builder, loc, RankedTensorType::get(outShape, ET), window, kernel,
+      /*window_strides=*/nullptr,
+      /*padding=*/nullptr,
+      /*lhs_dilation=*/nullptr,
+      /*rhs_dilation=*/nullptr,
+      /*window_reversal=*/nullptr,
+      /*conv_dimension_numbers=*/convDims,
+      /*feature_group_count=*/builder.getI64IntegerAttr(1),
+      /*batch_group_count=*/builder.getI64IntegerAttr(1),
+      /*precision_config=*/nullptr);
+
+  SmallVector<int64_t> resultShape;
+  SmallVector<Value> resultIVs;
+  if (batchIV && batchFirst) {
+    resultShape.push_back(numBatch);
+    resultIVs.push_back(batchIV);
+  }
+  resultShape.push_back(numOut);
+  resultIVs.push_back(outIV);
+  if (batchIV && !batchFirst) {
+    resultShape.push_back(numBatch);
+    resultIVs.push_back(batchIV);
+  }
+  Value res = stablehlo::ReshapeOp::create(
+      builder, loc, RankedTensorType::get(resultShape, ET), conv);
+
+  resultMap = affine::AffineValueMap(
+      AffineMap::getMultiDimIdentityMap(resultIVs.size(), builder.getContext()),
+      resultIVs);
+  return res;
+}
+
+// Raises `iter + lhs * rhs` (or `iter - lhs * rhs`) reduced over the induction
+// variable of `forOp` to a convolution or dot_general followed by a single
+// update of the init value. Only applies when the partial sums are used
+// exclusively by the terminator, otherwise the prefix sum emitted by the
+// generic reduction path is needed.
+static LogicalResult tryRaisingContractionToStableHLO(
+    Operation *innerOp, unsigned op_idx, Value init_val,
+    affine::AffineForOp forOp, IRMapping &mapping, OpBuilder &builder,
+    llvm::DenseMap<Value, affine::AffineValueMap> &maps, ParallelContext pc) {
+  bool isSub = isa<arith::SubIOp, arith::SubFOp>(innerOp);
+  if (!isa<arith::AddIOp, arith::AddFOp>(innerOp) && !(isSub && op_idx == 0))
+    return failure();
+
+  Value partial = innerOp->getResult(0);
+  if (!partial.hasOneUse() ||
+      *partial.getUsers().begin() != forOp.getBody()->getTerminator())
+    return failure();
+
+  auto mul = innerOp->getOperand(1 - op_idx).getDefiningOp();
+  if (!isa_and_nonnull<arith::MulIOp, arith::MulFOp>(mul))
+    return failure();
+
+  auto loc =
+      rewriteLocation(innerOp->getLoc(), pc.options.strip_llvm_debuginfo);
+
+  affine::AffineValueMap resultMap;
+  Value result;
+  for (unsigned i = 0; i < 2 && !result; i++) {
+    // The convolution reads the memref as mapped at innerOp, so it must not
+    // have been stored to since the load.
+    auto load = mul->getOperand(i).getDefiningOp<affine::AffineLoadOp>();
+    if (!load || load->getBlock() != innerOp->getBlock())
+      continue;
+    bool stored = false;
+    for (Operation *op = load->getNextNode(); op != innerOp;
+         op = op->getNextNode()) {
+      // Ops with unknown effects, e.g. calls, may write as well.
+      auto effects = getEffectsRecursively(op);
+      stored |= !effects ||
+                llvm::any_of(*effects, [](const auto &effect) {
+                  return isa<MemoryEffects::Write>(effect.getEffect());
+                });
+    }
+    if (!stored)
+      result = emitContractionAsConvolution(forOp, load, mul->getOperand(1 - i),
+                                            resultMap, mapping, maps, builder,
+                                            loc, pc);
+  }
+  if (!result)
+    result = emitContractionAsDotGeneral(
+        forOp, mapping.lookup(mul->getOperand(0)),
+        mapping.lookup(mul->getOperand(1)), resultMap, maps, builder, loc);
+  if (!result)
+    return failure();
+
+  Value init = mapping.lookup(init_val);
+  auto outputMap = alignMemoryAccess(result, resultMap, init,
+                                     maps.lookup(init), builder, pc);
+  if (isSub)
+    result = stablehlo::SubtractOp::create(builder, loc, init, result);
+  else
+    result = stablehlo::AddOp::create(builder, loc, result, init);
+
+  mapping.map(partial, result);
+  maps[result] = outputMap;
+  return success();
+}
+
 template <class T> static SmallVector<BlockArgument, 6> getIVs(T op);
 template <> SmallVector<BlockArgument, 6> getIVs(affine::AffineParallelOp op) {
   return {op.getIVs().begin(), op.getIVs().end()};
@@ -1314,6 +1632,14 @@ static LogicalResult tryRaisingParallelOpToStableHLO(
       Value reduced_val = innerOp.getOperand(1 - op_idx);
       Value init_val = iter_inputs[reduced_idx];
 
+      if (tryRaisingContractionToStableHLO(
+              &innerOp, op_idx, init_val,
+              cast<affine::AffineForOp>(
+                  iters[reduced_idx].getOwner()->getParentOp()),
+              mapping, builder, maps, *newPc)
+              .succeeded())
+        continue;
+
       Value reduce_broadcasted = mapping.lookup(reduced_val);
       auto reduce_map = maps.lookup(reduce_broadcasted);
 
@@ -1632,13 +1958,334 @@ static LogicalResult tryRaisingParallelOpToStableHLO(
   return success();
 }
 
+namespace {
+
+// Number of induction variables of the affine loops enclosing `op`. This is
+// the position of the induction variable of `op` (if it is a loop) in the
+// iteration domains built by polymer for the statements nested in it.
+static unsigned getNumEnclosingIVs(Operation *op) {
+  SmallVector<Operation *, 4> enclosing;
+  affine::getEnclosingAffineOps(*op, &enclosing);
+  unsigned numIVs = 0;
+  for (Operation *loop : enclosing) {
+    if (isa<affine::AffineForOp>(loop))
+      numIVs++;
+    else if (auto parallelOp = dyn_cast<affine::AffineParallelOp>(loop))
+      numIVs += parallelOp.getNumDims();
+  }
+  return numIVs;
+}
+
+// Polyhedral loop-carried dependence information for the affine.for loops of
+// a kernel, computed from the polymer IslScop.
+//
+// Building the scop annotates the IR and materializes iteration arguments as
+// extra statements, so the model is built on a scratch clone of the function
+// and queries on original loops are mapped to the clone.
+class IslLoopDependences {
+public:
+  struct Access {
+    Operation *op;
+    polymer::ScopArrayInfo *array;
+    // Access relation restricted to the iteration domain of the statement.
+    isl::map relation;
+    bool isWrite;
+  };
+
+  explicit IslLoopDependences(func::FuncOp func) {
+    clone = func.clone(mapping);
+    scop = polymer::createIslFromFuncOp(clone);
+  }
+  ~IslLoopDependences() {
+    scop.reset();
+    clone->erase();
+  }
+
+  bool isValid() const { return scop != nullptr; }
+
+  // Whether no two accesses nested in `forOp`, at least one of them a write,
+  // touch the same element in different iterations of `forOp`.
+  bool isParallel(affine::AffineForOp forOp) {
+    if (!isValid())
+      return false;
+    if (llvm::any_of(forOp.getResultTypes(), llvm::IsaPred<BaseMemRefType>))
+      return false;
+    auto clonedFor =
+        cast<affine::AffineForOp>(mapping.lookup(forOp.getOperation()));
+    unsigned depth = getNumEnclosingIVs(clonedFor);
+    SmallVector<Access> accesses = getNestedAccesses(clonedFor);
+    for (auto &&[i, src] : llvm::enumerate(accesses)) {
+      for (auto &dst : ArrayRef(accesses).drop_front(i)) {
+        if (src.array != dst.array || (!src.isWrite && !dst.isWrite))
+          continue;
+        if (mayConflict(src, dst, depth, /*acrossIterations=*/true)) {
+          LLVM_DEBUG(llvm::dbgs() << "isl: carried dependence in " << forOp
+                                  << " between " << *src.op << " and "
+                                  << *dst.op << "\n");
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // Whether `load` and `store`, both directly in the body of `forOp`, are the
+  // only accesses in `forOp` touching the elements they access. Other reads
+  // of the loaded elements are allowed.
+  bool isIsolatedRecurrence(affine::AffineForOp forOp,
+                            affine::AffineLoadOp load,
+                            affine::AffineStoreOp store) {
+    if (!isValid())
+      return false;
+    auto clonedFor =
+        cast<affine::AffineForOp>(mapping.lookup(forOp.getOperation()));
+    Operation *clonedLoad = mapping.lookup(load.getOperation());
+    Operation *clonedStore = mapping.lookup(store.getOperation());
+    unsigned depth = getNumEnclosingIVs(clonedFor);
+    SmallVector<Access> accesses = getNestedAccesses(clonedFor);
+    const Access *loadAccess = nullptr, *storeAccess = nullptr;
+    for (auto &access : accesses) {
+      if (access.op == clonedLoad)
+        loadAccess = &access;
+      if (access.op == clonedStore)
+        storeAccess = &access;
+    }
+    if (!loadAccess || !storeAccess)
+      return false;
+    for (auto &other : accesses) {
+      if (other.op == clonedLoad || other.op == clonedStore ||
+          other.array != storeAccess->array)
+        continue;
+      if (mayConflict(other, *storeAccess, depth, /*acrossIterations=*/false))
+        return false;
+      if (other.isWrite &&
+          mayConflict(other, *loadAccess, depth, /*acrossIterations=*/false))
+        return false;
+    }
+    return true;
+  }
+
+private:
+  // Whether some instances of `a` and `b` that agree on the `depth` loops
+  // enclosing the loop of interest access the same element. With
+  // `acrossIterations` only pairs from different iterations of that loop are
+  // considered.
+  static bool mayConflict(const Access &a, const Access &b, unsigned depth,
+                          bool acrossIterations) {
+    isl::map conflicts = a.relation.apply_range(b.relation.reverse());
+    for (unsigned i = 0; i < depth; i++)
+      conflicts = conflicts.equate(isl::dim::in, i, isl::dim::out, i);
+    if (acrossIterations)
+      conflicts = conflicts.subtract(
+          conflicts.equate(isl::dim::in, depth, isl::dim::out, depth));
+    // Treat isl errors as a possible conflict.
+    return !conflicts.is_empty().is_true();
+  }
+
+  SmallVector<Access> getNestedAccesses(affine::AffineForOp clonedFor) {
+    SmallVector<Access> accesses;
+    clonedFor->walk([&](Operation *op) {
+      if (!isa<affine::AffineReadOpInterface, affine::AffineWriteOpInterface>(
+              op))
+        return;
+      polymer::ScopStmt &stmt = scop->getStatement(op);
+      for (polymer::MemoryAccess *ma : stmt) {
+        if (ma->Kind != polymer::MemoryAccess::MT_Array || ma->isKill())
+          continue;
+        // Memrefs allocated inside the loop are private to an iteration.
+        if (Operation *def = ma->AI->val.getDefiningOp())
+          if (clonedFor->isProperAncestor(def))
+            continue;
+        accesses.push_back(
+            Access{op, ma->AI,
+                   ma->getAccessRelation().intersect_domain(stmt.getDomain()),
+                   ma->isWrite()});
+      }
+    });
+    return accesses;
+  }
+
+  IRMapping mapping;
+  func::FuncOp clone;
+  std::unique_ptr<polymer::IslScop> scop;
+};
+
+// A load/store pair on the same memref in the body of an affine.for which
+// carries a value from one iteration to the next through memory:
+//
+//   reduction:  A[m] = A[m] + f(i)        (location invariant in the loop)
+//   scan:       A[g(i)] = A[g(i - step)] + f(i)
+struct MemoryRecurrence {
+  affine::AffineLoadOp load;
+  affine::AffineStoreOp store;
+  bool isReduction;
+};
+
+static bool isDefinedOutside(affine::AffineForOp forOp, ValueRange values) {
+  return llvm::all_of(
+      values, [&](Value v) { return forOp.isDefinedOutsideOfLoop(v); });
+}
+
+// Syntactically match `load` and `store` as a reduction or a scan of distance
+// one in `forOp`. Legality w.r.t. the other accesses in the loop is checked
+// separately with IslLoopDependences::isIsolatedRecurrence.
+static std::optional<bool> matchMemoryRecurrence(affine::AffineForOp forOp,
+                                                 affine::AffineLoadOp load,
+                                                 affine::AffineStoreOp store) {
+  Value iv = forOp.getInductionVar();
+  affine::MemRefAccess loadAccess(load), storeAccess(store);
+  affine::AffineValueMap loadMap, storeMap;
+  loadAccess.getAccessMap(&loadMap);
+  storeAccess.getAccessMap(&storeMap);
+
+  auto otherOperandsOutside = [&](const affine::AffineValueMap &map) {
+    return llvm::all_of(map.getOperands(), [&](Value v) {
+      return v == iv || forOp.isDefinedOutsideOfLoop(v);
+    });
+  };
+  if (!otherOperandsOutside(loadMap) || !otherOperandsOutside(storeMap))
+    return std::nullopt;
+
+  if (loadAccess == storeAccess) {
+    if (!isDefinedOutside(forOp, loadMap.getOperands()))
+      return std::nullopt;
+    return true;
+  }
+
+  // The store must write a distinct element in every iteration, i.e. be a
+  // non-degenerate affine function of the induction variable.
+  std::optional<unsigned> ivPos;
+  for (unsigned i = 0, e = storeMap.getNumDims(); i < e; i++)
+    if (storeMap.getOperand(i) == iv)
+      ivPos = i;
+  if (!ivPos)
+    return std::nullopt;
+  AffineMap sMap = storeMap.getAffineMap();
+  if (!llvm::all_of(sMap.getResults(),
+                    [](AffineExpr e) { return e.isPureAffine(); }) ||
+      !llvm::any_of(sMap.getResults(), [&](AffineExpr e) {
+        return e.isFunctionOfDim(*ivPos);
+      }))
+    return std::nullopt;
+
+  // load(i) == store(i - step)
+  MLIRContext *ctx = forOp.getContext();
+  AffineExpr ivExpr = getAffineDimExpr(*ivPos, ctx);
+  AffineMap shifted = sMap.replace(ivExpr, ivExpr - forOp.getStepAsInt(),
+                                   sMap.getNumDims(), sMap.getNumSymbols());
+  affine::AffineValueMap shiftedMap(shifted, storeMap.getOperands());
+  affine::AffineValueMap diff;
+  affine::AffineValueMap::difference(loadMap, shiftedMap, &diff);
+  if (!llvm::all_of(diff.getAffineMap().getResults(), [](AffineExpr e) {
+        auto cst = dyn_cast<AffineConstantExpr>(e);
+        return cst && cst.getValue() == 0;
+      }))
+    return std::nullopt;
+  return false;
+}
+
+static SmallVector<MemoryRecurrence>
+findMemoryRecurrences(affine::AffineForOp forOp, IslLoopDependences &deps) {
+  SmallVector<MemoryRecurrence> recurrences;
+  if (!forOp.hasConstantBounds() ||
+      forOp.getConstantUpperBound() <= forOp.getConstantLowerBound())
+    return recurrences;
+
+  llvm::SmallPtrSet<Operation *, 4> used;
+  for (auto store : forOp.getBody()->getOps<affine::AffineStoreOp>()) {
+    Operation *update = store.getValueToStore().getDefiningOp();
+    if (!isa_and_nonnull<arith::AddFOp, arith::AddIOp, arith::SubFOp,
+                         arith::SubIOp>(update) ||
+        update->getBlock() != forOp.getBody())
+      continue;
+    // Only the minuend of a subtraction is a valid recurrence input.
+    unsigned numCandidates =
+        isa<arith::SubFOp, arith::SubIOp>(update) ? 1 : 2;
+    for (unsigned i = 0; i < numCandidates; i++) {
+      auto load = update->getOperand(i).getDefiningOp<affine::AffineLoadOp>();
+      if (!load || load.getMemRef() != store.getMemRef() ||
+          load->getBlock() != forOp.getBody() || used.contains(load))
+        continue;
+      auto isReduction = matchMemoryRecurrence(forOp, load, store);
+      if (!isReduction)
+        continue;
+      if (!deps.isIsolatedRecurrence(forOp, load, store)) {
+        LLVM_DEBUG(llvm::dbgs()
+                   << "isl: recurrence " << load << " -> " << store
+                   << " interferes with other accesses\n");
+        continue;
+      }
+      used.insert(load);
+      recurrences.push_back(MemoryRecurrence{load, store, *isReduction});
+      break;
+    }
+  }
+  return recurrences;
+}
+
+// Turn the memory recurrences of `forOp` into loop-carried values, which the
+// lockstep raising then emits as a reduce_window based reduction or prefix
+// computation:
+//
+//   affine.for %i {                         %init = affine.load A[g(lb - step)]
+//     %a = affine.load A[g(i - step)]       affine.for %i iter_args(%a = %init)
+//     %b = arith.addf %a, %x          -->     %b = arith.addf %a, %x
+//     affine.store %b, A[g(i)]                affine.store %b, A[g(i)]
+//   }                                         affine.yield %b
+//
+// For reductions the store is sunk after the loop instead.
+static void promoteMemoryRecurrences(affine::AffineForOp forOp,
+                                     ArrayRef<MemoryRecurrence> recurrences) {
+  IRRewriter rewriter(forOp.getContext());
+  rewriter.setInsertionPoint(forOp);
+
+  Value lb = arith::ConstantIndexOp::create(rewriter, forOp.getLoc(),
+                                            forOp.getConstantLowerBound());
+  SmallVector<Value> inits;
+  for (auto &rec : recurrences) {
+    IRMapping firstIteration;
+    firstIteration.map(forOp.getInductionVar(), lb);
+    inits.push_back(rewriter.clone(*rec.load, firstIteration)->getResult(0));
+  }
+
+  unsigned numResults = forOp.getNumResults();
+  auto newLoop = forOp.replaceWithAdditionalYields(
+      rewriter, inits, /*replaceInitOperandUsesInLoop=*/false,
+      [&](OpBuilder &, Location, ArrayRef<BlockArgument>) {
+        SmallVector<Value> yielded;
+        for (auto &rec : recurrences)
+          yielded.push_back(rec.store.getValueToStore());
+        return yielded;
+      });
+  assert(succeeded(newLoop));
+  auto newFor = cast<affine::AffineForOp>(newLoop->getOperation());
+
+  rewriter.setInsertionPointAfter(newFor);
+  for (auto &&[i, rec] : llvm::enumerate(recurrences)) {
+    rewriter.replaceAllUsesWith(rec.load.getResult(),
+                                newFor.getRegionIterArgs()[numResults + i]);
+    rewriter.eraseOp(rec.load);
+    if (rec.isReduction) {
+      IRMapping finalValue;
+      finalValue.map(rec.store.getValueToStore(),
+                     newFor.getResult(numResults + i));
+      rewriter.clone(*rec.store, finalValue);
+      rewriter.eraseOp(rec.store);
+    }
+  }
+}
+
+} // namespace
+
 bool isLoopLockStepExecutable(
     affine::AffineForOp forOp,
     SmallVectorImpl<affine::LoopReduction> *parallelReductions);
 static bool isLockStepExecutable(affine::AffineForOp forOp,
                                  ParallelContext &pc) {
   SmallVector<mlir::affine::LoopReduction> red;
-  if (isLoopLockStepExecutable(forOp, &red)) {
+  if (isLoopLockStepExecutable(forOp, &red) ||
+      (pc.options.islParallelLoops &&
+       pc.options.islParallelLoops->contains(forOp))) {
 
     llvm::SmallSet<Operation *, 1> reductions;
     for (auto &&[i, arg] : llvm::enumerate(forOp.getRegionIterArgs())) {
@@ -2690,6 +3337,41 @@ struct AffineToStableHLORaisingPass
 
     auto context = getOperation()->getContext();
 
+    auto op = getOperation();
+
+    // Identify raised kernels which takes in memrefs instead of tensors
+    auto isKernel = [](func::FuncOp func) {
+      auto FT = dyn_cast<FunctionType>(func.getFunctionType());
+      return FT &&
+             llvm::all_of(FT.getInputs(),
+                          [](Type argTy) { return isa<MemRefType>(argTy); }) &&
+             FT.getNumResults() == 0 && FT.getNumInputs() != 0;
+    };
+
+    if (use_isl_dependences) {
+      op->walk([&](func::FuncOp func) {
+        if (!isKernel(func))
+          return;
+        IslLoopDependences deps(func);
+        if (!deps.isValid())
+          return;
+        // Post-order, so that promoting an inner loop does not invalidate the
+        // outer loops collected so far.
+        SmallVector<
+            std::pair<affine::AffineForOp, SmallVector<MemoryRecurrence>>>
+            toPromote;
+        func.walk([&](affine::AffineForOp forOp) {
+          auto recurrences = findMemoryRecurrences(forOp, deps);
+          if (!recurrences.empty())
+            toPromote.emplace_back(forOp, std::move(recurrences));
+        });
+        for (auto &[forOp, recurrences] : toPromote) {
+          numPromotedRecurrences += recurrences.size();
+          promoteMemoryRecurrences(forOp, recurrences);
+        }
+      });
+    }
+
     if (enable_lockstep_for) {
 
       RewritePatternSet patterns(context);
@@ -2701,18 +3383,9 @@ struct AffineToStableHLORaisingPass
       }
     }
 
-    auto op = getOperation();
-
     op->walk([&](func::FuncOp func) {
-      auto FT = dyn_cast<FunctionType>(func.getFunctionType());
-
-      // Identify raised kernels which takes in memrefs instead of tensors
-      if (FT &&
-          llvm::all_of(FT.getInputs(),
-                       [](Type argTy) { return isa<MemRefType>(argTy); }) &&
-          FT.getNumResults() == 0 && FT.getNumInputs() != 0) {
+      if (isKernel(func))
         funcs.push_back(func);
-      }
     });
 
     SymbolTableCollection symbolTable;
@@ -2722,7 +3395,22 @@ struct AffineToStableHLORaisingPass
     while (!funcs.empty()) {
       auto kernelFunc = funcs.back();
       ArrayRef<Operation *> users = userMap.getUsers(kernelFunc);
-      bool raised = tryRaisingToStableHLO(kernelFunc, users, options);
+
+      ParallelContext::Options kernelOptions = options;
+      llvm::SmallPtrSet<Operation *, 8> islParallelLoops;
+      if (use_isl_dependences && enable_lockstep_for) {
+        IslLoopDependences deps(kernelFunc);
+        kernelFunc.walk([&](affine::AffineForOp forOp) {
+          if (deps.isParallel(forOp))
+            islParallelLoops.insert(forOp);
+        });
+        numIslParallelLoops += islParallelLoops.size();
+        kernelOptions.islParallelLoops = &islParallelLoops;
+      }
+
+      bool raised = tryRaisingToStableHLO(kernelFunc, users, kernelOptions);
+      if (raised)
+        numRaisedKernels++;
       anyRaised |= raised;
       if (!raised && err_if_not_fully_raised) {
         llvm::errs() << "failed to raise func: " << *kernelFunc << "\n";
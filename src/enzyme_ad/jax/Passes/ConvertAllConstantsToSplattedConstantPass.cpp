@@ -1,3 +1,5 @@
+#include "mlir/IR/BuiltinAttributes.h"
+#include "mlir/IR/DialectResourceBlobManager.h"
 #include "mlir/IR/PatternMatch.h"
 #include "mlir/Pass/Pass.h"
 #include "mlir/Transforms/GreedyPatternRewriteDriver.h"
@@ -5,6 +7,7 @@
 #include "stablehlo/dialect/StablehloOps.h"
 
 #include "src/enzyme_ad/jax/Utils.h"
+#include "llvm/Support/MathExtras.h"
 
 using namespace mlir;
 using namespace mlir::stablehlo;
@@ -22,6 +25,14 @@ struct ConvertSHLOConstantsToSplat
 
   LogicalResult matchAndRewrite(stablehlo::ConstantOp op,
                                 PatternRewriter &rewriter) const override {
+    if (auto resource = dyn_cast<DenseResourceElementsAttr>(op.getValue())) {
+      auto splatAttr = getFirstElementSplat(resource);
+      if (!splatAttr)
+        return failure();
+      rewriter.replaceOpWithNewOp<stablehlo::ConstantOp>(op, splatAttr);
+      return success();
+    }
+
     auto attr = cast<DenseElementsAttr>(op.getValue());
     if (attr.isSplat()) // already splatted
       return failure();
@@ -33,6 +44,36 @@ struct ConvertSHLOConstantsToSplat
     rewriter.replaceOpWithNewOp<stablehlo::ConstantOp>(op, splatAttr);
     return success();
   }
+
+  // Splats the first element of a resource blob, without materializing the
+  // rest of it. Returns null if the blob is not available.
+  static DenseElementsAttr
+  getFirstElementSplat(DenseResourceElementsAttr resource) {
+    auto type = resource.getType();
+    auto *blob = resource.getRawHandle().getBlob();
+    if (!blob || type.getNumElements() == 0)
+      return {};
+
+    Type elemTy = type.getElementType();
+    Type scalarTy = elemTy;
+    if (auto complexTy = dyn_cast<ComplexType>(elemTy))
+      scalarTy = complexTy.getElementType();
+    if (!scalarTy.isIntOrFloat())
+      return {};
+    size_t elemBytes = llvm::divideCeil(scalarTy.getIntOrFloatBitWidth(), 8);
+    if (isa<ComplexType>(elemTy))
+      elemBytes *= 2;
+
+    ArrayRef<char> data = blob->getData();
+    if (data.size() < elemBytes)
+      return {};
+    // Resource blobs store one byte per i1, unlike dense raw buffers.
+    if (elemTy.isInteger(1))
+      return DenseElementsAttr::get(type, data.front() != 0);
+    // A raw buffer holding a single element is a splat.
+    return DenseElementsAttr::getFromRawBuffer(type,
+                                               data.take_front(elemBytes));
+  }
 };
 
 namespace {
@@ -0,0 +1,746 @@
+//===- EnzymeHLOLayoutAssignment.cpp - Global transpose placement ---------===//
+//
+// This file implements a pass that assigns a dimension ordering to groups of
+// values connected through elementwise ops and while-loop carried values.
+// dot_general and reduce relate the orderings of their operands to the one
+// of their result, and the orderings of related groups are chosen jointly so
+// that the transposes materialized at the group boundaries are minimized,
+// weighted by tensor size and loop trip counts.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/IR/Builders.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "shardy/dialect/sdy/ir/utils.h"
+#include "src/enzyme_ad/jax/Implementations/WhileLoopInfo.h"
+#include "src/enzyme_ad/jax/Passes/Passes.h"
+#include "src/enzyme_ad/jax/Utils.h"
+#include "stablehlo/dialect/StablehloOps.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/Sequence.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/Support/MathExtras.h"
+
+namespace mlir {
+namespace enzyme {
+#define GEN_PASS_DEF_ENZYMEHLOLAYOUTASSIGNMENTPASS
+#include "src/enzyme_ad/jax/Passes/Passes.h.inc"
+} // namespace enzyme
+} // namespace mlir
+
+using namespace mlir;
+using namespace mlir::enzyme;
+
+namespace {
+
+// transpose(transpose(x, inner), outer) == transpose(x, result).
+SmallVector<int64_t> composePermutations(ArrayRef<int64_t> inner,
+                                         ArrayRef<int64_t> outer) {
+  SmallVector<int64_t> result;
+  for (auto dim : outer)
+    result.push_back(inner[dim]);
+  return result;
+}
+
+SmallVector<int64_t> getIdentityPermutation(int64_t rank) {
+  return llvm::to_vector(llvm::seq<int64_t>(0, rank));
+}
+
+bool isIdentityPermutation(ArrayRef<int64_t> perm) {
+  return llvm::equal(perm, llvm::seq<int64_t>(0, perm.size()));
+}
+
+RankedTensorType getPermutedType(RankedTensorType ty, ArrayRef<int64_t> perm) {
+  SmallVector<int64_t> shape;
+  for (auto dim : perm)
+    shape.push_back(ty.getDimSize(dim));
+  return ty.clone(shape);
+}
+
+// Positions of `dims` in a value transposed by `perm`.
+SmallVector<int64_t> remapDimensions(ArrayRef<int64_t> dims,
+                                     ArrayRef<int64_t> perm) {
+  SmallVector<int64_t> invPerm = stablehlo::getInversePermutation(perm);
+  SmallVector<int64_t> result;
+  for (auto dim : dims)
+    result.push_back(invPerm[dim]);
+  return result;
+}
+
+bool hasFlexibleType(Value v) {
+  auto ty = dyn_cast<RankedTensorType>(v.getType());
+  return ty && ty.hasStaticShape() && ty.getRank() >= 2 &&
+         !sdy::getSharding(v);
+}
+
+// Elementwise ops whose operands are either of the result shape or scalars
+// compute the same values in any dimension ordering.
+bool isElementwiseCandidate(Operation *op) {
+  if (!isa_and_nonnull<stablehlo::StablehloDialect>(op->getDialect()) ||
+      !stablehlo::hasTraitElementwise(op) || op->getNumResults() != 1 ||
+      op->getNumRegions() != 0 || !hasFlexibleType(op->getResult(0)))
+    return false;
+  auto shape = cast<RankedTensorType>(op->getResult(0).getType()).getShape();
+  return llvm::all_of(op->getOperandTypes(), [&](Type type) {
+    auto ty = dyn_cast<RankedTensorType>(type);
+    return ty && (ty.getRank() == 0 || ty.getShape() == shape);
+  });
+}
+
+// dot_general and single-input reduce read their operands in any dimension
+// ordering once their dimension attributes are remapped, at the price of a
+// permuted result.
+bool isLayoutOp(Operation *op) {
+  auto isStatic = [](Value v) {
+    auto ty = dyn_cast<RankedTensorType>(v.getType());
+    return ty && ty.hasStaticShape();
+  };
+  if (auto dot = dyn_cast<stablehlo::DotGeneralOp>(op))
+    return isStatic(dot.getLhs()) && isStatic(dot.getRhs()) &&
+           isStatic(dot.getResult());
+  if (auto reduce = dyn_cast<stablehlo::ReduceOp>(op))
+    return reduce.getInputs().size() == 1 &&
+           isStatic(reduce.getInputs()[0]) && isStatic(reduce.getResult(0));
+  return false;
+}
+
+SmallVector<Value> getLayoutOperands(Operation *op) {
+  if (auto dot = dyn_cast<stablehlo::DotGeneralOp>(op))
+    return {dot.getLhs(), dot.getRhs()};
+  return {cast<stablehlo::ReduceOp>(op).getInputs()[0]};
+}
+
+// Appends the result positions of the operand dimensions that are not
+// `dropped`, in the order in which an operand transposed by `perm` holds
+// them. Kept dimensions appear in the result in increasing order, starting at
+// `offset`.
+void appendKeptDimensions(ArrayRef<int64_t> perm, ArrayRef<int64_t> dropped,
+                          int64_t offset, SmallVectorImpl<int64_t> &result) {
+  for (auto dim : perm) {
+    if (llvm::is_contained(dropped, dim))
+      continue;
+    int64_t numDroppedBefore =
+        llvm::count_if(dropped, [&](int64_t d) { return d < dim; });
+    result.push_back(offset + dim - numDroppedBefore);
+  }
+}
+
+// Returns the permutation of its original result that `op` computes once its
+// operands are transposed by `operandPerms` and its dimension attributes are
+// remapped accordingly.
+SmallVector<int64_t>
+getResultPermutation(Operation *op,
+                     ArrayRef<SmallVector<int64_t>> operandPerms) {
+  SmallVector<int64_t> result;
+  if (auto dot = dyn_cast<stablehlo::DotGeneralOp>(op)) {
+    // Batch dimensions come first in the order of the attribute, followed by
+    // the free dimensions of the lhs and then of the rhs.
+    auto dims = dot.getDotDimensionNumbers();
+    int64_t numBatch = dims.getLhsBatchingDimensions().size();
+    result = getIdentityPermutation(numBatch);
+    SmallVector<int64_t> lhsDropped(dims.getLhsBatchingDimensions());
+    llvm::append_range(lhsDropped, dims.getLhsContractingDimensions());
+    SmallVector<int64_t> rhsDropped(dims.getRhsBatchingDimensions());
+    llvm::append_range(rhsDropped, dims.getRhsContractingDimensions());
+    appendKeptDimensions(operandPerms[0], lhsDropped, numBatch, result);
+    appendKeptDimensions(operandPerms[1], rhsDropped,
+                         numBatch + operandPerms[0].size() - lhsDropped.size(),
+                         result);
+    return result;
+  }
+  auto reduce = cast<stablehlo::ReduceOp>(op);
+  appendKeptDimensions(operandPerms[0], reduce.getDimensions(), 0, result);
+  return result;
+}
+
+// Calls `fn` with every tuple of indices below `sizes`, starting with all
+// zeros.
+void forEachCombination(ArrayRef<size_t> sizes,
+                        function_ref<void(ArrayRef<size_t>)> fn) {
+  if (llvm::is_contained(sizes, 0))
+    return;
+  SmallVector<size_t> indices(sizes.size(), 0);
+  while (true) {
+    fn(indices);
+    size_t i = 0;
+    for (; i < indices.size(); i++) {
+      if (++indices[i] < sizes[i])
+        break;
+      indices[i] = 0;
+    }
+    if (i == indices.size())
+      return;
+  }
+}
+
+class LayoutAssignment {
+public:
+  LayoutAssignment(func::FuncOp func, int64_t unknownTripCount)
+      : func(func), unknownTripCount(unknownTripCount) {}
+
+  void run() {
+    buildGroups();
+    collectBoundaries();
+    collectCandidates();
+    solve();
+    rewrite();
+  }
+
+private:
+  // Sets of related groups with at most this many assignments are solved
+  // exactly; larger ones by coordinate descent.
+  static constexpr uint64_t kMaxEnumeratedAssignments = 4096;
+  static constexpr size_t kMaxCandidates = 16;
+  static constexpr unsigned kMaxSweeps = 16;
+
+  // A value feeding a group from outside, possibly through a transpose that
+  // is folded into the one materialized for the new ordering.
+  struct Input {
+    Value source;
+    SmallVector<int64_t> permutation;
+    stablehlo::TransposeOp absorbed;
+    SmallVector<OpOperand *> uses;
+  };
+
+  struct Group {
+    SmallVector<Value> values;
+    llvm::MapVector<Value, Input> inputs;
+    SmallVector<stablehlo::TransposeOp> transposeUsers;
+    // Uses outside of the group, collected before any rewriting creates new
+    // ones.
+    llvm::MapVector<Value, SmallVector<OpOperand *>> escaping;
+    SmallVector<SmallVector<int64_t>> candidates;
+    SmallVector<uint64_t> boundaryCosts;
+  };
+
+  func::FuncOp func;
+  int64_t unknownTripCount;
+  llvm::MapVector<Value, Value> parent;
+  DenseMap<Operation *, uint64_t> tripCounts;
+  SmallVector<Group> groups;
+  DenseMap<Value, unsigned> groupIndices;
+  llvm::SetVector<Operation *> layoutOps;
+  // The candidate ordering chosen for every group.
+  SmallVector<unsigned> choices;
+
+  Value find(Value v) {
+    Value root = parent.lookup(v);
+    if (root == v)
+      return v;
+    root = find(root);
+    parent[v] = root;
+    return root;
+  }
+
+  void unite(Value a, Value b) {
+    Value rootA = find(a), rootB = find(b);
+    if (rootA != rootB)
+      parent[rootB] = rootA;
+  }
+
+  bool isFlexible(Value v) { return parent.contains(v); }
+
+  unsigned getGroupIndex(Value v) { return groupIndices.lookup(find(v)); }
+
+  // Returns the group value `use` flows into, if the use does not need the
+  // operand in the original ordering.
+  Value getLayoutTarget(OpOperand &use) {
+    Operation *owner = use.getOwner();
+    unsigned idx = use.getOperandNumber();
+    if (auto whileOp = dyn_cast<stablehlo::WhileOp>(owner)) {
+      Value result = whileOp.getResult(idx);
+      return isFlexible(result) ? result : Value();
+    }
+    if (isa<stablehlo::ReturnOp>(owner)) {
+      auto whileOp = dyn_cast<stablehlo::WhileOp>(owner->getParentOp());
+      if (!whileOp || owner->getParentRegion() != &whileOp.getBody())
+        return Value();
+      Value result = whileOp.getResult(idx);
+      return isFlexible(result) ? result : Value();
+    }
+    if (layoutOps.contains(owner) || owner->getNumResults() != 1 ||
+        !isFlexible(owner->getResult(0)) ||
+        cast<ShapedType>(use.get().getType()).getRank() == 0)
+      return Value();
+    return owner->getResult(0);
+  }
+
+  void buildGroups() {
+    func.walk([&](Operation *op) {
+      if (isLayoutOp(op)) {
+        layoutOps.insert(op);
+        if (hasFlexibleType(op->getResult(0)))
+          parent[op->getResult(0)] = op->getResult(0);
+        return;
+      }
+      if (isElementwiseCandidate(op)) {
+        parent[op->getResult(0)] = op->getResult(0);
+        return;
+      }
+      auto whileOp = dyn_cast<stablehlo::WhileOp>(op);
+      if (!whileOp)
+        return;
+      for (auto [idx, result] : llvm::enumerate(whileOp.getResults())) {
+        if (!hasFlexibleType(result))
+          continue;
+        for (Value v : {result, whileOp.getBody().getArgument(idx),
+                        whileOp.getCond().getArgument(idx)})
+          parent[v] = v;
+        unite(result, whileOp.getBody().getArgument(idx));
+        unite(result, whileOp.getCond().getArgument(idx));
+      }
+    });
+
+    SmallVector<Value> values;
+    for (auto &[value, _] : parent)
+      values.push_back(value);
+    for (auto value : values)
+      for (auto &use : value.getUses())
+        if (Value target = getLayoutTarget(use))
+          unite(value, target);
+  }
+
+  uint64_t getFrequency(Block *block) {
+    uint64_t frequency = 1;
+    for (Operation *op = block->getParentOp(); op && op != func;
+         op = op->getParentOp()) {
+      auto whileOp = dyn_cast<stablehlo::WhileOp>(op);
+      if (!whileOp)
+        continue;
+      auto [it, inserted] = tripCounts.try_emplace(op, unknownTripCount);
+      if (inserted) {
+        WhileLoopInfo info(whileOp);
+        if (info.computeInfo().succeeded() && info.isConstant())
+          it->second = std::max<int64_t>(info.getConstantNumIters(), 0);
+      }
+      frequency = llvm::SaturatingMultiply(frequency, it->second);
+    }
+    return frequency;
+  }
+
+  static uint64_t getSize(Value v) {
+    return cast<RankedTensorType>(v.getType()).getNumElements();
+  }
+
+  // Operands that define `v` inside its group.
+  SmallVector<OpOperand *> getDefiningOperands(Value v) {
+    SmallVector<OpOperand *> operands;
+    if (auto whileOp = v.getDefiningOp<stablehlo::WhileOp>()) {
+      unsigned idx = cast<OpResult>(v).getResultNumber();
+      operands.push_back(&whileOp->getOpOperand(idx));
+      operands.push_back(
+          &whileOp.getBody().front().getTerminator()->getOpOperand(idx));
+      return operands;
+    }
+    if (isa<BlockArgument>(v))
+      return operands;
+    for (auto &operand : v.getDefiningOp()->getOpOperands())
+      if (getLayoutTarget(operand) == v)
+        operands.push_back(&operand);
+    return operands;
+  }
+
+  void collectBoundaries() {
+    for (auto &[value, _] : parent) {
+      auto [it, inserted] =
+          groupIndices.try_emplace(find(value), groups.size());
+      if (inserted)
+        groups.emplace_back();
+      groups[it->second].values.push_back(value);
+    }
+    for (auto &group : groups)
+      collectBoundary(group);
+  }
+
+  void collectBoundary(Group &group) {
+    Value root = find(group.values.front());
+    int64_t rank =
+        cast<RankedTensorType>(group.values.front().getType()).getRank();
+    for (auto v : group.values) {
+      for (auto *operand : getDefiningOperands(v)) {
+        Value x = operand->get();
+        if (isFlexible(x))
+          continue;
+        auto &input = group.inputs[x];
+        input.uses.push_back(operand);
+        if (input.source)
+          continue;
+
+        input.source = x;
+        input.permutation = getIdentityPermutation(rank);
+        // The transpose can only be folded if nothing else needs its result
+        // and it does not read from this group.
+        auto transpose = x.getDefiningOp<stablehlo::TransposeOp>();
+        if (transpose && !(isFlexible(transpose.getOperand()) &&
+                           find(transpose.getOperand()) == root)) {
+          bool onlyGroupUsers = llvm::all_of(x.getUses(), [&](OpOperand &use) {
+            Value target = getLayoutTarget(use);
+            return target && find(target) == root;
+          });
+          if (onlyGroupUsers) {
+            input.source = transpose.getOperand();
+            input.permutation = llvm::to_vector(transpose.getPermutation());
+            input.absorbed = transpose;
+          }
+        }
+      }
+
+      // Uses by layout ops are accounted for by the op itself.
+      for (auto &use : v.getUses()) {
+        if (getLayoutTarget(use) || layoutOps.contains(use.getOwner()))
+          continue;
+        if (auto transpose = dyn_cast<stablehlo::TransposeOp>(use.getOwner()))
+          group.transposeUsers.push_back(transpose);
+        else
+          group.escaping[v].push_back(&use);
+      }
+    }
+  }
+
+  bool addCandidate(Group &group, ArrayRef<int64_t> perm) {
+    if (group.candidates.size() >= kMaxCandidates ||
+        llvm::any_of(group.candidates, [&](ArrayRef<int64_t> candidate) {
+          return candidate == perm;
+        }))
+      return false;
+    group.candidates.push_back(llvm::to_vector(perm));
+    return true;
+  }
+
+  // An optimal ordering cancels at least one boundary transpose or matches
+  // the ordering a layout op produces, so only those orderings need to be
+  // considered.
+  void collectCandidates() {
+    for (auto &group : groups) {
+      addCandidate(group,
+                   getIdentityPermutation(
+                       cast<RankedTensorType>(group.values.front().getType())
+                           .getRank()));
+      for (auto &[x, input] : group.inputs)
+        addCandidate(group,
+                     stablehlo::getInversePermutation(input.permutation));
+      for (auto transpose : group.transposeUsers)
+        addCandidate(group, transpose.getPermutation());
+    }
+
+    bool changed = true;
+    for (unsigned sweep = 0; changed && sweep < kMaxSweeps; sweep++) {
+      changed = false;
+      for (auto *op : layoutOps) {
+        Value result = op->getResult(0);
+        if (!isFlexible(result))
+          continue;
+        SmallVector<SmallVector<SmallVector<int64_t>>> operandCandidates;
+        for (Value operand : getLayoutOperands(op)) {
+          if (isFlexible(operand)) {
+            operandCandidates.push_back(
+                groups[getGroupIndex(operand)].candidates);
+            continue;
+          }
+          operandCandidates.push_back({getIdentityPermutation(
+              cast<RankedTensorType>(operand.getType()).getRank())});
+        }
+        SmallVector<size_t> sizes;
+        for (auto &candidates : operandCandidates)
+          sizes.push_back(candidates.size());
+        Group &target = groups[getGroupIndex(result)];
+        forEachCombination(sizes, [&](ArrayRef<size_t> indices) {
+          SmallVector<SmallVector<int64_t>> operandPerms;
+          for (auto [candidates, idx] : llvm::zip(operandCandidates, indices))
+            operandPerms.push_back(candidates[idx]);
+          changed |=
+              addCandidate(target, getResultPermutation(op, operandPerms));
+        });
+      }
+    }
+
+    for (auto &group : groups)
+      for (auto &perm : group.candidates)
+        group.boundaryCosts.push_back(getBoundaryCost(group, perm));
+  }
+
+  uint64_t getBoundaryCost(Group &group, ArrayRef<int64_t> perm) {
+    SmallVector<int64_t> invPerm = stablehlo::getInversePermutation(perm);
+    uint64_t cost = 0;
+    for (auto &[x, input] : group.inputs) {
+      if (isIdentityPermutation(composePermutations(input.permutation, perm)))
+        continue;
+      cost = llvm::SaturatingAdd(
+          cost, llvm::SaturatingMultiply(
+                    getSize(x), getFrequency(input.source.getParentBlock())));
+    }
+    for (auto transpose : group.transposeUsers) {
+      if (isIdentityPermutation(
+              composePermutations(invPerm, transpose.getPermutation())))
+        continue;
+      cost = llvm::SaturatingAdd(
+          cost,
+          llvm::SaturatingMultiply(getSize(transpose.getResult()),
+                                   getFrequency(transpose->getBlock())));
+    }
+    if (!isIdentityPermutation(perm)) {
+      for (auto &[v, uses] : group.escaping)
+        cost = llvm::SaturatingAdd(
+            cost, llvm::SaturatingMultiply(getSize(v),
+                                           getFrequency(v.getParentBlock())));
+    }
+    return cost;
+  }
+
+  SmallVector<int64_t> getPermutation(Value v) {
+    if (!isFlexible(v))
+      return getIdentityPermutation(
+          cast<RankedTensorType>(v.getType()).getRank());
+    unsigned idx = getGroupIndex(v);
+    return groups[idx].candidates[choices[idx]];
+  }
+
+  SmallVector<SmallVector<int64_t>> getOperandPermutations(Operation *op) {
+    SmallVector<SmallVector<int64_t>> operandPerms;
+    for (Value operand : getLayoutOperands(op))
+      operandPerms.push_back(getPermutation(operand));
+    return operandPerms;
+  }
+
+  // A layout op needs a transpose of its result if the ordering it produces
+  // from the orderings of its operands is not the one of its result.
+  uint64_t getLayoutOpCost(Operation *op) {
+    Value result = op->getResult(0);
+    if (getResultPermutation(op, getOperandPermutations(op)) ==
+        getPermutation(result))
+      return 0;
+    return llvm::SaturatingMultiply(getSize(result),
+                                    getFrequency(op->getBlock()));
+  }
+
+  struct Component {
+    SmallVector<unsigned> groups;
+    SmallVector<Operation *> layoutOps;
+  };
+
+  // Groups related through layout ops are solved together.
+  void solve() {
+    choices.assign(groups.size(), 0);
+
+    SmallVector<unsigned> leaders =
+        llvm::to_vector(llvm::seq<unsigned>(0, groups.size()));
+    auto findLeader = [&](unsigned idx) {
+      while (leaders[idx] != idx)
+        idx = leaders[idx] = leaders[leaders[idx]];
+      return idx;
+    };
+    auto getRelatedGroups = [&](Operation *op) {
+      SmallVector<unsigned> related;
+      SmallVector<Value> values = getLayoutOperands(op);
+      values.push_back(op->getResult(0));
+      for (Value v : values)
+        if (isFlexible(v))
+          related.push_back(getGroupIndex(v));
+      return related;
+    };
+    for (auto *op : layoutOps) {
+      SmallVector<unsigned> related = getRelatedGroups(op);
+      for (auto idx : related)
+        leaders[findLeader(idx)] = findLeader(related.front());
+    }
+
+    llvm::MapVector<unsigned, Component> components;
+    for (auto idx : llvm::seq<unsigned>(0, groups.size()))
+      components[findLeader(idx)].groups.push_back(idx);
+    for (auto *op : layoutOps) {
+      SmallVector<unsigned> related = getRelatedGroups(op);
+      if (!related.empty())
+        components[findLeader(related.front())].layoutOps.push_back(op);
+    }
+    for (auto &[_, component] : components)
+      solve(component);
+  }
+
+  void solve(Component &component) {
+    auto getCost = [&]() {
+      uint64_t cost = 0;
+      for (auto idx : component.groups)
+        cost = llvm::SaturatingAdd(cost,
+                                   groups[idx].boundaryCosts[choices[idx]]);
+      for (auto *op : component.layoutOps)
+        cost = llvm::SaturatingAdd(cost, getLayoutOpCost(op));
+      return cost;
+    };
+
+    uint64_t bestCost = getCost();
+    SmallVector<size_t> sizes;
+    uint64_t numAssignments = 1;
+    for (auto idx : component.groups) {
+      sizes.push_back(groups[idx].candidates.size());
+      numAssignments = llvm::SaturatingMultiply<uint64_t>(
+          numAssignments, groups[idx].candidates.size());
+    }
+
+    if (numAssignments <= kMaxEnumeratedAssignments) {
+      SmallVector<size_t> best(sizes.size(), 0);
+      forEachCombination(sizes, [&](ArrayRef<size_t> indices) {
+        for (auto [idx, choice] : llvm::zip(component.groups, indices))
+          choices[idx] = choice;
+        uint64_t cost = getCost();
+        if (cost < bestCost) {
+          bestCost = cost;
+          best = llvm::to_vector(indices);
+        }
+      });
+      for (auto [idx, choice] : llvm::zip(component.groups, best))
+        choices[idx] = choice;
+      return;
+    }
+
+    // Change the ordering of one group at a time as long as the total cost
+    // decreases.
+    for (unsigned sweep = 0; sweep < kMaxSweeps; sweep++) {
+      bool improved = false;
+      for (auto idx : component.groups) {
+        unsigned current = choices[idx];
+        for (auto choice :
+             llvm::seq<unsigned>(0, groups[idx].candidates.size())) {
+          choices[idx] = choice;
+          uint64_t cost = getCost();
+          if (cost < bestCost) {
+            bestCost = cost;
+            current = choice;
+            improved = true;
+          }
+        }
+        choices[idx] = current;
+      }
+      if (!improved)
+        break;
+    }
+  }
+
+  void rewrite() {
+    // The orderings layout ops read and produce, computed before any type
+    // changes.
+    struct LayoutOpRewrite {
+      Operation *op;
+      SmallVector<SmallVector<int64_t>> operandPerms;
+      SmallVector<int64_t> target;
+      RankedTensorType resultType;
+    };
+    SmallVector<LayoutOpRewrite> opRewrites;
+    for (auto *op : layoutOps) {
+      LayoutOpRewrite opRewrite{op, getOperandPermutations(op),
+                                getPermutation(op->getResult(0)),
+                                cast<RankedTensorType>(
+                                    op->getResult(0).getType())};
+      if (isIdentityPermutation(opRewrite.target) &&
+          llvm::all_of(opRewrite.operandPerms, isIdentityPermutation))
+        continue;
+      opRewrites.push_back(std::move(opRewrite));
+    }
+
+    for (auto [idx, group] : llvm::enumerate(groups)) {
+      ArrayRef<int64_t> perm = group.candidates[choices[idx]];
+      if (!isIdentityPermutation(perm))
+        rewrite(group, perm);
+    }
+
+    for (auto &opRewrite : opRewrites)
+      rewrite(opRewrite.op, opRewrite.operandPerms, opRewrite.target,
+              opRewrite.resultType);
+  }
+
+  void rewrite(Group &group, ArrayRef<int64_t> perm) {
+    SmallVector<int64_t> invPerm = stablehlo::getInversePermutation(perm);
+    OpBuilder builder(func.getContext());
+
+    for (auto v : group.values)
+      v.setType(getPermutedType(cast<RankedTensorType>(v.getType()), perm));
+
+    for (auto &[x, input] : group.inputs) {
+      SmallVector<int64_t> inputPerm =
+          composePermutations(input.permutation, perm);
+      Value transposed = input.source;
+      if (!isIdentityPermutation(inputPerm)) {
+        builder.setInsertionPointAfterValue(input.source);
+        transposed = stablehlo::TransposeOp::create(builder, x.getLoc(),
+                                                    input.source, inputPerm);
+      }
+      for (auto *use : input.uses)
+        use->set(transposed);
+      if (input.absorbed && input.absorbed->use_empty())
+        input.absorbed->erase();
+    }
+
+    for (auto transpose : group.transposeUsers) {
+      SmallVector<int64_t> userPerm =
+          composePermutations(invPerm, transpose.getPermutation());
+      Value replacement = transpose.getOperand();
+      if (!isIdentityPermutation(userPerm)) {
+        builder.setInsertionPoint(transpose);
+        replacement = stablehlo::TransposeOp::create(
+            builder, transpose.getLoc(), replacement, userPerm);
+      }
+      transpose.replaceAllUsesWith(replacement);
+      transpose->erase();
+    }
+
+    for (auto &[v, uses] : group.escaping) {
+      builder.setInsertionPointAfterValue(v);
+      auto back = stablehlo::TransposeOp::create(builder, v.getLoc(), v,
+                                                 invPerm);
+      for (auto *use : uses)
+        use->set(back);
+    }
+  }
+
+  // Remaps the dimension attributes of `op` to its transposed operands and
+  // transposes its result into the ordering of its group, if needed.
+  void rewrite(Operation *op, ArrayRef<SmallVector<int64_t>> operandPerms,
+               ArrayRef<int64_t> target, RankedTensorType resultType) {
+    if (auto dot = dyn_cast<stablehlo::DotGeneralOp>(op)) {
+      auto dims = dot.getDotDimensionNumbers();
+      dot.setDotDimensionNumbersAttr(stablehlo::DotDimensionNumbersAttr::get(
+          dims.getContext(),
+          remapDimensions(dims.getLhsBatchingDimensions(), operandPerms[0]),
+          remapDimensions(dims.getRhsBatchingDimensions(), operandPerms[1]),
+          remapDimensions(dims.getLhsContractingDimensions(), operandPerms[0]),
+          remapDimensions(dims.getRhsContractingDimensions(),
+                          operandPerms[1])));
+    } else {
+      auto reduce = cast<stablehlo::ReduceOp>(op);
+      SmallVector<int64_t> dims =
+          remapDimensions(reduce.getDimensions(), operandPerms[0]);
+      llvm::sort(dims);
+      reduce.setDimensionsAttr(DenseI64ArrayAttr::get(op->getContext(), dims));
+    }
+
+    SmallVector<int64_t> perm = getResultPermutation(op, operandPerms);
+    Value result = op->getResult(0);
+    result.setType(getPermutedType(resultType, perm));
+
+    SmallVector<int64_t> resultPerm =
+        composePermutations(stablehlo::getInversePermutation(perm), target);
+    if (isIdentityPermutation(resultPerm))
+      return;
+    OpBuilder builder(op);
+    builder.setInsertionPointAfter(op);
+    auto transpose = stablehlo::TransposeOp::create(builder, op->getLoc(),
+                                                    result, resultPerm);
+    result.replaceAllUsesExcept(transpose, transpose);
+  }
+};
+
+struct EnzymeHLOLayoutAssignmentPass
+    : public enzyme::impl::EnzymeHLOLayoutAssignmentPassBase<
+          EnzymeHLOLayoutAssignmentPass> {
+  using EnzymeHLOLayoutAssignmentPassBase::EnzymeHLOLayoutAssignmentPassBase;
+
+  void runOnOperation() override {
+    for (auto func : getOperation().getOps<func::FuncOp>()) {
+      if (func.isExternal())
+        continue;
+      LayoutAssignment(func, unknown_trip_count).run();
+    }
+  }
+};
+
+} // namespace
@@ -19,7 +19,9 @@
 #include "mlir/Dialect/CommonFolders.h"
 #include "mlir/Dialect/Func/IR/FuncOps.h"
 #include "mlir/Dialect/Tensor/IR/Tensor.h"
+#include "mlir/IR/AsmState.h"
 #include "mlir/IR/Builders.h"
+#include "mlir/IR/DialectResourceBlobManager.h"
 #include "mlir/IR/Dominance.h"
 #include "mlir/IR/IRMapping.h"
 #include "mlir/IR/Matchers.h"
@@ -4944,6 +4946,165 @@ DenseElementsAttr fromTensor(stablehlo::Tensor tensor) {
   return stablehlo::makeDenseElementsAttr(tensor);
 }
 
+// Host storage size of one element of `elemTy` inside a resource blob, or
+// std::nullopt if the type is not stored out of line. The layout matches the
+// one used by the reference interpreter's tensors, so blobs can be handed to
+// it without conversion.
+static std::optional<size_t> blobElementBytes(Type elemTy) {
+  if (auto intTy = dyn_cast<IntegerType>(elemTy)) {
+    auto width = intTy.getWidth();
+    if (width == 1)
+      return 1;
+    if (width == 8 || width == 16 || width == 32 || width == 64)
+      return width / 8;
+    return std::nullopt;
+  }
+  if (isa<Float16Type, BFloat16Type, Float32Type, Float64Type>(elemTy))
+    return elemTy.getIntOrFloatBitWidth() / 8;
+  if (auto complexTy = dyn_cast<ComplexType>(elemTy)) {
+    if (isa<Float32Type, Float64Type>(complexTy.getElementType()))
+      return 2 * complexTy.getElementType().getIntOrFloatBitWidth() / 8;
+  }
+  return std::nullopt;
+}
+
+// Owner of the large constants produced by constant folding. Results above
+// `threshold` bytes are emitted as DenseResourceElementsAttr blobs instead of
+// uniqued DenseElementsAttrs, which live in the context until it is
+// destroyed. Every blob handed out is recorded, so that the intermediates of
+// a folding chain can be released while rewriting and once it has finished.
+struct FoldedConstantArena {
+  // Amount of data held by erased constants after which the blobs are swept
+  // during rewriting.
+  static constexpr size_t kSweepBytes = 64 << 20;
+
+  size_t threshold;
+  SmallVector<DenseResourceElementsHandle> handles;
+  llvm::SmallPtrSet<void *, 8> owned;
+  size_t erasedBytes = 0;
+
+  FoldedConstantArena(size_t threshold) : threshold(threshold) {}
+
+  ElementsAttr get(stablehlo::Tensor tensor) {
+    auto type = tensor.getType();
+    auto elemBytes = blobElementBytes(type.getElementType());
+    if (!threshold || !elemBytes)
+      return fromTensor(tensor);
+    size_t elemSize = *elemBytes;
+    size_t numBytes = type.getNumElements() * elemSize;
+    if (numBytes <= threshold)
+      return fromTensor(tensor);
+
+    auto blob = HeapAsmResourceBlob::allocate(
+        numBytes, alignof(std::max_align_t), /*dataIsMutable*/ true);
+    char *data = blob.getMutableData().data();
+    auto store = [&](const APInt &bits, char *dst) {
+      llvm::StoreIntToMemory(bits, reinterpret_cast<uint8_t *>(dst),
+                       bits.getBitWidth() / 8);
+    };
+    for (auto it = tensor.index_begin(); it != tensor.index_end();
+         ++it, data += elemSize) {
+      auto element = tensor.get(*it);
+      auto elemTy = type.getElementType();
+      if (elemTy.isInteger(1))
+        *data = element.getBooleanValue();
+      else if (isa<IntegerType>(elemTy))
+        store(element.getIntegerValue(), data);
+      else if (isa<FloatType>(elemTy))
+        store(element.getFloatValue().bitcastToAPInt(), data);
+      else {
+        auto value = element.getComplexValue();
+        store(value.real().bitcastToAPInt(), data);
+        store(value.imag().bitcastToAPInt(), data + elemSize / 2);
+      }
+    }
+
+    auto attr = DenseResourceElementsAttr::get(type, "enzyme_hlo_folded",
+                                               std::move(blob));
+    handles.push_back(attr.getRawHandle());
+    owned.insert(attr.getRawHandle().getResource());
+    return attr;
+  }
+
+  // Drops the payload of every blob created by this arena that is no longer
+  // referenced from `root`, and stops tracking it. The blob manager has no
+  // way to remove an entry, so only its name is left behind.
+  void releaseUnused(Operation *root) {
+    erasedBytes = 0;
+    if (handles.empty())
+      return;
+    llvm::SmallPtrSet<void *, 8> live;
+    root->walk([&](Operation *op) {
+      op->getAttrDictionary().walk([&](DenseResourceElementsAttr attr) {
+        live.insert(attr.getRawHandle().getResource());
+      });
+    });
+    llvm::erase_if(handles, [&](DenseResourceElementsHandle &handle) {
+      if (live.contains(handle.getResource()))
+        return false;
+      handle.getResource()->setBlob(AsmResourceBlob());
+      owned.erase(handle.getResource());
+      return true;
+    });
+  }
+
+  // Called before `op` is erased from `root`. Sweeps the blobs once the
+  // constants erased since the last sweep held kSweepBytes. `op` itself is
+  // still referenced, so its blob is only released by a later sweep.
+  void notifyErased(Operation *op, Operation *root) {
+    auto constant = dyn_cast<stablehlo::ConstantOp>(op);
+    if (!constant)
+      return;
+    auto resource = dyn_cast<DenseResourceElementsAttr>(constant.getValue());
+    if (!resource || !owned.contains(resource.getRawHandle().getResource()))
+      return;
+    if (auto *blob = resource.getRawHandle().getBlob())
+      erasedBytes += blob->getData().size();
+    if (erasedBytes >= kSweepBytes)
+      releaseUnused(root);
+  }
+};
+
+// Lets a FoldedConstantArena release intermediates while patterns are applied.
+struct FoldedConstantArenaListener : public RewriterBase::Listener {
+  FoldedConstantArena &arena;
+  Operation *root;
+
+  FoldedConstantArenaListener(FoldedConstantArena &arena, Operation *root)
+      : arena(arena), root(root) {}
+
+  void notifyOperationErased(Operation *op) override {
+    arena.notifyErased(op, root);
+  }
+};
+
+ElementsAttr fromTensor(stablehlo::Tensor tensor, FoldedConstantArena *arena) {
+  if (arena)
+    return arena->get(tensor);
+  return fromTensor(tensor);
+}
+
+// Matches a constant operand that is either a DenseElementsAttr, returned in
+// `attr`, or a blob emitted by a FoldedConstantArena, returned directly as an
+// interpreter tensor in `tensor` with `attr` left null.
+static bool matchConstantOrBlob(Value value, DenseElementsAttr &attr,
+                                stablehlo::Tensor &tensor) {
+  if (matchPattern(value, m_Constant(&attr)))
+    return true;
+  DenseResourceElementsAttr resource;
+  if (!matchPattern(value, m_Constant(&resource)))
+    return false;
+  auto *blob = resource.getRawHandle().getBlob();
+  if (!blob || blob->getData().empty() ||
+      !blobElementBytes(resource.getType().getElementType()))
+    return false;
+  tensor = stablehlo::Tensor(
+      resource.getType(),
+      UnmanagedAsmResourceBlob::allocateWithAlign(blob->getData(),
+                                                  blob->getDataAlignment()));
+  return true;
+}
+
 /*
 %22 = stablehlo.dot_general %21, %16, contracting_dims = [1] x [0], precision
 = [DEFAULT, DEFAULT] : (tensor<288x288xf32>, tensor<288xf32>) ->
@@ -5036,6 +5197,23 @@ struct PadSimplify final
       }
     }
 
+    // Padding a padded splat with the same value is a single larger pad,
+    // which needs no materialization. Smaller results are left to be folded.
+    if (op.getType().getNumElements() >= max_constant_expansion) {
+      SplatElementsAttr pv;
+      auto structured = detectStructuredConstant(op.getOperand());
+      if (structured && structured->kind == StructuredConstant::Kind::Padded &&
+          matchPattern(op.getPaddingValue(), m_Constant(&pv))) {
+        auto result = structured->pad(
+            pv.getSplatValue<TypedAttr>(), op.getEdgePaddingLow(),
+            op.getEdgePaddingHigh(), op.getInteriorPadding(), op.getType());
+        if (result) {
+          rewriter.replaceOp(op, result->materialize(rewriter, op.getLoc()));
+          return success();
+        }
+      }
+    }
+
     for (auto &&[low, high, inner] :
          llvm::zip(op.getEdgePaddingLow(), op.getEdgePaddingHigh(),
                    op.getInteriorPadding())) {
@@ -6283,25 +6461,26 @@ struct DynamicUpdateSliceConstProp final
 };
 
 template <auto f>
-LogicalResult binaryConstProp(Operation *op, PatternRewriter &rewriter) {
+LogicalResult binaryConstProp(Operation *op, PatternRewriter &rewriter,
+                              FoldedConstantArena *arena = nullptr) {
   // return if not constant
   DenseElementsAttr lhsAttr;
   DenseElementsAttr rhsAttr;
-  if (!matchPattern(op->getOperand(0), m_Constant(&lhsAttr)) ||
-      !matchPattern(op->getOperand(1), m_Constant(&rhsAttr)))
-    return failure();
-
   stablehlo::Tensor lhsTen;
   stablehlo::Tensor rhsTen;
+  if (!matchConstantOrBlob(op->getOperand(0), lhsAttr, lhsTen) ||
+      !matchConstantOrBlob(op->getOperand(1), rhsAttr, rhsTen))
+    return failure();
+
   RankedTensorType ty = cast<RankedTensorType>(op->getResultTypes()[0]);
+  bool allSplat = lhsAttr && lhsAttr.isSplat() && rhsAttr && rhsAttr.isSplat();
 
   // only const prop if the constant has a single user to prevent create many
   // constants
-  if ((!lhsAttr.isSplat() || !rhsAttr.isSplat()) &&
-      !llvm::hasSingleElement(op->getResult(0).getUsers()))
+  if (!allSplat && !llvm::hasSingleElement(op->getResult(0).getUsers()))
     return failure();
 
-  if (lhsAttr.isSplat() && rhsAttr.isSplat()) {
+  if (allSplat) {
     ty = RankedTensorType::get(
         {}, cast<ShapedType>(op->getResultTypes()[0]).getElementType());
 
@@ -6310,19 +6489,23 @@ LogicalResult binaryConstProp(Operation *op, PatternRewriter &rewriter) {
 
     rhsTen = stablehlo::makeTensor(rhsAttr.resizeSplat(RankedTensorType::get(
         {}, cast<ShapedType>(op->getOperand(1).getType()).getElementType())));
-  } else {
+
+    auto out = fromTensor(f(lhsTen, rhsTen, cast<ShapedType>(ty)));
+    rewriter.replaceOpWithNewOp<stablehlo::ConstantOp>(
+        op, op->getResultTypes()[0],
+        out.resizeSplat(cast<ShapedType>(op->getResultTypes()[0])));
+    return success();
+  }
+
+  if (lhsAttr)
     lhsTen = stablehlo::constantOp(lhsAttr);
+  if (rhsAttr)
     rhsTen = stablehlo::constantOp(rhsAttr);
-  }
 
   // get the resultType
   auto resultType = cast<ShapedType>(ty);
 
-  auto out = fromTensor(f(lhsTen, rhsTen, resultType));
-
-  if (lhsAttr.isSplat() && rhsAttr.isSplat()) {
-    out = out.resizeSplat(cast<ShapedType>(op->getResultTypes()[0]));
-  }
+  auto out = fromTensor(f(lhsTen, rhsTen, resultType), arena);
 
   // Replace with new constant op containing the computed result
   rewriter.replaceOpWithNewOp<stablehlo::ConstantOp>(
@@ -6336,45 +6519,58 @@ struct BinaryConstProp final
   using CheckedOpRewritePattern<
       OpTy, BinaryConstProp<OpTy, constPropFn>>::CheckedOpRewritePattern;
 
+  FoldedConstantArena *arena = nullptr;
+  BinaryConstProp(FoldedConstantArena *arena, MLIRContext *context,
+                  PatternBenefit benefit = 1,
+                  ArrayRef<StringRef> generatedNames = {})
+      : CheckedOpRewritePattern<OpTy, BinaryConstProp<OpTy, constPropFn>>(
+            context, benefit, generatedNames),
+        arena(arena) {}
+
   LogicalResult matchAndRewriteImpl(OpTy op, PatternRewriter &rewriter) const {
-    return binaryConstProp<constPropFn>(op, rewriter);
+    return binaryConstProp<constPropFn>(op, rewriter, arena);
   }
 };
 
 template <auto f>
-LogicalResult unaryConstProp(Operation *op, PatternRewriter &rewriter) {
+LogicalResult unaryConstProp(Operation *op, PatternRewriter &rewriter,
+                             FoldedConstantArena *arena = nullptr) {
   // return if not constant
   DenseElementsAttr inputAttr;
-  if (!matchPattern(op->getOperand(0), m_Constant(&inputAttr)))
+  stablehlo::Tensor inputTen;
+  if (!matchConstantOrBlob(op->getOperand(0), inputAttr, inputTen))
     return failure();
 
-  stablehlo::Tensor inputTen;
   RankedTensorType ty = cast<RankedTensorType>(op->getResultTypes()[0]);
+  bool isSplat = inputAttr && inputAttr.isSplat();
 
   // only const prop if the constant has a single user to prevent create many
   // constants
-  if (!inputAttr.isSplat() &&
-      !llvm::hasSingleElement(op->getResult(0).getUsers()))
+  if (!isSplat && !llvm::hasSingleElement(op->getResult(0).getUsers()))
     return failure();
 
-  if (inputAttr.isSplat()) {
+  if (isSplat) {
     ty = RankedTensorType::get(
         {}, cast<ShapedType>(op->getResultTypes()[0]).getElementType());
     auto inputTy = RankedTensorType::get(
         {}, cast<ShapedType>(op->getOperand(0).getType()).getElementType());
     inputTen = stablehlo::makeTensor(inputAttr.resizeSplat(inputTy));
-  } else {
-    inputTen = stablehlo::constantOp(inputAttr);
+
+    auto out = fromTensor(f(inputTen, cast<ShapedType>(ty)));
+    rewriter.replaceOpWithNewOp<stablehlo::ConstantOp>(
+        op, op->getResultTypes()[0],
+        out.resizeSplat(cast<ShapedType>(op->getResultTypes()[0])));
+    return success();
   }
+
+  if (inputAttr)
+    inputTen = stablehlo::constantOp(inputAttr);
   // get the resultType
   auto resultType = cast<ShapedType>(ty);
 
   // Convert constant to tensor, compute log, then convert back to attribute
-  auto out = fromTensor(f(inputTen, resultType));
+  auto out = fromTensor(f(inputTen, resultType), arena);
 
-  if (inputAttr.isSplat()) {
-    out = out.resizeSplat(cast<ShapedType>(op->getResultTypes()[0]));
-  }
   // Replace with new constant op containing the computed result
   rewriter.replaceOpWithNewOp<stablehlo::ConstantOp>(
       op, op->getResultTypes()[0], out);
@@ -6388,8 +6584,16 @@ struct UnaryConstProp final
   using CheckedOpRewritePattern<
       OpTy, UnaryConstProp<OpTy, constPropFn>>::CheckedOpRewritePattern;
 
+  FoldedConstantArena *arena = nullptr;
+  UnaryConstProp(FoldedConstantArena *arena, MLIRContext *context,
+                 PatternBenefit benefit = 1,
+                 ArrayRef<StringRef> generatedNames = {})
+      : CheckedOpRewritePattern<OpTy, UnaryConstProp<OpTy, constPropFn>>(
+            context, benefit, generatedNames),
+        arena(arena) {}
+
   LogicalResult matchAndRewriteImpl(OpTy op, PatternRewriter &rewriter) const {
-    return unaryConstProp<constPropFn>(op, rewriter);
+    return unaryConstProp<constPropFn>(op, rewriter, arena);
   }
 };
 
@@ -6491,11 +6695,17 @@ struct ConcatConstProp final
     : CheckedOpRewritePattern<stablehlo::ConcatenateOp, ConcatConstProp> {
   using CheckedOpRewritePattern::CheckedOpRewritePattern;
   size_t max_constant_expansion;
+  FoldedConstantArena *arena;
   ConcatConstProp(size_t max_constant_expansion, MLIRContext *context,
                   PatternBenefit benefit = 1,
                   ArrayRef<StringRef> generatedNames = {})
+      : ConcatConstProp(max_constant_expansion, nullptr, context, benefit,
+                        generatedNames) {}
+  ConcatConstProp(size_t max_constant_expansion, FoldedConstantArena *arena,
+                  MLIRContext *context, PatternBenefit benefit = 1,
+                  ArrayRef<StringRef> generatedNames = {})
       : CheckedOpRewritePattern(context, benefit, generatedNames),
-        max_constant_expansion(max_constant_expansion) {}
+        max_constant_expansion(max_constant_expansion), arena(arena) {}
 
   LogicalResult matchAndRewriteImpl(stablehlo::ConcatenateOp op,
                                     PatternRewriter &rewriter) const {
@@ -6530,19 +6740,19 @@ struct ConcatConstProp final
 
     SmallVector<DenseElementsAttr> constants;
     constants.assign(op->getNumOperands(), DenseElementsAttr());
+    SmallVector<stablehlo::Tensor> blobs(op->getNumOperands());
     bool legal = true;
     for (unsigned i = 0, e = op->getNumOperands(); i != e; ++i) {
-      matchPattern(op->getOperand(i), m_Constant(&constants[i]));
-      if (!constants[i])
+      if (!matchConstantOrBlob(op->getOperand(i), constants[i], blobs[i]))
         legal = false;
     }
 
     if (legal) {
 
-      if (constants[0].isSplat()) {
+      if (constants[0] && constants[0].isSplat()) {
         bool allSplat = true;
         for (int i = 1; i < op->getNumOperands(); i++) {
-          if (!constants[i].isSplat()) {
+          if (!constants[i] || !constants[i].isSplat()) {
             allSplat = false;
             break;
           }
@@ -6565,12 +6775,12 @@ struct ConcatConstProp final
         return failure();
 
       SmallVector<stablehlo::Tensor> inps;
-      for (auto &c : constants)
-        inps.push_back(stablehlo::constantOp(c));
+      for (auto [c, blob] : llvm::zip(constants, blobs))
+        inps.push_back(c ? stablehlo::constantOp(c) : blob);
       auto out =
           stablehlo::concatenateOp(inps, op.getDimension(), op.getType());
-      rewriter.replaceOpWithNewOp<stablehlo::ConstantOp>(op, op.getType(),
-                                                         fromTensor(out));
+      rewriter.replaceOpWithNewOp<stablehlo::ConstantOp>(
+          op, op.getType(), fromTensor(out, arena));
       return success();
     }
     return failure();
@@ -6581,34 +6791,38 @@ struct ScatterConstFold final
     : CheckedOpRewritePattern<stablehlo::ScatterOp, ScatterConstFold> {
   using CheckedOpRewritePattern::CheckedOpRewritePattern;
   size_t max_constant_expansion;
+  FoldedConstantArena *arena;
 
   ScatterConstFold(size_t max_constant_expansion, MLIRContext *context,
                    PatternBenefit benefit = 1,
                    ArrayRef<StringRef> generatedNames = {})
+      : ScatterConstFold(max_constant_expansion, nullptr, context, benefit,
+                         generatedNames) {}
+  ScatterConstFold(size_t max_constant_expansion, FoldedConstantArena *arena,
+                   MLIRContext *context, PatternBenefit benefit = 1,
+                   ArrayRef<StringRef> generatedNames = {})
       : CheckedOpRewritePattern(context, benefit, generatedNames),
-        max_constant_expansion(max_constant_expansion) {}
+        max_constant_expansion(max_constant_expansion), arena(arena) {}
 
   LogicalResult matchAndRewriteImpl(stablehlo::ScatterOp op,
                                     PatternRewriter &rewriter) const {
     // First we check that all inputs/updates are constants and then we
     // materialize them using constantOp
-    SmallVector<DenseElementsAttr> inputConstants, updateConstants;
+    SmallVector<stablehlo::Tensor> inputs, updates;
     DenseElementsAttr scatterIndicesConstant;
     for (auto input : op.getInputs()) {
       DenseElementsAttr attr;
-      if (matchPattern(input, m_Constant(&attr))) {
-        inputConstants.push_back(attr);
-      } else {
+      stablehlo::Tensor tensor;
+      if (!matchConstantOrBlob(input, attr, tensor))
         return failure();
-      }
+      inputs.push_back(attr ? stablehlo::constantOp(attr) : tensor);
     }
     for (auto update : op.getUpdates()) {
       DenseElementsAttr attr;
-      if (matchPattern(update, m_Constant(&attr))) {
-        updateConstants.push_back(attr);
-      } else {
+      stablehlo::Tensor tensor;
+      if (!matchConstantOrBlob(update, attr, tensor))
         return failure();
-      }
+      updates.push_back(attr ? stablehlo::constantOp(attr) : tensor);
     }
     if (!matchPattern(op.getScatterIndices(),
                       m_Constant(&scatterIndicesConstant)))
@@ -6626,11 +6840,6 @@ struct ScatterConstFold final
     if (totalResultSize > max_constant_expansion)
       return rewriter.notifyMatchFailure(op, "result size too large");
 
-    SmallVector<stablehlo::Tensor> inputs, updates;
-    for (auto input : inputConstants)
-      inputs.push_back(stablehlo::constantOp(input));
-    for (auto update : updateConstants)
-      updates.push_back(stablehlo::constantOp(update));
     stablehlo::Tensor scatterIndices =
         stablehlo::constantOp(scatterIndicesConstant);
 
@@ -6686,7 +6895,7 @@ struct ScatterConstFold final
 
     for (auto [i, result] : llvm::enumerate(results)) {
       auto constOp = stablehlo::ConstantOp::create(rewriter, op.getLoc(),
-                                                   fromTensor(result));
+                                                   fromTensor(result, arena));
       rewriter.replaceAllUsesWith(op->getResult(0), constOp.getResult());
     }
 
@@ -7822,7 +8031,12 @@ struct IotaSimplify
   LogicalResult matchAndRewriteImpl(stablehlo::IotaOp op,
                                     PatternRewriter &rewriter) const {
     if (op.getType().getNumElements() >= max_constant_expansion) {
-      return failure();
+      // A large iota stays lazy unless it runs along a unit dimension.
+      auto structured = detectStructuredConstant(op.getResult());
+      if (!structured || structured->kind != StructuredConstant::Kind::Splat)
+        return failure();
+      rewriter.replaceOp(op, structured->materialize(rewriter, op.getLoc()));
+      return success();
     }
 
     auto out = stablehlo::iotaOp(op.getIotaDimension(), op.getType());
@@ -8194,7 +8408,25 @@ struct BroadcastInDimSimplify
       return success();
     }
 
-    return failure();
+    return broadcastStructured(op, rewriter);
+  }
+
+  // Broadcasts an iota chain or a pad of splats too large to expand without
+  // materializing it. Large dense operands are first turned into such
+  // structure by RecognizeFromConstant.
+  LogicalResult broadcastStructured(stablehlo::BroadcastInDimOp op,
+                                    PatternRewriter &rewriter) const {
+    if (op.getType().getNumElements() < max_constant_expansion)
+      return failure();
+    auto structured = detectStructuredConstant(op.getOperand());
+    if (!structured || structured->kind == StructuredConstant::Kind::Splat)
+      return failure();
+    auto result = structured->broadcastInDim(op.getBroadcastDimensions(),
+                                             op.getType());
+    if (!result)
+      return failure();
+    rewriter.replaceOp(op, result->materialize(rewriter, op.getLoc()));
+    return success();
   }
 };
 
@@ -14945,6 +15177,180 @@ bool verifyInversePermutations(stablehlo::TransposeOp innerTrans,
   return true;
 }
 
+// Rewrites the condition of counted loops into the `iv < limit` form that
+// WhileLoopInfo recognizes. Increasing loops compared with `limit > iv`,
+// `iv <= limit` or `iv != limit` get an equivalent `iv < limit'`. Decreasing
+// loops compared with `iv > limit`, `iv >= limit` or `iv != limit` get a new
+// counter compared against the trip count, and the original induction
+// variable is recomputed from the counter in the body so that it stays affine
+// in the analyzed induction variable.
+struct WhileConditionCanonicalize
+    : public CheckedOpRewritePattern<stablehlo::WhileOp,
+                                     WhileConditionCanonicalize> {
+  using CheckedOpRewritePattern::CheckedOpRewritePattern;
+
+  static Value createConstant(PatternRewriter &rewriter, Location loc,
+                              RankedTensorType ty, int64_t value) {
+    return stablehlo::ConstantOp::create(
+        rewriter, loc, ty, cast<ElementsAttr>(makeAttr(ty, value)));
+  }
+
+  LogicalResult matchAndRewriteImpl(stablehlo::WhileOp op,
+                                    PatternRewriter &rewriter) const {
+    Block &condBlock = op.getCond().front();
+    if (condBlock.getOperations().size() != 2)
+      return failure();
+    auto condTerm = cast<stablehlo::ReturnOp>(condBlock.getTerminator());
+    auto cmp = condTerm->getOperand(0).getDefiningOp<stablehlo::CompareOp>();
+    if (!cmp)
+      return failure();
+
+    auto ivTy = cast<RankedTensorType>(cmp.getLhs().getType());
+    auto intTy = dyn_cast<IntegerType>(ivTy.getElementType());
+    if (ivTy.getRank() != 0 || !intTy || intTy.isUnsigned())
+      return failure();
+    // The bounds are rewritten with signed arithmetic.
+    if (cmp.getCompareType() &&
+        *cmp.getCompareType() != stablehlo::ComparisonType::SIGNED)
+      return failure();
+
+    auto direction = cmp.getComparisonDirection();
+    auto iv = dyn_cast<BlockArgument>(cmp.getLhs());
+    Value limit = cmp.getRhs();
+    bool swapped = false;
+    if (!iv || iv.getOwner() != &condBlock) {
+      iv = dyn_cast<BlockArgument>(cmp.getRhs());
+      limit = cmp.getLhs();
+      direction = reversedComparisonDirection(direction);
+      swapped = true;
+    }
+    if (!iv || iv.getOwner() != &condBlock || !definedOutside(limit, op))
+      return failure();
+
+    if (!swapped && direction == stablehlo::ComparisonDirection::LT)
+      return failure(); // already canonical
+
+    // The induction variable is incremented by a constant step.
+    Block &body = op.getBody().front();
+    unsigned ivNum = iv.getArgNumber();
+    Value bodyIV = body.getArgument(ivNum);
+    Value next = body.getTerminator()->getOperand(ivNum);
+    Operation *inc = next.getDefiningOp();
+    APInt stepAP;
+    int64_t step;
+    if (isa_and_nonnull<stablehlo::AddOp>(inc) &&
+        ((inc->getOperand(0) == bodyIV &&
+          matchPattern(inc->getOperand(1), m_ConstantInt(&stepAP))) ||
+         (inc->getOperand(1) == bodyIV &&
+          matchPattern(inc->getOperand(0), m_ConstantInt(&stepAP))))) {
+      step = stepAP.getSExtValue();
+    } else if (isa_and_nonnull<stablehlo::SubtractOp>(inc) &&
+               inc->getOperand(0) == bodyIV &&
+               matchPattern(inc->getOperand(1), m_ConstantInt(&stepAP))) {
+      step = -stepAP.getSExtValue();
+    } else {
+      return failure();
+    }
+    if (step == 0)
+      return failure();
+
+    Value start = op->getOperand(ivNum);
+    APInt startAP, limitAP;
+    bool constantBounds = matchPattern(start, m_ConstantInt(&startAP)) &&
+                          matchPattern(limit, m_ConstantInt(&limitAP));
+
+    // `iv != limit` behaves like a strict inequality if the limit is reached
+    // exactly.
+    if (direction == stablehlo::ComparisonDirection::NE) {
+      if (!constantBounds)
+        return failure();
+      int64_t distance = limitAP.getSExtValue() - startAP.getSExtValue();
+      if (distance % step != 0 || distance / step < 0)
+        return failure();
+      direction = step > 0 ? stablehlo::ComparisonDirection::LT
+                           : stablehlo::ComparisonDirection::GT;
+    }
+
+    Location loc = cmp.getLoc();
+
+    if (step > 0) {
+      Value newLimit = limit;
+      if (direction == stablehlo::ComparisonDirection::LE) {
+        // iv <= limit  <=>  iv < limit + 1, unless limit + 1 overflows.
+        APInt limitVal;
+        if (!matchPattern(limit, m_ConstantInt(&limitVal)) ||
+            limitVal.isMaxSignedValue())
+          return failure();
+        rewriter.setInsertionPoint(op);
+        newLimit = createConstant(rewriter, loc, ivTy,
+                                  limitVal.getSExtValue() + 1);
+      } else if (direction != stablehlo::ComparisonDirection::LT) {
+        return failure();
+      }
+
+      rewriter.setInsertionPoint(cmp);
+      rewriter.replaceOpWithNewOp<stablehlo::CompareOp>(
+          cmp, iv, newLimit, stablehlo::ComparisonDirection::LT,
+          cmp.getCompareTypeAttr());
+      return success();
+    }
+
+    if (direction != stablehlo::ComparisonDirection::GT &&
+        direction != stablehlo::ComparisonDirection::GE)
+      return failure();
+
+    // Decreasing loop: iterate a new counter over the trip count
+    //   max((start - limit + k - 1) / k, 0)   for iv > limit
+    //   max((start - limit + k) / k, 0)       for iv >= limit
+    // with k = -step.
+    int64_t k = -step;
+    int64_t bias = direction == stablehlo::ComparisonDirection::GT ? k - 1 : k;
+    rewriter.setInsertionPoint(op);
+    Value numIters = stablehlo::SubtractOp::create(rewriter, loc, start, limit);
+    numIters = stablehlo::AddOp::create(
+        rewriter, loc, numIters, createConstant(rewriter, loc, ivTy, bias));
+    numIters = stablehlo::DivOp::create(rewriter, loc, numIters,
+                                        createConstant(rewriter, loc, ivTy, k));
+    Value zero = createConstant(rewriter, loc, ivTy, 0);
+    numIters = stablehlo::MaxOp::create(rewriter, loc, numIters, zero);
+
+    SmallVector<Value> operands(op.getOperands());
+    operands.push_back(zero);
+    auto newWhile = stablehlo::WhileOp::create(
+        rewriter, op.getLoc(), ValueRange(operands).getTypes(), operands);
+    rewriter.inlineRegionBefore(op.getCond(), newWhile.getCond(),
+                                newWhile.getCond().end());
+    rewriter.inlineRegionBefore(op.getBody(), newWhile.getBody(),
+                                newWhile.getBody().end());
+
+    Value condCounter = condBlock.addArgument(ivTy, loc);
+    rewriter.setInsertionPoint(cmp);
+    rewriter.replaceOpWithNewOp<stablehlo::CompareOp>(
+        cmp, condCounter, numIters, stablehlo::ComparisonDirection::LT,
+        cmp.getCompareTypeAttr());
+
+    Value counter = body.addArgument(ivTy, loc);
+    rewriter.setInsertionPointToStart(&body);
+    // iv = start - k * counter
+    Value scaled = stablehlo::MulOp::create(
+        rewriter, loc, counter, createConstant(rewriter, loc, ivTy, -k));
+    Value newIV = stablehlo::AddOp::create(rewriter, loc, scaled, start);
+    rewriter.replaceAllUsesWith(bodyIV, newIV);
+
+    Operation *terminator = body.getTerminator();
+    rewriter.setInsertionPoint(terminator);
+    Value nextCounter = stablehlo::AddOp::create(
+        rewriter, loc, counter, createConstant(rewriter, loc, ivTy, 1));
+    rewriter.modifyOpInPlace(terminator, [&] {
+      terminator->insertOperands(terminator->getNumOperands(), nextCounter);
+    });
+
+    rewriter.replaceOp(op,
+                       newWhile.getResults().take_front(op.getNumResults()));
+    return success();
+  }
+};
+
 // Currently supports:
 // 1. Identifies induction variable
 // 2. Addition of constant step value
@@ -15828,6 +16234,692 @@ struct WhileDUS : public CheckedOpRewritePattern<stablehlo::WhileOp, WhileDUS> {
   }
 };
 
+// Fuses a while loop with the preceding while loop in the same block when
+// both iterate over the same induction range. Results of the first loop may
+// be consumed by the second loop only through dynamic slices that read back
+// exactly the element written by a dynamic update slice in the same
+// iteration of the first loop; such slices are forwarded the update value.
+struct WhileFusion
+    : public CheckedOpRewritePattern<stablehlo::WhileOp, WhileFusion> {
+  using CheckedOpRewritePattern::CheckedOpRewritePattern;
+
+  using IndexInfoMap = llvm::MapVector<Value, WhileLoopInfo::AffineIndexInfo>;
+
+  static bool sameBounds(WhileLoopInfo &first, WhileLoopInfo &second) {
+    if (!first.isConstantStep() || !second.isConstantStep() ||
+        *first.getConstantStep() != *second.getConstantStep() ||
+        *first.getConstantStep() <= 0)
+      return false;
+
+    if (first.isConstant() && second.isConstant())
+      return *first.getConstantStart() == *second.getConstantStart() &&
+             *first.getConstantLimit() == *second.getConstantLimit();
+
+    return first.getStart() == second.getStart() &&
+           first.getLimit() == second.getLimit();
+  }
+
+  // Checks that `ds` in the body of `second` reads the element that the
+  // first loop writes in the same iteration through `dus`, and that no other
+  // iteration of the first loop writes to it.
+  static bool canForward(stablehlo::DynamicUpdateSliceOp dus,
+                         stablehlo::DynamicSliceOp ds,
+                         WhileLoopInfo &firstInfo, IndexInfoMap &firstMap,
+                         IndexInfoMap &secondMap) {
+    if (!firstInfo.isConstant())
+      return false;
+
+    auto updateTy = cast<RankedTensorType>(dus.getUpdate().getType());
+    auto operandTy = cast<RankedTensorType>(dus.getOperand().getType());
+    if (!updateTy.hasStaticShape() || !operandTy.hasStaticShape() ||
+        ds.getType() != updateTy)
+      return false;
+
+    int64_t start = *firstInfo.getConstantStart();
+    int64_t step = *firstInfo.getConstantStep();
+    int64_t numIters = firstInfo.getConstantNumIters();
+    if (numIters <= 0)
+      return false;
+    int64_t last = start + (numIters - 1) * step;
+
+    std::optional<int64_t> inductionDim;
+    for (auto [dim, dusIdx, dsIdx] :
+         llvm::enumerate(dus.getStartIndices(), ds.getStartIndices())) {
+      int64_t size = updateTy.getDimSize(dim);
+      int64_t limit = operandTy.getDimSize(dim) - size;
+
+      APInt dusConst, dsConst;
+      if (matchPattern(dusIdx, m_ConstantInt(&dusConst))) {
+        if (!matchPattern(dsIdx, m_ConstantInt(&dsConst)) ||
+            dusConst.getSExtValue() != dsConst.getSExtValue() ||
+            dusConst.getSExtValue() < 0 || dusConst.getSExtValue() > limit)
+          return false;
+        continue;
+      }
+
+      if (inductionDim || !firstMap.contains(dusIdx) ||
+          !secondMap.contains(dsIdx))
+        return false;
+      inductionDim = dim;
+
+      auto dusInfo = firstMap.lookup(dusIdx);
+      auto dsInfo = secondMap.lookup(dsIdx);
+      int64_t scale = dusInfo.scale.getSExtValue();
+      int64_t offset = dusInfo.offset.getSExtValue();
+      if (scale == 0 || scale != dsInfo.scale.getSExtValue() ||
+          offset != dsInfo.offset.getSExtValue())
+        return false;
+
+      // Distinct iterations must write disjoint windows, and no window may be
+      // clamped, so that the window read in iteration i is final once the
+      // first loop has executed iteration i.
+      if (std::abs(scale * step) < size)
+        return false;
+      int64_t lo = std::min(scale * start, scale * last) + offset;
+      int64_t hi = std::max(scale * start, scale * last) + offset;
+      if (lo < 0 || hi > limit)
+        return false;
+    }
+
+    return inductionDim.has_value();
+  }
+
+  LogicalResult matchAndRewriteImpl(stablehlo::WhileOp second,
+                                    PatternRewriter &rewriter) const {
+    stablehlo::WhileOp first;
+    for (Operation *prev = second->getPrevNode(); prev;
+         prev = prev->getPrevNode()) {
+      if ((first = dyn_cast<stablehlo::WhileOp>(prev)))
+        break;
+    }
+    if (!first)
+      return rewriter.notifyMatchFailure(second, "no preceding while");
+
+    if (!isMemoryEffectFree(first) || !isMemoryEffectFree(second))
+      return rewriter.notifyMatchFailure(second, "loops have side effects");
+
+    WhileLoopInfo firstInfo(first), secondInfo(second);
+    if (firstInfo.computeInfo().failed() || secondInfo.computeInfo().failed())
+      return rewriter.notifyMatchFailure(second, "unknown loop bounds");
+    if (!sameBounds(firstInfo, secondInfo))
+      return rewriter.notifyMatchFailure(second, "different loop bounds");
+
+    auto firstMap = firstInfo.getAffineIndexInfo();
+    auto secondMap = secondInfo.getAffineIndexInfo();
+
+    Block &firstBody = first.getBody().front();
+    Block &secondBody = second.getBody().front();
+    auto firstYield = cast<stablehlo::ReturnOp>(firstBody.getTerminator());
+
+    // Slices in the second body that are replaced by the value the first
+    // body writes in the same iteration.
+    llvm::MapVector<Operation *, Value> forwarded;
+    for (auto result : first.getResults()) {
+      for (OpOperand &use : result.getUses()) {
+        Operation *user = use.getOwner();
+        Operation *ancestor = second->getBlock()->findAncestorOpInBlock(*user);
+        if (!ancestor)
+          return failure();
+        if (second->isBeforeInBlock(ancestor))
+          continue;
+        if (ancestor != second)
+          return rewriter.notifyMatchFailure(
+              second, "first loop result used between the loops");
+
+        auto ds = dyn_cast<stablehlo::DynamicSliceOp>(user);
+        if (!ds || use.getOperandNumber() != 0 || ds->getBlock() != &secondBody)
+          return rewriter.notifyMatchFailure(second, "unsupported dependence");
+
+        auto dus = firstYield.getOperand(result.getResultNumber())
+                       .getDefiningOp<stablehlo::DynamicUpdateSliceOp>();
+        if (!dus ||
+            dus.getOperand() != firstBody.getArgument(result.getResultNumber()))
+          return rewriter.notifyMatchFailure(second, "unsupported dependence");
+
+        if (!canForward(dus, ds, firstInfo, firstMap, secondMap))
+          return rewriter.notifyMatchFailure(second, "overlapping accesses");
+
+        forwarded[ds] = dus.getUpdate();
+      }
+    }
+
+    unsigned numFirst = first.getNumResults();
+    SmallVector<Value> operands(first.getOperands());
+    llvm::append_range(operands, second.getOperands());
+    SmallVector<Type> types(first.getResultTypes());
+    llvm::append_range(types, second.getResultTypes());
+    SmallVector<Location> locs;
+    for (auto arg : firstBody.getArguments())
+      locs.push_back(arg.getLoc());
+    for (auto arg : secondBody.getArguments())
+      locs.push_back(arg.getLoc());
+
+    rewriter.setInsertionPoint(second);
+    auto fused = stablehlo::WhileOp::create(rewriter, first.getLoc(), types,
+                                            operands);
+
+    {
+      Block *cond = rewriter.createBlock(&fused.getCond(),
+                                         fused.getCond().end(), types, locs);
+      IRMapping mapper;
+      mapper.map(first.getCond().getArguments(),
+                 cond->getArguments().take_front(numFirst));
+      for (auto &op : first.getCond().front())
+        rewriter.clone(op, mapper);
+    }
+
+    {
+      Block *body = rewriter.createBlock(&fused.getBody(),
+                                         fused.getBody().end(), types, locs);
+      IRMapping mapper;
+      mapper.map(firstBody.getArguments(),
+                 body->getArguments().take_front(numFirst));
+      mapper.map(secondBody.getArguments(),
+                 body->getArguments().drop_front(numFirst));
+
+      for (auto &op : firstBody.without_terminator())
+        rewriter.clone(op, mapper);
+      for (auto &[ds, update] : forwarded)
+        mapper.map(ds->getResult(0), mapper.lookupOrDefault(update));
+      for (auto &op : secondBody.without_terminator()) {
+        if (!forwarded.contains(&op))
+          rewriter.clone(op, mapper);
+      }
+
+      SmallVector<Value> yields;
+      for (auto v : firstYield.getOperands())
+        yields.push_back(mapper.lookupOrDefault(v));
+      for (auto v : secondBody.getTerminator()->getOperands())
+        yields.push_back(mapper.lookupOrDefault(v));
+      stablehlo::ReturnOp::create(rewriter, second.getLoc(), yields);
+    }
+
+    rewriter.replaceOp(first, fused.getResults().take_front(numFirst));
+    rewriter.replaceOp(second, fused.getResults().drop_front(numFirst));
+    return success();
+  }
+};
+
+// Software-pipelines dynamic slices of loop-invariant tensors whose start
+// indices are affine in the induction variable: the slice for the first
+// iteration is taken before the loop, and every iteration prefetches the
+// slice of the next one into a loop-carried buffer. The prefetch issued by
+// the last iteration is clamped by dynamic_slice semantics and discarded.
+struct WhileSlicePipelining
+    : public CheckedOpRewritePattern<stablehlo::WhileOp, WhileSlicePipelining> {
+  using CheckedOpRewritePattern::CheckedOpRewritePattern;
+
+  using IndexInfoMap = llvm::MapVector<Value, WhileLoopInfo::AffineIndexInfo>;
+
+  struct Candidate {
+    stablehlo::DynamicSliceOp slice;
+    // The sliced tensor outside of and inside the loop.
+    Value outerOperand;
+    Value innerOperand;
+  };
+
+  static Value materializeIndex(PatternRewriter &rewriter, Location loc,
+                                Value iv, Value index,
+                                WhileLoopInfo::AffineIndexInfo info) {
+    auto indexTy = cast<RankedTensorType>(index.getType());
+    Value result = iv;
+    if (iv.getType() != indexTy)
+      result = stablehlo::ConvertOp::create(rewriter, loc, indexTy, result);
+
+    if (!info.scale.isOne()) {
+      auto scale = stablehlo::ConstantOp::create(
+          rewriter, loc, indexTy,
+          cast<ElementsAttr>(makeAttr(indexTy, info.scale.getSExtValue())));
+      result = stablehlo::MulOp::create(rewriter, loc, result, scale);
+    }
+    if (!info.offset.isZero()) {
+      auto offset = stablehlo::ConstantOp::create(
+          rewriter, loc, indexTy,
+          cast<ElementsAttr>(makeAttr(indexTy, info.offset.getSExtValue())));
+      result = stablehlo::AddOp::create(rewriter, loc, result, offset);
+    }
+    return result;
+  }
+
+  static Value createSlice(PatternRewriter &rewriter,
+                           stablehlo::DynamicSliceOp slice, Value operand,
+                           Value iv, IndexInfoMap &indexInfo) {
+    SmallVector<Value> startIndices;
+    for (auto index : slice.getStartIndices()) {
+      auto it = indexInfo.find(index);
+      if (it == indexInfo.end())
+        startIndices.push_back(index);
+      else
+        startIndices.push_back(materializeIndex(rewriter, slice.getLoc(), iv,
+                                                index, it->second));
+    }
+    return stablehlo::DynamicSliceOp::create(rewriter, slice.getLoc(), operand,
+                                             startIndices,
+                                             slice.getSliceSizes());
+  }
+
+  // Collects the dynamic slices in the body of `whileOp` of a tensor that is
+  // defined before the loop or carried through it unchanged, whose start
+  // indices are loop invariant or affine in the induction variable, with at
+  // least one of them affine. Slices yielded directly are carried already.
+  static SmallVector<Candidate>
+  collectInvariantSliceCandidates(stablehlo::WhileOp whileOp,
+                                  const IndexInfoMap &indexInfo) {
+    Block &body = whileOp.getBody().front();
+    Operation *terminator = body.getTerminator();
+
+    SmallVector<Candidate> candidates;
+    for (auto slice : body.getOps<stablehlo::DynamicSliceOp>()) {
+      if (llvm::is_contained(slice->getUsers(), terminator))
+        continue;
+
+      Value outerOperand;
+      Value innerOperand = slice.getOperand();
+      if (definedOutside(innerOperand, whileOp)) {
+        outerOperand = innerOperand;
+      } else if (auto arg = dyn_cast<BlockArgument>(innerOperand);
+                 arg && arg.getOwner() == &body &&
+                 terminator->getOperand(arg.getArgNumber()) == arg) {
+        outerOperand = whileOp->getOperand(arg.getArgNumber());
+      } else {
+        continue;
+      }
+
+      bool legal = true, dependsOnIV = false;
+      for (auto index : slice.getStartIndices()) {
+        if (indexInfo.contains(index))
+          dependsOnIV = true;
+        else if (!definedOutside(index, whileOp))
+          legal = false;
+      }
+      if (!legal || !dependsOnIV)
+        continue;
+
+      candidates.push_back({slice, outerOperand, innerOperand});
+    }
+    return candidates;
+  }
+
+  LogicalResult matchAndRewriteImpl(stablehlo::WhileOp whileOp,
+                                    PatternRewriter &rewriter) const {
+    WhileLoopInfo info(whileOp);
+    if (info.computeInfo().failed() || !info.isConstantStep())
+      return rewriter.notifyMatchFailure(whileOp, "unknown loop step");
+
+    auto indexInfo = info.getAffineIndexInfo();
+    Block &body = whileOp.getBody().front();
+    Operation *terminator = body.getTerminator();
+
+    auto candidates = collectInvariantSliceCandidates(whileOp, indexInfo);
+    if (candidates.empty())
+      return rewriter.notifyMatchFailure(whileOp, "no slices to pipeline");
+
+    // Prologue: the slices read by the first iteration.
+    rewriter.setInsertionPoint(whileOp);
+    SmallVector<Value> operands(whileOp.getOperands());
+    for (auto &candidate : candidates)
+      operands.push_back(createSlice(rewriter, candidate.slice,
+                                     candidate.outerOperand, info.getStart(),
+                                     indexInfo));
+
+    // Prefetch the slices read by the next iteration.
+    Value iv = info.getInductionVariable();
+    rewriter.setInsertionPoint(terminator);
+    auto ivTy = cast<RankedTensorType>(iv.getType());
+    auto step = stablehlo::ConstantOp::create(
+        rewriter, whileOp.getLoc(), ivTy,
+        cast<ElementsAttr>(makeAttr(ivTy, *info.getConstantStep())));
+    Value nextIV =
+        stablehlo::AddOp::create(rewriter, whileOp.getLoc(), iv, step);
+    SmallVector<Value> prefetched;
+    for (auto &candidate : candidates)
+      prefetched.push_back(createSlice(rewriter, candidate.slice,
+                                       candidate.innerOperand, nextIV,
+                                       indexInfo));
+
+    auto newWhile = stablehlo::WhileOp::create(
+        rewriter, whileOp.getLoc(), ValueRange(operands).getTypes(), operands);
+    rewriter.inlineRegionBefore(whileOp.getCond(), newWhile.getCond(),
+                                newWhile.getCond().end());
+    rewriter.inlineRegionBefore(whileOp.getBody(), newWhile.getBody(),
+                                newWhile.getBody().end());
+
+    Block &cond = newWhile.getCond().front();
+    for (auto &candidate : candidates) {
+      auto sliceTy = candidate.slice.getType();
+      cond.addArgument(sliceTy, candidate.slice.getLoc());
+      Value buffer = body.addArgument(sliceTy, candidate.slice.getLoc());
+      rewriter.replaceOp(candidate.slice, buffer);
+    }
+    rewriter.modifyOpInPlace(terminator, [&] {
+      terminator->insertOperands(terminator->getNumOperands(), prefetched);
+    });
+
+    rewriter.replaceOp(
+        whileOp, newWhile.getResults().take_front(whileOp.getNumResults()));
+    return success();
+  }
+};
+
+// Index-set splitting for loops whose body compares an affine function of
+// the induction variable against a constant, e.g. `iv == 0` or
+// `iv == n - 1` guarding boundary conditions. If those compares only differ
+// from their steady-state value in the first and last few iterations, the
+// boundary iterations are peeled into straight-line copies with the
+// compares specialized, and the remaining loop sees them as constants.
+struct WhileBoundaryPeel
+    : public CheckedOpRewritePattern<stablehlo::WhileOp, WhileBoundaryPeel> {
+  using CheckedOpRewritePattern::CheckedOpRewritePattern;
+
+  int64_t max_peel;
+  WhileBoundaryPeel(int64_t max_peel, MLIRContext *context,
+                    PatternBenefit benefit = 1,
+                    ArrayRef<StringRef> generatedNames = {})
+      : CheckedOpRewritePattern(context, benefit, generatedNames),
+        max_peel(max_peel) {}
+
+  // Upper bound on the trip count for which the compares are evaluated
+  // iteration by iteration.
+  static constexpr int64_t kMaxEvaluatedIterations = 1 << 20;
+
+  // Signed comparison, as only signed compares are specialized.
+  static bool evaluate(stablehlo::ComparisonDirection direction,
+                       const APInt &lhs, const APInt &rhs) {
+    switch (direction) {
+    case stablehlo::ComparisonDirection::EQ:
+      return lhs == rhs;
+    case stablehlo::ComparisonDirection::NE:
+      return lhs != rhs;
+    case stablehlo::ComparisonDirection::LT:
+      return lhs.slt(rhs);
+    case stablehlo::ComparisonDirection::LE:
+      return lhs.sle(rhs);
+    case stablehlo::ComparisonDirection::GT:
+      return lhs.sgt(rhs);
+    case stablehlo::ComparisonDirection::GE:
+      return lhs.sge(rhs);
+    }
+    llvm_unreachable("unknown comparison direction");
+  }
+
+  LogicalResult matchAndRewriteImpl(stablehlo::WhileOp op,
+                                    PatternRewriter &rewriter) const {
+    WhileLoopInfo info(op);
+    if (info.computeInfo().failed() || !info.isConstant() ||
+        *info.getConstantStep() <= 0)
+      return rewriter.notifyMatchFailure(op, "unsupported loop bounds");
+
+    int64_t start = *info.getConstantStart();
+    int64_t step = *info.getConstantStep();
+    int64_t numIters = info.getConstantNumIters();
+    if (numIters <= 2 || numIters > kMaxEvaluatedIterations)
+      return rewriter.notifyMatchFailure(op, "unsupported trip count");
+
+    auto indexInfo = info.getAffineIndexInfo();
+    Block &body = op.getBody().front();
+
+    // Value of every affine compare in every iteration.
+    llvm::MapVector<Operation *, SmallVector<bool>> compares;
+    for (auto cmp : body.getOps<stablehlo::CompareOp>()) {
+      auto elemTy = getElementTypeOrSelf(cmp.getLhs().getType());
+      if (!isa<IntegerType>(elemTy) || elemTy.isUnsignedInteger())
+        continue;
+      if (cmp.getCompareType() &&
+          *cmp.getCompareType() != stablehlo::ComparisonType::SIGNED)
+        continue;
+
+      auto direction = cmp.getComparisonDirection();
+      Value affine = cmp.getLhs(), other = cmp.getRhs();
+      if (!indexInfo.contains(affine)) {
+        std::swap(affine, other);
+        direction = reversedComparisonDirection(direction);
+      }
+      APInt cst;
+      if (!indexInfo.contains(affine) ||
+          !matchPattern(other, m_ConstantInt(&cst)))
+        continue;
+
+      // The affine value is computed in the width of the induction variable
+      // and converted to the compared type, both wrapping like the loop
+      // body does.
+      auto affineInfo = indexInfo.lookup(affine);
+      unsigned ivWidth = affineInfo.scale.getBitWidth();
+      unsigned width = cast<IntegerType>(elemTy).getWidth();
+      APInt iv(ivWidth, start, /*isSigned*/ true);
+      APInt ivStep(ivWidth, step, /*isSigned*/ true);
+      APInt rhs = cst.sextOrTrunc(width);
+      SmallVector<bool> values;
+      for (int64_t t = 0; t < numIters; t++, iv += ivStep) {
+        APInt lhs = affineInfo.scale * iv + affineInfo.offset;
+        values.push_back(evaluate(direction, lhs.sextOrTrunc(width), rhs));
+      }
+      compares[cmp] = std::move(values);
+    }
+
+    // The compares have to be constant on [front, numIters - back).
+    int64_t mid = numIters / 2, front = 0, back = 0;
+    for (auto &[cmp, values] : compares) {
+      for (int64_t t = 0; t < numIters; t++) {
+        if (values[t] == values[mid])
+          continue;
+        if (t < mid)
+          front = std::max(front, t + 1);
+        else
+          back = std::max(back, numIters - t);
+      }
+    }
+    if (front + back == 0)
+      return rewriter.notifyMatchFailure(op, "no boundary compares");
+    if (front > max_peel || back > max_peel || front + back >= numIters)
+      return rewriter.notifyMatchFailure(op, "too many iterations to peel");
+
+    Location loc = op.getLoc();
+    auto cloneIteration = [&](ValueRange args, int64_t t) {
+      IRMapping mapper;
+      mapper.map(body.getArguments(), args);
+      for (auto &[cmp, values] : compares) {
+        auto ty = cmp->getResult(0).getType();
+        mapper.map(cmp->getResult(0),
+                   stablehlo::ConstantOp::create(
+                       rewriter, cmp->getLoc(), ty,
+                       cast<ElementsAttr>(makeAttr(ty, values[t] ? 1 : 0))));
+      }
+      for (auto &inner : body.without_terminator()) {
+        if (!compares.contains(&inner))
+          rewriter.clone(inner, mapper);
+      }
+      SmallVector<Value> results;
+      for (auto v : body.getTerminator()->getOperands())
+        results.push_back(mapper.lookupOrDefault(v));
+      return results;
+    };
+
+    rewriter.setInsertionPoint(op);
+    SmallVector<Value> args(op.getOperands());
+    for (int64_t t = 0; t < front; t++)
+      args = cloneIteration(args, t);
+
+    auto ivTy = cast<RankedTensorType>(info.getStart().getType());
+    Value newLimit = stablehlo::ConstantOp::create(
+        rewriter, loc, ivTy,
+        cast<ElementsAttr>(
+            makeAttr(ivTy, start + (numIters - back) * step)));
+    auto steady = stablehlo::WhileOp::create(
+        rewriter, loc, op->getResultTypes(), args, op->getAttrs());
+    rewriter.inlineRegionBefore(op.getCond(), steady.getCond(),
+                                steady.getCond().end());
+    rewriter.inlineRegionBefore(op.getBody(), steady.getBody(),
+                                steady.getBody().end());
+
+    rewriter.setInsertionPointAfter(steady);
+    args = llvm::to_vector(steady.getResults());
+    for (int64_t t = numIters - back; t < numIters; t++)
+      args = cloneIteration(args, t);
+
+    // Specialize the steady-state loop.
+    auto condCmp = steady.getCond()
+                       .front()
+                       .getTerminator()
+                       ->getOperand(0)
+                       .getDefiningOp();
+    rewriter.modifyOpInPlace(condCmp,
+                             [&] { condCmp->setOperand(1, newLimit); });
+    for (auto &[cmp, values] : compares) {
+      auto ty = cmp->getResult(0).getType();
+      rewriter.setInsertionPoint(cmp);
+      rewriter.replaceOpWithNewOp<stablehlo::ConstantOp>(
+          cmp, ty, cast<ElementsAttr>(makeAttr(ty, values[mid] ? 1 : 0)));
+    }
+
+    rewriter.replaceOp(op, args);
+    return success();
+  }
+};
+
+// Sliding-window reuse for dynamic slices of loop-invariant tensors whose
+// start index advances by less than the slice size every iteration, e.g.
+// `x[i : i + k]` in a 1D convolution. The window is carried through the
+// loop: each iteration rotates the previous window by the shift and only
+// slices the `shift` elements that enter it, instead of reloading all `k`.
+struct WhileSlidingWindowBuffer
+    : public CheckedOpRewritePattern<stablehlo::WhileOp,
+                                     WhileSlidingWindowBuffer> {
+  using CheckedOpRewritePattern::CheckedOpRewritePattern;
+
+  struct Candidate : WhileSlicePipelining::Candidate {
+    // The dimension the window slides along and by how much.
+    int64_t dim;
+    int64_t shift;
+  };
+
+  LogicalResult matchAndRewriteImpl(stablehlo::WhileOp whileOp,
+                                    PatternRewriter &rewriter) const {
+    WhileLoopInfo info(whileOp);
+    if (info.computeInfo().failed() || !info.isConstant())
+      return rewriter.notifyMatchFailure(whileOp, "unknown loop bounds");
+
+    int64_t start = *info.getConstantStart();
+    int64_t step = *info.getConstantStep();
+    int64_t numIters = info.getConstantNumIters();
+    if (numIters < 2)
+      return rewriter.notifyMatchFailure(whileOp, "no reuse across iterations");
+
+    auto indexInfo = info.getAffineIndexInfo();
+    Block &body = whileOp.getBody().front();
+    Operation *terminator = body.getTerminator();
+
+    SmallVector<Candidate> candidates;
+    for (auto &invariant :
+         WhileSlicePipelining::collectInvariantSliceCandidates(whileOp,
+                                                               indexInfo)) {
+      auto slice = invariant.slice;
+      auto operandTy =
+          cast<RankedTensorType>(invariant.innerOperand.getType());
+      // The window slides along the only dimension indexed by the
+      // induction variable.
+      int64_t dim = -1;
+      bool legal = true;
+      for (auto [i, index] : llvm::enumerate(slice.getStartIndices())) {
+        if (indexInfo.contains(index)) {
+          legal &= dim == -1;
+          dim = i;
+        }
+      }
+      if (!legal || operandTy.isDynamicDim(dim))
+        continue;
+
+      auto affine = indexInfo.lookup(slice.getStartIndices()[dim]);
+      int64_t scale = affine.scale.getSExtValue();
+      int64_t offset = affine.offset.getSExtValue();
+      int64_t size = slice.getSliceSizes()[dim];
+      int64_t shift = scale * step;
+      if (shift <= 0 || shift >= size)
+        continue;
+
+      // The rotated window only matches the original slice if no iteration
+      // had its start index clamped.
+      int64_t first = scale * start + offset;
+      int64_t last = scale * (start + (numIters - 1) * step) + offset;
+      if (first < 0 || last > operandTy.getDimSize(dim) - size)
+        continue;
+
+      candidates.push_back({invariant, dim, shift});
+    }
+
+    if (candidates.empty())
+      return rewriter.notifyMatchFailure(whileOp, "no sliding windows");
+
+    // Prologue: the window read by the first iteration.
+    rewriter.setInsertionPoint(whileOp);
+    SmallVector<Value> operands(whileOp.getOperands());
+    for (auto &candidate : candidates)
+      operands.push_back(WhileSlicePipelining::createSlice(
+          rewriter, candidate.slice, candidate.outerOperand, info.getStart(),
+          indexInfo));
+
+    auto newWhile = stablehlo::WhileOp::create(
+        rewriter, whileOp.getLoc(), ValueRange(operands).getTypes(), operands);
+    rewriter.inlineRegionBefore(whileOp.getCond(), newWhile.getCond(),
+                                newWhile.getCond().end());
+    rewriter.inlineRegionBefore(whileOp.getBody(), newWhile.getBody(),
+                                newWhile.getBody().end());
+
+    Value iv = info.getInductionVariable();
+    rewriter.setInsertionPoint(terminator);
+    auto ivTy = cast<RankedTensorType>(iv.getType());
+    auto stepCst = stablehlo::ConstantOp::create(
+        rewriter, whileOp.getLoc(), ivTy,
+        cast<ElementsAttr>(makeAttr(ivTy, step)));
+    Value nextIV =
+        stablehlo::AddOp::create(rewriter, whileOp.getLoc(), iv, stepCst);
+
+    Block &cond = newWhile.getCond().front();
+    SmallVector<Value> nextWindows;
+    for (auto &candidate : candidates) {
+      auto slice = candidate.slice;
+      Location loc = slice.getLoc();
+      auto sliceTy = slice.getType();
+      cond.addArgument(sliceTy, loc);
+      Value window = body.addArgument(sliceTy, loc);
+
+      // Shift the window and fill in the elements that enter it.
+      int64_t dim = candidate.dim;
+      int64_t size = slice.getSliceSizes()[dim];
+      int64_t keep = size - candidate.shift;
+      Value index = slice.getStartIndices()[dim];
+      auto affine = indexInfo.lookup(index);
+      affine.offset += keep;
+      SmallVector<Value> startIndices(slice.getStartIndices());
+      startIndices[dim] = WhileSlicePipelining::materializeIndex(
+          rewriter, loc, nextIV, index, affine);
+      SmallVector<int64_t> sizes(slice.getSliceSizes());
+      sizes[dim] = candidate.shift;
+      Value entering = stablehlo::DynamicSliceOp::create(
+          rewriter, loc, candidate.innerOperand, startIndices, sizes);
+
+      Value rotated = enzymexla::RotateOp::create(rewriter, loc, window,
+                                                  candidate.shift, dim);
+      auto indexTy = cast<RankedTensorType>(index.getType());
+      auto zero = stablehlo::ConstantOp::create(
+          rewriter, loc, indexTy, cast<ElementsAttr>(makeAttr(indexTy, 0)));
+      SmallVector<Value> updateIndices(sliceTy.getRank(), zero);
+      updateIndices[dim] = stablehlo::ConstantOp::create(
+          rewriter, loc, indexTy, cast<ElementsAttr>(makeAttr(indexTy, keep)));
+      nextWindows.push_back(stablehlo::DynamicUpdateSliceOp::create(
+          rewriter, loc, rotated, entering, updateIndices));
+
+      rewriter.replaceOp(slice, window);
+    }
+    rewriter.modifyOpInPlace(terminator, [&] {
+      terminator->insertOperands(terminator->getNumOperands(), nextWindows);
+    });
+
+    rewriter.replaceOp(
+        whileOp, newWhile.getResults().take_front(whileOp.getNumResults()));
+    return success();
+  }
+};
+
 struct WhileUpdateWithoutCorners
     : public CheckedOpRewritePattern<stablehlo::WhileOp,
                                      WhileUpdateWithoutCorners> {
@@ -16598,6 +17690,318 @@ struct WhileRepeatedInductionReduction
   }
 };
 
+// Rewrites loops that compute an inclusive scan into a carried tensor,
+//   a[iv + k] = a[iv + k - 1] op b[iv + l]
+// with op one of add, mul, max or min, into a parallel prefix over the scanned
+// slice of b, combined with the seed element a[start + k - 1]. The prefix is
+// built from pairwise reduce_windows, slices and pads, with linear work and
+// logarithmic depth. Floating-point sums and products are only rewritten when
+// `reassociate_float` is set, since the prefix reorders them. The loop result
+// is replaced; the now dead loop-carried value is removed by the while cleanup
+// patterns.
+struct WhileScanToReduceWindow
+    : public CheckedOpRewritePattern<stablehlo::WhileOp,
+                                     WhileScanToReduceWindow> {
+  using CheckedOpRewritePattern::CheckedOpRewritePattern;
+
+  bool reassociate_float;
+  WhileScanToReduceWindow(bool reassociate_float, MLIRContext *context,
+                          PatternBenefit benefit = 1,
+                          ArrayRef<StringRef> generatedNames = {})
+      : CheckedOpRewritePattern(context, benefit, generatedNames),
+        reassociate_float(reassociate_float) {}
+
+  using IndexInfoMap = llvm::MapVector<Value, WhileLoopInfo::AffineIndexInfo>;
+
+  // Matches start indices which are constant along all dimensions but one,
+  // which is indexed by iv + offset.
+  static bool getScanAccess(ValueRange indices, IndexInfoMap &indexInfo,
+                            int64_t &dim, int64_t &offset,
+                            SmallVectorImpl<int64_t> &starts) {
+    dim = -1;
+    for (auto [i, index] : llvm::enumerate(indices)) {
+      APInt cst;
+      if (matchPattern(index, m_ConstantInt(&cst))) {
+        starts.push_back(cst.getSExtValue());
+        continue;
+      }
+      auto it = indexInfo.find(index);
+      if (dim != -1 || it == indexInfo.end() || !it->second.scale.isOne())
+        return false;
+      dim = i;
+      offset = it->second.offset.getSExtValue();
+      starts.push_back(0);
+    }
+    return dim != -1;
+  }
+
+  static bool inBounds(ArrayRef<int64_t> starts, ArrayRef<int64_t> sizes,
+                       RankedTensorType ty) {
+    for (auto [start, size, dimSize] :
+         llvm::zip_equal(starts, sizes, ty.getShape())) {
+      if (start < 0 || start + size > dimSize)
+        return false;
+    }
+    return true;
+  }
+
+  static ElementsAttr getIdentity(Operation *op, RankedTensorType ty) {
+    auto elemTy = ty.getElementType();
+    if (!isa<FloatType, IntegerType>(elemTy))
+      return nullptr;
+    // -0.0 rather than 0.0, so that adding it preserves the sign of zeros.
+    if (isa<stablehlo::AddOp>(op)) {
+      if (auto floatTy = dyn_cast<FloatType>(elemTy))
+        return DenseElementsAttr::get(
+            ty, APFloat::getZero(floatTy.getFloatSemantics(), true));
+      return cast<ElementsAttr>(makeAttr(ty, 0));
+    }
+    if (isa<stablehlo::MulOp>(op))
+      return cast<ElementsAttr>(makeAttr(ty, 1));
+
+    bool isMax = isa<stablehlo::MaxOp>(op);
+    if (auto floatTy = dyn_cast<FloatType>(elemTy))
+      return DenseElementsAttr::get(
+          ty, APFloat::getInf(floatTy.getFloatSemantics(), isMax));
+    auto intTy = cast<IntegerType>(elemTy);
+    unsigned width = intTy.getWidth();
+    // Booleans are ordered false < true, max is an or and min an and.
+    if (intTy.isUnsigned() || width == 1)
+      return DenseElementsAttr::get(ty, isMax ? APInt::getMinValue(width)
+                                              : APInt::getMaxValue(width));
+    return DenseElementsAttr::get(ty, isMax ? APInt::getSignedMinValue(width)
+                                            : APInt::getSignedMaxValue(width));
+  }
+
+  static Value createCombine(PatternRewriter &rewriter, Operation *combine,
+                             Value lhs, Value rhs) {
+    OperationState state(combine->getLoc(), combine->getName());
+    state.addOperands({lhs, rhs});
+    state.addTypes(lhs.getType());
+    return rewriter.create(state)->getResult(0);
+  }
+
+  // Slices [start, limit) with `stride` along `dim`, keeping the other
+  // dimensions whole.
+  static Value sliceAlong(PatternRewriter &rewriter, Location loc, Value v,
+                          int64_t dim, int64_t start, int64_t limit,
+                          int64_t stride) {
+    auto ty = cast<RankedTensorType>(v.getType());
+    SmallVector<int64_t> starts(ty.getRank(), 0), limits(ty.getShape()),
+        strides(ty.getRank(), 1);
+    starts[dim] = start;
+    limits[dim] = limit;
+    strides[dim] = stride;
+    return stablehlo::SliceOp::create(rewriter, loc, v, starts, limits,
+                                      strides);
+  }
+
+  // Inclusive scan of `x` along `dim`. Adjacent pairs are combined by a
+  // reduce_window of size and stride 2, whose scan gives the odd positions.
+  // Each even position combines the preceding odd one with its own element.
+  // Both halves are then interleaved by padding them with the identity `init`.
+  static Value createScan(PatternRewriter &rewriter, Location loc,
+                          Operation *combine, Value x, Value init,
+                          int64_t dim) {
+    auto ty = cast<RankedTensorType>(x.getType());
+    int64_t n = ty.getDimSize(dim);
+    if (n < 2)
+      return x;
+    int64_t rank = ty.getRank();
+    int64_t numEven = (n + 1) / 2, numOdd = n / 2;
+
+    SmallVector<int64_t> windowDims(rank, 1), ones(rank, 1);
+    windowDims[dim] = 2;
+    SmallVector<int64_t> pairsShape(ty.getShape());
+    pairsShape[dim] = numOdd;
+    Type resultTys[1] = {ty.clone(pairsShape)};
+    Value inputs[1] = {x};
+    Value inits[1] = {init};
+    auto pairs = stablehlo::ReduceWindowOp::create(
+        rewriter, loc, resultTys, inputs, inits,
+        rewriter.getDenseI64ArrayAttr(windowDims),
+        rewriter.getDenseI64ArrayAttr(windowDims),
+        rewriter.getDenseI64ArrayAttr(ones),
+        rewriter.getDenseI64ArrayAttr(ones),
+        DenseIntElementsAttr::get(
+            RankedTensorType::get({rank, 2}, rewriter.getIntegerType(64)),
+            SmallVector<int64_t>(2 * rank, 0)));
+    {
+      OpBuilder::InsertionGuard guard(rewriter);
+      auto scalarTy = cast<RankedTensorType>(init.getType());
+      Type tys[2] = {scalarTy, scalarTy};
+      Location locs[2] = {loc, loc};
+      Block *block = rewriter.createBlock(&pairs.getBody(), {}, tys, locs);
+      Value combined = createCombine(rewriter, combine, block->getArgument(0),
+                                     block->getArgument(1));
+      stablehlo::ReturnOp::create(rewriter, loc, combined);
+    }
+
+    Value odd =
+        createScan(rewriter, loc, combine, pairs.getResult(0), init, dim);
+    Value even = sliceAlong(rewriter, loc, x, dim, 0, 1, 1);
+    if (numEven > 1) {
+      Value prefix = sliceAlong(rewriter, loc, odd, dim, 0, numEven - 1, 1);
+      Value rest = sliceAlong(rewriter, loc, x, dim, 2, n, 2);
+      Value parts[2] = {even, createCombine(rewriter, combine, prefix, rest)};
+      even = stablehlo::ConcatenateOp::create(rewriter, loc, parts, dim);
+    }
+
+    SmallVector<int64_t> low(rank, 0), high(rank, 0), interior(rank, 0);
+    interior[dim] = 1;
+    high[dim] = n - (2 * numEven - 1);
+    Value paddedEven = stablehlo::PadOp::create(rewriter, loc, even, init, low,
+                                                high, interior);
+    low[dim] = 1;
+    high[dim] = n - 2 * numOdd;
+    Value paddedOdd = stablehlo::PadOp::create(rewriter, loc, odd, init, low,
+                                               high, interior);
+    return createCombine(rewriter, combine, paddedEven, paddedOdd);
+  }
+
+  LogicalResult matchAndRewriteImpl(stablehlo::WhileOp whileOp,
+                                    PatternRewriter &rewriter) const {
+    WhileLoopInfo info(whileOp);
+    if (info.computeInfo().failed() || !info.isConstant() ||
+        *info.getConstantStep() != 1)
+      return rewriter.notifyMatchFailure(whileOp, "unsupported loop bounds");
+
+    int64_t start = *info.getConstantStart();
+    int64_t numIters = info.getConstantNumIters();
+    if (numIters < 2)
+      return rewriter.notifyMatchFailure(whileOp, "too few iterations");
+
+    auto indexInfo = info.getAffineIndexInfo();
+    Block &body = whileOp.getBody().front();
+    auto yield = cast<stablehlo::ReturnOp>(body.getTerminator());
+
+    bool changed = false;
+    for (auto [idx, result] : llvm::enumerate(whileOp.getResults())) {
+      if (result.use_empty())
+        continue;
+
+      auto dus = yield.getOperand(idx)
+                     .getDefiningOp<stablehlo::DynamicUpdateSliceOp>();
+      if (!dus || dus.getOperand() != body.getArgument(idx))
+        continue;
+
+      auto updateTy = cast<RankedTensorType>(dus.getUpdate().getType());
+      auto carriedTy = cast<RankedTensorType>(dus.getType());
+      int64_t dim, offset;
+      SmallVector<int64_t> starts;
+      if (!updateTy.hasStaticShape() || !carriedTy.hasStaticShape() ||
+          !getScanAccess(dus.getStartIndices(), indexInfo, dim, offset,
+                         starts) ||
+          updateTy.getDimSize(dim) != 1)
+        continue;
+
+      Operation *combine = dus.getUpdate().getDefiningOp();
+      if (!combine || !isa<stablehlo::AddOp, stablehlo::MulOp,
+                           stablehlo::MaxOp, stablehlo::MinOp>(combine))
+        continue;
+
+      // One operand reads the element written by the previous iteration, the
+      // other one slices a loop-invariant tensor.
+      stablehlo::DynamicSliceOp prev, next;
+      bool prevIsLhs = true;
+      for (int i = 0; i < 2; i++) {
+        auto ds = combine->getOperand(i)
+                      .getDefiningOp<stablehlo::DynamicSliceOp>();
+        if (!ds)
+          continue;
+        if (!prev && ds.getOperand() == body.getArgument(idx)) {
+          prev = ds;
+          prevIsLhs = i == 0;
+        } else if (definedOutside(ds.getOperand(), whileOp)) {
+          next = ds;
+        }
+      }
+      if (!prev || !next || prev.getType() != updateTy ||
+          next.getType() != updateTy)
+        continue;
+
+      int64_t prevDim, prevOffset, nextDim, nextOffset;
+      SmallVector<int64_t> prevStarts, nextStarts;
+      if (!getScanAccess(prev.getStartIndices(), indexInfo, prevDim,
+                         prevOffset, prevStarts) ||
+          prevDim != dim || prevOffset != offset - 1 || prevStarts != starts)
+        continue;
+      if (!getScanAccess(next.getStartIndices(), indexInfo, nextDim,
+                         nextOffset, nextStarts) ||
+          nextDim != dim)
+        continue;
+
+      auto scanned = cast<RankedTensorType>(next.getOperand().getType());
+      if (!scanned.hasStaticShape())
+        continue;
+
+      // All accesses must be in bounds so that none of them is clamped.
+      SmallVector<int64_t> sizes(updateTy.getShape());
+      SmallVector<int64_t> scanSizes(sizes);
+      scanSizes[dim] = numIters;
+      SmallVector<int64_t> seedStarts(starts), writeStarts(starts);
+      seedStarts[dim] = start + offset - 1;
+      writeStarts[dim] = start + offset;
+      nextStarts[dim] = start + nextOffset;
+      if (!inBounds(seedStarts, sizes, carriedTy) ||
+          !inBounds(writeStarts, scanSizes, carriedTy) ||
+          !inBounds(nextStarts, scanSizes, scanned))
+        continue;
+
+      if (isa<FloatType>(updateTy.getElementType()) && !reassociate_float &&
+          isa<stablehlo::AddOp, stablehlo::MulOp>(combine))
+        continue;
+
+      auto scalarTy = RankedTensorType::get({}, updateTy.getElementType());
+      auto identity = getIdentity(combine, scalarTy);
+      if (!identity)
+        continue;
+
+      rewriter.setInsertionPoint(whileOp);
+      Location loc = whileOp.getLoc();
+      int64_t rank = updateTy.getRank();
+
+      SmallVector<int64_t> limits, strides(rank, 1);
+      for (auto [s, size] : llvm::zip_equal(nextStarts, scanSizes))
+        limits.push_back(s + size);
+      Value window = stablehlo::SliceOp::create(
+          rewriter, loc, next.getOperand(), nextStarts, limits, strides);
+      auto windowTy = cast<RankedTensorType>(window.getType());
+
+      Value init = stablehlo::ConstantOp::create(rewriter, loc, identity);
+      Value scan = createScan(rewriter, loc, combine, window, init, dim);
+
+      Value initial = whileOp->getOperand(idx);
+      SmallVector<int64_t> seedLimits;
+      for (auto [s, size] : llvm::zip_equal(seedStarts, sizes))
+        seedLimits.push_back(s + size);
+      Value seed = stablehlo::SliceOp::create(rewriter, loc, initial,
+                                              seedStarts, seedLimits, strides);
+      seed = stablehlo::BroadcastInDimOp::create(
+          rewriter, loc, windowTy, seed,
+          llvm::to_vector(llvm::seq<int64_t>(0, rank)));
+
+      Value combined =
+          prevIsLhs
+              ? createCombine(rewriter, combine, seed, scan)
+              : createCombine(rewriter, combine, scan, seed);
+
+      SmallVector<Value> writeIndices;
+      auto indexTy = RankedTensorType::get({}, rewriter.getI64Type());
+      for (auto s : writeStarts)
+        writeIndices.push_back(stablehlo::ConstantOp::create(
+            rewriter, loc, indexTy, cast<ElementsAttr>(makeAttr(indexTy, s))));
+      Value replacement = stablehlo::DynamicUpdateSliceOp::create(
+          rewriter, loc, initial, combined, writeIndices);
+
+      rewriter.replaceAllUsesWith(result, replacement);
+      changed = true;
+    }
+
+    return changed ? success() : failure();
+  }
+};
+
 struct WhilePadInductionReduction
     : public CheckedOpRewritePattern<stablehlo::WhileOp,
                                      WhilePadInductionReduction> {
@@ -19659,6 +21063,102 @@ struct WhileLICM
   }
 };
 
+// Hoists loop-invariant, speculatable operations out of a while loop,
+// including operations nested in inner while loops and in if/case branches.
+// The loop may not run at all, so every hoisted operation is speculated and
+// operations with regions are never hoisted. Operations in a branch are only
+// moved when none of their results has more than `max_speculated_elements`
+// elements.
+struct RegionLICM
+    : public CheckedOpRewritePattern<stablehlo::WhileOp, RegionLICM> {
+  using CheckedOpRewritePattern::CheckedOpRewritePattern;
+
+  int64_t max_speculated_elements;
+  RegionLICM(int64_t max_speculated_elements, MLIRContext *context,
+             PatternBenefit benefit = 1,
+             ArrayRef<StringRef> generatedNames = {})
+      : CheckedOpRewritePattern(context, benefit, generatedNames),
+        max_speculated_elements(max_speculated_elements) {}
+
+  // Returns whether `op` sits in a conditional branch below `loop`, or
+  // failure if it is nested in a region that is not structured control flow.
+  static FailureOr<bool> isSpeculated(Operation *op, Operation *loop) {
+    bool speculated = false;
+    for (Operation *parent = op->getParentOp(); parent != loop;
+         parent = parent->getParentOp()) {
+      if (isa<stablehlo::IfOp, stablehlo::CaseOp>(parent))
+        speculated = true;
+      else if (!isa<stablehlo::WhileOp>(parent))
+        return failure();
+    }
+    return speculated;
+  }
+
+  bool isCheapToSpeculate(Operation *op) const {
+    return llvm::all_of(op->getResultTypes(), [&](Type ty) {
+      auto shapedTy = dyn_cast<ShapedType>(ty);
+      return shapedTy && shapedTy.hasStaticShape() &&
+             shapedTy.getNumElements() <= max_speculated_elements;
+    });
+  }
+
+  LogicalResult matchAndRewriteImpl(stablehlo::WhileOp op,
+                                    PatternRewriter &rewriter) const {
+    SmallVector<Operation *> toHoist;
+    DenseSet<Operation *> hoisted;
+
+    // Constants defined inside the loop do not block hoisting; they are
+    // cloned in front of the hoisted user.
+    auto isInvariant = [&](Value v) {
+      if (definedOutside(v, op))
+        return true;
+      auto defOp = v.getDefiningOp();
+      if (!defOp)
+        return false;
+      return hoisted.contains(defOp) || isa<stablehlo::ConstantOp>(defOp);
+    };
+
+    op->walk<WalkOrder::PreOrder>([&](Operation *inner) {
+      if (inner == op || inner->getNumRegions() ||
+          inner->hasTrait<OpTrait::IsTerminator>() ||
+          isa<stablehlo::ConstantOp>(inner) || !isMemoryEffectFree(inner) ||
+          !isSpeculatable(inner))
+        return;
+
+      auto speculated = isSpeculated(inner, op);
+      if (failed(speculated) || (*speculated && !isCheapToSpeculate(inner)))
+        return;
+
+      if (!llvm::all_of(inner->getOperands(),
+                        [&](Value v) { return isInvariant(v); }))
+        return;
+
+      toHoist.push_back(inner);
+      hoisted.insert(inner);
+    });
+
+    if (toHoist.empty())
+      return rewriter.notifyMatchFailure(op, "no invariant operations");
+
+    for (Operation *inner : toHoist) {
+      rewriter.setInsertionPoint(op);
+      SmallVector<std::pair<unsigned, Value>> constants;
+      for (OpOperand &operand : inner->getOpOperands()) {
+        auto cst = operand.get().getDefiningOp<stablehlo::ConstantOp>();
+        if (cst && !definedOutside(cst.getResult(), op))
+          constants.emplace_back(operand.getOperandNumber(),
+                                 rewriter.clone(*cst)->getResult(0));
+      }
+      rewriter.modifyOpInPlace(inner, [&] {
+        inner->moveBefore(op);
+        for (auto [idx, cst] : constants)
+          inner->setOperand(idx, cst);
+      });
+    }
+    return success();
+  }
+};
+
 // Replace a while op consisting of DUS chains for each iter arg where each DUS
 // doesn't depend on values evolving in the loop. This can be later extended to
 // support other similarly idempotent ops. The loop is expected to have a
@@ -31721,8 +33221,10 @@ struct RecognizeFromConstant final
 
   LogicalResult matchAndRewriteImpl(stablehlo::ConstantOp op,
                                     PatternRewriter &rewriter) {
-    DenseElementsAttr val = cast<DenseElementsAttr>(op.getValue());
-    if (val.isSplat() || op.getType().getNumElements() < min_fold_size) {
+    // Blobs emitted by a FoldedConstantArena are left alone.
+    auto val = dyn_cast<DenseElementsAttr>(op.getValue());
+    if (!val || val.isSplat() ||
+        op.getType().getNumElements() < min_fold_size) {
       return failure();
     }
 
@@ -33253,7 +34755,8 @@ void mlir::transform::addEnzymeHLOUnroll(RewritePatternSet &patterns,
                                          int64_t maxNumIterations,
                                          MLIRContext &context,
                                          PatternBenefit benefit) {
-  patterns.insert<WhileUnroll>(maxNumIterations, 128, &context, benefit);
+  patterns.insert<WhileUnroll>(maxNumIterations, 128, /*unrollFactor*/ 1,
+                               &context, benefit);
 }
 
 void mlir::transform::addPadDotGeneral(RewritePatternSet &patterns,
@@ -33466,6 +34969,28 @@ void mlir::transform::addIotaLICM(RewritePatternSet &patterns, bool single_user,
   patterns.insert<LICM<stablehlo::IotaOp>>(single_user, &context, benefit);
 }
 
+void mlir::transform::addRegionLICM(RewritePatternSet &patterns,
+                                    int64_t maxSpeculatedElements,
+                                    MLIRContext &context,
+                                    PatternBenefit benefit) {
+  patterns.insert<RegionLICM>(maxSpeculatedElements, &context, benefit);
+}
+
+void mlir::transform::addWhileScanToReduceWindow(RewritePatternSet &patterns,
+                                                 bool reassociateFloat,
+                                                 MLIRContext &context,
+                                                 PatternBenefit benefit) {
+  patterns.insert<WhileScanToReduceWindow>(reassociateFloat, &context,
+                                           benefit);
+}
+
+void mlir::transform::addWhileBoundaryPeel(RewritePatternSet &patterns,
+                                           int64_t maxPeel,
+                                           MLIRContext &context,
+                                           PatternBenefit benefit) {
+  patterns.insert<WhileBoundaryPeel>(maxPeel, &context, benefit);
+}
+
 void mlir::transform::addNoNanAddSubSimplify(RewritePatternSet &patterns,
                                              bool allowOnFloatingPointMath,
                                              MLIRContext &context,
@@ -33621,6 +35146,7 @@ struct EnzymeHLOOptPass
 
   void runOnOperation() override {
     auto context = getOperation()->getContext();
+    FoldedConstantArena arena(out_of_line_constant_bytes);
 
     RewritePatternSet patterns(context);
     mlir::enzyme::populateWithGenerated(patterns);
@@ -33661,10 +35187,12 @@ struct EnzymeHLOOptPass
         SliceReshapeDynamicSlice, SliceReshapeSlice>(context,
                                                      PatternBenefit(65000));
 
-    patterns.add<IotaSimplify, BroadcastInDimSimplify, ConcatConstProp,
-                 DynamicUpdateSliceConstProp, PadSimplify, ScatterConstFold,
+    patterns.add<IotaSimplify, BroadcastInDimSimplify,
+                 DynamicUpdateSliceConstProp, PadSimplify,
                  RecognizeFromConstant>(max_constant_expansion, context,
                                         PatternBenefit(65000));
+    patterns.add<ConcatConstProp, ScatterConstFold>(
+        max_constant_expansion, &arena, context, PatternBenefit(65000));
 
     patterns.add<
         ConvertConcat, DynamicUpdateToConcat, SliceOfDynamicUpdate,
@@ -33705,7 +35233,8 @@ struct EnzymeHLOOptPass
                                 stablehlo::roundNearestEvenOp>,
                  UnaryConstProp<stablehlo::SignOp, stablehlo::signOp>,
                  UnaryConstProp<stablehlo::FloorOp, stablehlo::floorOp>,
-                 UnaryConstProp<stablehlo::TanOp, stablehlo::tanOp>>(context);
+                 UnaryConstProp<stablehlo::TanOp, stablehlo::tanOp>>(&arena,
+                                                                     context);
 
     // binary constant propagation patterns
     patterns.add<BinaryConstProp<stablehlo::AddOp, stablehlo::addOp>,
@@ -33720,7 +35249,8 @@ struct EnzymeHLOOptPass
                  BinaryConstProp<stablehlo::PowOp, stablehlo::powerOp>,
                  BinaryConstProp<stablehlo::RemOp, stablehlo::remOp>,
                  BinaryConstProp<stablehlo::SubtractOp, stablehlo::subtractOp>,
-                 BinaryConstProp<stablehlo::XorOp, stablehlo::xorOp>>(context);
+                 BinaryConstProp<stablehlo::XorOp, stablehlo::xorOp>>(&arena,
+                                                                      context);
 
     patterns.add<GatherConstProp, ClampConstProp>(context);
 
@@ -33914,6 +35444,7 @@ struct EnzymeHLOOptPass
     patterns.add<
         WhileRepeatedInductionReduction,
         WhileOpInductionReplacement,
+        WhileConditionCanonicalize,
         WhilePadInductionReduction,
         WhileIdempotentDUS,
         ConcatBroadcastToPad,
@@ -34068,13 +35599,17 @@ struct EnzymeHLOOptPass
                                                      options);
     }
 
+    FoldedConstantArenaListener listener(arena, getOperation());
     GreedyRewriteConfig config;
     config.setMaxIterations(max_iterations);
     config.setUseTopDownTraversal(top_down);
+    if (arena.threshold)
+      config.setListener(&listener);
     if (failed(applyPatternsAndFoldGreedily(getOperation(), std::move(patterns),
                                             config))) {
       signalPassFailure();
     }
+    arena.releaseUnused(getOperation());
   }
 };
 
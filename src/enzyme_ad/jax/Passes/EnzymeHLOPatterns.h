@@ -144,6 +144,13 @@ void addMultiSliceLICM(RewritePatternSet &patterns, bool single_user,
                        MLIRContext &context, PatternBenefit benefit);
 void addMultiRotateLICM(RewritePatternSet &patterns, bool single_user,
                         MLIRContext &context, PatternBenefit benefit);
+void addRegionLICM(RewritePatternSet &patterns, int64_t maxSpeculatedElements,
+                   MLIRContext &context, PatternBenefit benefit);
+void addWhileScanToReduceWindow(RewritePatternSet &patterns,
+                                bool reassociateFloat, MLIRContext &context,
+                                PatternBenefit benefit);
+void addWhileBoundaryPeel(RewritePatternSet &patterns, int64_t maxPeel,
+                          MLIRContext &context, PatternBenefit benefit);
 
 } // namespace mlir::transform
 
@@ -0,0 +1,317 @@
+//===- EnzymeHLOScheduleSearch.cpp - Cost-guided rewrite schedule search --===//
+//
+// This file implements a pass that searches over sequences of greedy rewrite
+// schedules on StableHLO functions and keeps the cheapest result according
+// to a static cost model.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
+#include "mlir/Dialect/Transform/IR/TransformDialect.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Pass/PassRegistry.h"
+#include "src/enzyme_ad/jax/Dialect/Dialect.h"
+#include "src/enzyme_ad/jax/Dialect/Perfify/Dialect.h"
+#include "src/enzyme_ad/jax/Implementations/WhileLoopInfo.h"
+#include "src/enzyme_ad/jax/Passes/Passes.h"
+#include "stablehlo/dialect/ChloOps.h"
+#include "stablehlo/dialect/StablehloOps.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/xxhash.h"
+
+#include <chrono>
+
+#define DEBUG_TYPE "enzyme-hlo-schedule-search"
+
+namespace mlir {
+namespace enzyme {
+#define GEN_PASS_DEF_ENZYMEHLOSCHEDULESEARCHPASS
+#include "src/enzyme_ad/jax/Passes/Passes.h.inc"
+} // namespace enzyme
+} // namespace mlir
+
+using namespace mlir;
+using namespace mlir::enzyme;
+
+namespace {
+
+// The propagation directions `full_optimization_pass_pipeline` otherwise has
+// to run one after the other.
+constexpr const char *kTransposeUpPatterns =
+    "transpose_select;transpose_while;transpose_slice;transpose_concat;"
+    "transpose_iota;transpose_reduce;transpose_reduce_window;transpose_dus;"
+    "transpose_pad<1>;transpose_einsum<1>;transpose_dynamic_slice;"
+    "transpose_reverse;transpose_reshape;transpose_elementwise(1);"
+    "transpose_transpose<16>";
+constexpr const char *kTransposeDownPatterns =
+    "reorder_elementwise_and_shape_op<16>;"
+    "elementwise_all_transpose_operands_simplify;dynamic_slice_transpose;"
+    "slice_transpose;einsum_transpose<1>;reduce_transpose_simplify;"
+    "reverse_transpose;transpose_all_users_slice;transpose_transpose<16>";
+constexpr const char *kReshapeUpPatterns =
+    "reshape_concat;reshape_dus;reshape_pad;reshape_slice(1);"
+    "reshape_elementwise(1);reshape_dynamic_slice(1)";
+constexpr const char *kReshapeDownPatterns =
+    "concat_appending_reshape;slice_reshape;slice_reshape_slice<1>;"
+    "dynamic_slice_reshape_slice;slice_reshape_concat<1>;"
+    "slice_reshape_elementwise<1>;slice_reshape_pad<1>;"
+    "elementwise_reshape_like";
+
+// Static cost of StableHLO programs. Unless overridden, every op costs one
+// unit per element it reads or writes and dot_general and convolution cost
+// one unit per multiply-add. Reshapes, iotas and non-splat constants are
+// charged for the elements they materialize, since the backend may have to
+// copy them into a different layout. A `perfify.cost "<op name>" <cycles>`
+// entry in the module overrides the per-element cost of an op.
+class HLOCostModel {
+public:
+  explicit HLOCostModel(ModuleOp module) {
+    module.walk([&](perfify::CostOp cost) {
+      overrides[cost.getTargetOp()] = cost.getCycleCost().getSExtValue();
+    });
+  }
+
+  uint64_t getCost(Operation *root) const {
+    uint64_t total = 0;
+    for (auto &region : root->getRegions())
+      for (auto &block : region)
+        for (auto &op : block)
+          total = llvm::SaturatingAdd(total, getOpCost(&op));
+    return total;
+  }
+
+private:
+  llvm::StringMap<int64_t> overrides;
+
+  static uint64_t numElements(Type type) {
+    auto tensorTy = dyn_cast<RankedTensorType>(type);
+    if (!tensorTy || !tensorTy.hasStaticShape())
+      return 1;
+    return tensorTy.getNumElements();
+  }
+
+  static uint64_t numElements(TypeRange types) {
+    uint64_t total = 0;
+    for (auto type : types)
+      total = llvm::SaturatingAdd(total, numElements(type));
+    return total;
+  }
+
+  uint64_t getOpCost(Operation *op) const {
+    auto it = overrides.find(op->getName().getStringRef());
+    if (it != overrides.end())
+      return llvm::SaturatingMultiply<uint64_t>(
+          std::max<int64_t>(it->second, 0), numElements(op->getResultTypes()));
+
+    if (auto whileOp = dyn_cast<stablehlo::WhileOp>(op)) {
+      uint64_t tripCount = 1;
+      WhileLoopInfo info(whileOp);
+      if (info.computeInfo().succeeded() && info.isConstant())
+        tripCount = std::max<int64_t>(info.getConstantNumIters(), 0);
+      return llvm::SaturatingMultiply(tripCount, getCost(op));
+    }
+    if (op->getNumRegions() != 0 &&
+        !isa<stablehlo::ReduceOp, stablehlo::ReduceWindowOp,
+             stablehlo::ScatterOp, stablehlo::SortOp,
+             stablehlo::SelectAndScatterOp>(op))
+      return getCost(op);
+
+    if (isa<stablehlo::ReturnOp, func::ReturnOp>(op))
+      return 0;
+
+    if (auto constant = dyn_cast<stablehlo::ConstantOp>(op)) {
+      if (auto elements = dyn_cast<DenseElementsAttr>(constant.getValue());
+          elements && elements.isSplat())
+        return 1;
+      return numElements(constant.getType());
+    }
+    if (isa<stablehlo::IotaOp, stablehlo::ReshapeOp>(op))
+      return numElements(op->getResultTypes());
+
+    if (auto dot = dyn_cast<stablehlo::DotGeneralOp>(op)) {
+      auto lhsTy = cast<RankedTensorType>(dot.getLhs().getType());
+      uint64_t contracted = 1;
+      auto dimensionNumbers = dot.getDotDimensionNumbers();
+      for (auto dim : dimensionNumbers.getLhsContractingDimensions())
+        contracted = llvm::SaturatingMultiply<uint64_t>(
+            contracted, lhsTy.getDimSize(dim));
+      return llvm::SaturatingMultiply(numElements(dot.getType()), contracted);
+    }
+    if (auto conv = dyn_cast<stablehlo::ConvolutionOp>(op)) {
+      auto rhsTy = cast<RankedTensorType>(conv.getRhs().getType());
+      int64_t outFeatures = std::max<int64_t>(
+          rhsTy.getDimSize(
+              conv.getDimensionNumbers().getKernelOutputFeatureDimension()),
+          1);
+      return llvm::SaturatingMultiply(numElements(conv.getType()),
+                                      numElements(rhsTy) / outFeatures);
+    }
+
+    return llvm::SaturatingAdd(numElements(op->getOperandTypes()),
+                               numElements(op->getResultTypes()));
+  }
+};
+
+// Functions whose body only contains tensor-level ops that do not reference
+// any symbol can be optimized in a module of their own.
+bool isSelfContained(func::FuncOp func) {
+  if (func.isExternal())
+    return false;
+  auto *context = func->getContext();
+  Dialect *dialects[] = {
+      context->getLoadedDialect<stablehlo::StablehloDialect>(),
+      context->getLoadedDialect<chlo::ChloDialect>(),
+      context->getLoadedDialect<enzymexla::EnzymeXLADialect>()};
+  return !func.getBody()
+              .walk([&](Operation *op) {
+                if (isa<func::ReturnOp>(op))
+                  return WalkResult::advance();
+                if (!llvm::is_contained(dialects, op->getDialect()))
+                  return WalkResult::interrupt();
+                for (auto attr : op->getAttrs())
+                  if (attr.getValue()
+                          .walk([](SymbolRefAttr) {
+                            return WalkResult::interrupt();
+                          })
+                          .wasInterrupted())
+                    return WalkResult::interrupt();
+                return WalkResult::advance();
+              })
+              .wasInterrupted();
+}
+
+uint64_t getFingerprint(ModuleOp module) {
+  std::string str;
+  llvm::raw_string_ostream os(str);
+  module.print(os);
+  return llvm::xxh3_64bits(os.str());
+}
+
+struct Candidate {
+  OwningOpRef<ModuleOp> module;
+  uint64_t cost;
+};
+
+struct EnzymeHLOScheduleSearchPass
+    : public enzyme::impl::EnzymeHLOScheduleSearchPassBase<
+          EnzymeHLOScheduleSearchPass> {
+  using EnzymeHLOScheduleSearchPassBase::EnzymeHLOScheduleSearchPassBase;
+
+  LogicalResult buildSchedules(
+      SmallVectorImpl<std::unique_ptr<PassManager>> &pipelines) {
+    SmallVector<StringRef> patternLists;
+    if (schedules.getValue().empty()) {
+      patternLists = {kTransposeUpPatterns, kTransposeDownPatterns,
+                      kReshapeUpPatterns, kReshapeDownPatterns};
+    } else {
+      StringRef(schedules.getValue())
+          .split(patternLists, '|', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+    }
+
+    for (auto patterns : patternLists) {
+      auto pm = std::make_unique<PassManager>(&getContext());
+      std::string pipeline =
+          ("enzyme-hlo-generate-td{patterns=" + patterns +
+           "},transform-interpreter,enzyme-hlo-remove-transform,"
+           "canonicalize,cse")
+              .str();
+      if (failed(parsePassPipeline(pipeline, *pm, llvm::errs())))
+        return failure();
+      pipelines.push_back(std::move(pm));
+    }
+    return success();
+  }
+
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    HLOCostModel costModel(module);
+
+    SmallVector<std::unique_ptr<PassManager>> pipelines;
+    if (failed(buildSchedules(pipelines))) {
+      module.emitError() << "failed to parse rewrite schedules";
+      return signalPassFailure();
+    }
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(time_budget_ms);
+    auto budgetExhausted = [&](uint64_t exploredOps) {
+      return exploredOps > max_explored_ops ||
+             (time_budget_ms > 0 &&
+              std::chrono::steady_clock::now() > deadline);
+    };
+
+    uint64_t exploredOps = 0;
+    SmallVector<func::FuncOp> funcs(module.getOps<func::FuncOp>());
+    for (auto func : funcs) {
+      if (!isSelfContained(func))
+        continue;
+
+      OpBuilder builder(&getContext());
+      OwningOpRef<ModuleOp> initial = ModuleOp::create(builder, func.getLoc());
+      initial->push_back(func.clone());
+      uint64_t initialCost = costModel.getCost(*initial);
+
+      llvm::DenseSet<uint64_t> visited;
+      visited.insert(getFingerprint(*initial));
+      OwningOpRef<ModuleOp> best;
+      uint64_t bestCost = initialCost;
+
+      // Each round applies every schedule to every program of the beam.
+      // Results that do not increase the cost of the program they were
+      // derived from stay in the beam, so that a cost-neutral schedule can
+      // enable a later one.
+      SmallVector<Candidate> beam;
+      beam.push_back({std::move(initial), initialCost});
+      for (int64_t round = 0; round < max_rounds && !beam.empty(); round++) {
+        SmallVector<Candidate> next;
+        for (auto &parent : beam) {
+          for (auto &pm : pipelines) {
+            if (budgetExhausted(exploredOps))
+              break;
+
+            OwningOpRef<ModuleOp> candidate = parent.module->clone();
+            if (failed(pm->run(*candidate)))
+              continue;
+            candidate->walk([&](Operation *) { exploredOps++; });
+            if (!visited.insert(getFingerprint(*candidate)).second)
+              continue;
+
+            uint64_t cost = costModel.getCost(*candidate);
+            LLVM_DEBUG(llvm::dbgs()
+                       << "schedule-search: @" << func.getSymName()
+                       << " round " << round << " cost " << cost << " (parent "
+                       << parent.cost << ", best " << bestCost << ")\n");
+            if (cost > parent.cost)
+              continue;
+            if (cost < bestCost) {
+              bestCost = cost;
+              best = candidate->clone();
+            }
+            next.push_back({std::move(candidate), cost});
+          }
+        }
+        llvm::stable_sort(next, [](const Candidate &a, const Candidate &b) {
+          return a.cost < b.cost;
+        });
+        if (next.size() > static_cast<size_t>(beam_width))
+          next.truncate(beam_width);
+        beam = std::move(next);
+      }
+
+      if (!best)
+        continue;
+
+      auto bestFunc = cast<func::FuncOp>(best->getBody()->front());
+      if (bestFunc.getFunctionType() != func.getFunctionType())
+        continue;
+      func.getBody().takeBody(bestFunc.getBody());
+    }
+  }
+};
+
+} // namespace
@@ -7,7 +7,7 @@
 //===----------------------------------------------------------------------===//
 //
 // This file implements a pass to unroll stablehlo.while ops with known number
-// of iterations.
+// of iterations, or to partially unroll them by a fixed factor.
 //
 //===----------------------------------------------------------------------===//
 
@@ -32,6 +32,7 @@
 #include "mlir/Dialect/Tensor/IR/Tensor.h"
 
 #include "src/enzyme_ad/jax/Implementations/WhileLoopInfo.h"
+#include "src/enzyme_ad/jax/Utils.h"
 
 namespace mlir {
 namespace enzyme {
@@ -44,43 +45,154 @@ using namespace mlir;
 using namespace mlir::enzyme;
 using namespace enzyme;
 
+// Marks loops produced by partial unrolling so they are not unrolled again.
+static constexpr StringLiteral kUnrolledAttr = "enzymexla.unrolled";
+
+// Clones the body of a while loop once, with its block arguments bound to
+// `args`, and returns the values it yields.
+static SmallVector<Value> cloneLoopBody(PatternRewriter &rewriter,
+                                        Block *loopBodyBlock, ValueRange args) {
+  IRMapping operandMap;
+  operandMap.map(loopBodyBlock->getArguments(), args);
+
+  for (auto &it : loopBodyBlock->without_terminator()) {
+    rewriter.clone(it, operandMap);
+  }
+
+  SmallVector<Value> results;
+  for (auto r : loopBodyBlock->getTerminator()->getOperands()) {
+    results.push_back(operandMap.lookupOrDefault(r));
+  }
+  return results;
+}
+
 LogicalResult
 WhileUnroll::matchAndRewriteImpl(mlir::stablehlo::WhileOp op,
                                  PatternRewriter &rewriter) const {
+  if (op->hasAttr(kUnrolledAttr))
+    return failure();
 
   WhileLoopInfo info(op);
-  if (info.computeInfo().failed() || !info.isConstant())
+  if (info.computeInfo().failed())
     return failure();
 
-  auto bodyTerm = cast<stablehlo::ReturnOp>(&op.getBody().front().back());
   auto loopBodyBlock = &op.getBody().front();
 
+  if (maxOperationThreshold > -1 &&
+      std::distance(loopBodyBlock->begin(), loopBodyBlock->end()) >
+          maxOperationThreshold) {
+    if (!info.isConstant() || info.getConstantNumIters() > 1)
+      return rewriter.notifyMatchFailure(
+          op, "max operations for unrolling exceeded");
+  }
+
+  if (!info.isConstant()) {
+    if (unrollFactor > 1)
+      return partiallyUnroll(op, info, rewriter);
+    return failure();
+  }
+
   auto iters = info.getConstantNumIters();
-  if (maxNumIterations != -1 && iters > maxNumIterations)
+  // Without an explicit limit, partial unrolling only fully unrolls loops
+  // that fit in a single unrolled body.
+  auto maxFullIterations = maxNumIterations;
+  if (maxFullIterations == -1 && unrollFactor > 1)
+    maxFullIterations = unrollFactor;
+  if (maxFullIterations != -1 && iters > maxFullIterations) {
+    if (unrollFactor > 1)
+      return partiallyUnroll(op, info, rewriter);
     return rewriter.notifyMatchFailure(op,
                                        "max iterations for unrolling exceeded");
-
-  if (iters > 1 && maxOperationThreshold > -1 &&
-      std::distance(loopBodyBlock->begin(), loopBodyBlock->end()) >
-          maxOperationThreshold)
-    return rewriter.notifyMatchFailure(op,
-                                       "max operations for unrolling exceeded");
+  }
 
   SmallVector<Value> results(op.getOperands().begin(), op.getOperands().end());
 
   for (size_t iter = 0; iter < iters; iter++) {
-    IRMapping operandMap;
-    operandMap.map(loopBodyBlock->getArguments(), results);
+    results = cloneLoopBody(rewriter, loopBodyBlock, results);
+  }
+  rewriter.replaceOp(op, results);
+  return success();
+}
 
-    for (auto &it : loopBodyBlock->without_terminator()) {
-      rewriter.clone(it, operandMap);
-    }
+// Rewrites the loop into a loop over `unrollFactor` copies of its body,
+// followed by the iterations that remain. For a constant trip count the
+// remainder is emitted as straight-line copies of the body. Otherwise the
+// unrolled loop stops while a whole group of iterations is still in range,
+// and a copy of the original loop finishes the rest.
+LogicalResult
+WhileUnroll::partiallyUnroll(stablehlo::WhileOp op, WhileLoopInfo &info,
+                             PatternRewriter &rewriter) const {
+  auto step = info.getConstantStep();
+  if (!step || *step <= 0)
+    return rewriter.notifyMatchFailure(op, "requires a positive constant step");
+
+  // The adjusted limit is computed with signed arithmetic.
+  auto cmp = cast<stablehlo::CompareOp>(
+      op.getCond().front().getTerminator()->getOperand(0).getDefiningOp());
+  if (cmp.getCompareType() &&
+      *cmp.getCompareType() != stablehlo::ComparisonType::SIGNED)
+    return rewriter.notifyMatchFailure(op, "requires a signed comparison");
+
+  auto induct = info.getInductionVariable();
+  if (!induct)
+    return failure();
+  auto ivType = info.getStart().getType();
+  auto loc = op.getLoc();
+
+  int64_t remainder = 0;
+  Value newLimit;
+  if (info.isConstant()) {
+    auto iters = info.getConstantNumIters();
+    if (iters < unrollFactor)
+      return rewriter.notifyMatchFailure(op, "fewer iterations than factor");
+    remainder = iters % unrollFactor;
+    int64_t limit = *info.getConstantStart() + (iters - remainder) * *step;
+    newLimit = stablehlo::ConstantOp::create(
+        rewriter, loc, ivType, cast<ElementsAttr>(makeAttr(ivType, limit)));
+  } else {
+    // The limit has to be available before the loop to be adjusted.
+    auto limit = info.getLimit();
+    if (op->isAncestor(limit.getParentBlock()->getParentOp()))
+      return rewriter.notifyMatchFailure(op, "limit is defined in the loop");
+    auto offset = stablehlo::ConstantOp::create(
+        rewriter, loc, ivType,
+        cast<ElementsAttr>(makeAttr(ivType, (unrollFactor - 1) * *step)));
+    newLimit = stablehlo::SubtractOp::create(rewriter, loc, limit, offset);
+  }
 
-    results.clear();
-    for (auto r : bodyTerm->getOperands()) {
-      results.push_back(operandMap.lookupOrDefault(r));
-    }
+  auto unrolled = stablehlo::WhileOp::create(
+      rewriter, loc, op->getResultTypes(), op->getOperands(), op->getAttrs());
+  unrolled->setAttr(kUnrolledAttr, rewriter.getUnitAttr());
+
+  IRMapping condMap;
+  op.getCond().cloneInto(&unrolled.getCond(), condMap);
+  auto condTerm = unrolled.getCond().front().getTerminator();
+  condTerm->getOperand(0).getDefiningOp()->setOperand(1, newLimit);
+
+  auto loopBodyBlock = &op.getBody().front();
+  SmallVector<Location> argLocs;
+  for (auto arg : loopBodyBlock->getArguments())
+    argLocs.push_back(arg.getLoc());
+  Block *body =
+      rewriter.createBlock(&unrolled.getBody(), {},
+                           loopBodyBlock->getArgumentTypes(), argLocs);
+  SmallVector<Value> results(body->getArguments());
+  for (int64_t i = 0; i < unrollFactor; i++)
+    results = cloneLoopBody(rewriter, loopBodyBlock, results);
+  stablehlo::ReturnOp::create(rewriter, loc, results);
+
+  rewriter.setInsertionPointAfter(unrolled);
+  results.assign(unrolled->result_begin(), unrolled->result_end());
+  if (info.isConstant()) {
+    for (int64_t i = 0; i < remainder; i++)
+      results = cloneLoopBody(rewriter, loopBodyBlock, results);
+  } else {
+    auto tail = cast<stablehlo::WhileOp>(rewriter.clone(*op));
+    tail->setOperands(results);
+    tail->setAttr(kUnrolledAttr, rewriter.getUnitAttr());
+    results.assign(tail->result_begin(), tail->result_end());
   }
+
   rewriter.replaceOp(op, results);
   return success();
 }
@@ -92,7 +204,8 @@ struct EnzymeHLOUnrollPass
   void runOnOperation() override {
     auto context = getOperation()->getContext();
     RewritePatternSet patterns(context);
-    patterns.add<WhileUnroll>(maxNumIterations, maxOperationThreshold, context);
+    patterns.add<WhileUnroll>(maxNumIterations, maxOperationThreshold,
+                              unrollFactor, context);
     GreedyRewriteConfig config;
     if (failed(applyPatternsAndFoldGreedily(getOperation(), std::move(patterns),
                                             config))) {
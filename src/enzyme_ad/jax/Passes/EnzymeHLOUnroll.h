@@ -2,6 +2,7 @@
 
 #include "mlir/IR/PatternMatch.h"
 #include "src/enzyme_ad/jax/CheckedRewrite.h"
+#include "src/enzyme_ad/jax/Implementations/WhileLoopInfo.h"
 #ifdef __clang__
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wmissing-braces"
@@ -26,13 +27,22 @@ struct WhileUnroll
 
   int64_t maxNumIterations = -1;
   int64_t maxOperationThreshold = -1;
+  // When greater than one, loops that are not fully unrolled are rewritten
+  // into a loop over this many copies of the body plus a remainder.
+  int64_t unrollFactor = 1;
 
   WhileUnroll(int64_t maxNumIterations, int64_t maxOperationThreshold,
-              MLIRContext *ctx, PatternBenefit benefit = 1)
+              int64_t unrollFactor, MLIRContext *ctx,
+              PatternBenefit benefit = 1)
       : CheckedOpRewritePattern<stablehlo::WhileOp, WhileUnroll>(ctx, benefit),
         maxNumIterations(maxNumIterations),
-        maxOperationThreshold(maxOperationThreshold) {}
+        maxOperationThreshold(maxOperationThreshold),
+        unrollFactor(unrollFactor) {}
 
   LogicalResult matchAndRewriteImpl(stablehlo::WhileOp op,
                                     PatternRewriter &rewriter) const;
+
+private:
+  LogicalResult partiallyUnroll(stablehlo::WhileOp op, WhileLoopInfo &info,
+                                PatternRewriter &rewriter) const;
 };
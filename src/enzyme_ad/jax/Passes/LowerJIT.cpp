@@ -1088,12 +1088,11 @@ struct LowerJITPass
                 ? rewriter.getStringAttr("enzymexla_compile_cpu_with_error")
                 : rewriter.getStringAttr("enzymexla_compile_cpu"),
             /* has_side_effect*/ hasSideEffectAttr,
-            /*backend_config*/ backendstr,
+            /*backend_config*/ dattr,
             /* api_version*/
             CustomCallApiVersionAttr::get(
                 rewriter.getContext(),
-                mlir::stablehlo::CustomCallApiVersion::
-                    API_VERSION_STATUS_RETURNING_UNIFIED),
+                mlir::stablehlo::CustomCallApiVersion::API_VERSION_TYPED_FFI),
             /*calledcomputations*/ nullptr, operand_layouts, result_layouts,
             output_operand_aliases);
 
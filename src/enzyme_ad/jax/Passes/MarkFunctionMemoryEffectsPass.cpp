@@ -6,6 +6,7 @@
 #include "mlir/Interfaces/FunctionInterfaces.h"
 #include "mlir/Pass/Pass.h"
 #include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/SCCIterator.h"
 
 #include "mlir/Dialect/LLVMIR/LLVMDialect.h"
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
@@ -29,34 +30,11 @@ using namespace mlir::enzymexla;
 
 namespace {
 
-enum class VisitState { NotVisited, Visiting, Visited };
-
 struct MarkFunctionMemoryEffectsPass
     : public enzyme::impl::MarkFunctionMemoryEffectsPassBase<
           MarkFunctionMemoryEffectsPass> {
   using Base::Base;
 
-  DenseMap<CallGraphNode *, VisitState> visitState;
-  SmallVector<CallGraphNode *> topoOrder;
-
-  bool dfs(CallGraphNode *node) {
-    auto it = visitState.find(node);
-    if (it != visitState.end()) {
-      if (it->second == VisitState::Visiting)
-        return true; // cycle detected
-      return false;
-    }
-    visitState[node] = VisitState::Visiting;
-    for (auto &edge : *node) {
-      CallGraphNode *target = edge.getTarget();
-      if (dfs(target))
-        return true;
-    }
-    visitState[node] = VisitState::Visited;
-    topoOrder.push_back(node);
-    return false;
-  }
-
   void
   insertMemoryEffects(BitVector &effects,
                       SmallVector<MemoryEffects::EffectInstance> memEffects) {
@@ -280,167 +258,158 @@ struct MarkFunctionMemoryEffectsPass
     return SymbolRefAttr::get(ctx, symbolPath[0], nestedRefs);
   }
 
-  void runOnOperation() override {
-    ModuleOp module = getOperation();
-    auto *ctx = module->getContext();
-    OpBuilder builder(ctx);
-
-    DenseMap<SymbolRefAttr, BitVector> funcEffects;
-    DenseMap<SymbolRefAttr, SmallVector<BitVector>> funcArgEffects;
-    DenseMap<SymbolRefAttr, FunctionOpInterface> symbolToFunc;
-
-    CallGraph callGraph(module);
-
-    bool hasCycle = false;
-    for (CallGraphNode *node : callGraph) {
-      if (!visitState.count(node))
-        hasCycle |= dfs(node);
-    }
-
-    // First pass: collect direct effects
-    for (CallGraphNode *node : topoOrder) {
-      if (node->isExternal())
-        continue;
-
-      Region *region = node->getCallableRegion();
-      if (!region)
-        return signalPassFailure();
-
-      Operation *parentOp = region->getParentOp();
-      auto funcOp = dyn_cast<FunctionOpInterface>(parentOp);
-      if (!funcOp)
-        return signalPassFailure();
-
-      BitVector effects(4, 0);
-      SmallVector<BitVector> argEffects;
-      argEffects.reserve(funcOp.getNumArguments());
-      for (unsigned i = 0; i < funcOp.getNumArguments(); i++) {
-        argEffects.push_back(BitVector(4, 0));
+  void collectDirectEffects(FunctionOpInterface funcOp, BitVector &effects) {
+    funcOp.walk([&](Operation *op) {
+      if (op->hasTrait<OpTrait::HasRecursiveMemoryEffects>()) {
+        return WalkResult::advance();
       }
 
-      funcOp.walk([&](Operation *op) {
-        if (op->hasTrait<OpTrait::HasRecursiveMemoryEffects>()) {
+      if (op == funcOp)
+        return WalkResult::advance();
+
+      if (auto jitcall = dyn_cast<enzymexla::JITCallOp>(op)) {
+        if (jitcall.getXlaSideEffectFreeAttr()) {
           return WalkResult::advance();
+        } else if (!assume_no_memory_effects) {
+          insertMemoryEffects(effects);
         }
-
-        if (op == funcOp)
+      } else if (auto kcall = dyn_cast<enzymexla::KernelCallOp>(op)) {
+        if (kcall.getXlaSideEffectFreeAttr()) {
           return WalkResult::advance();
-
-        if (auto jitcall = dyn_cast<enzymexla::JITCallOp>(op)) {
-          if (jitcall.getXlaSideEffectFreeAttr()) {
-            return WalkResult::advance();
-          } else if (!assume_no_memory_effects) {
-            insertMemoryEffects(effects);
-          }
-        } else if (auto kcall = dyn_cast<enzymexla::KernelCallOp>(op)) {
-          if (kcall.getXlaSideEffectFreeAttr()) {
-            return WalkResult::advance();
-          } else {
-            insertMemoryEffects(effects);
-          }
-        } else if (auto tcall = dyn_cast<triton_ext::TritonCallOp>(op)) {
-          if (tcall.getXlaSideEffectFreeAttr()) {
-            return WalkResult::advance();
-          } else {
-            insertMemoryEffects(effects);
-          }
-        } else if (auto ccall = dyn_cast<stablehlo::CustomCallOp>(op)) {
-          if (!ccall.getHasSideEffect()) {
-            return WalkResult::advance();
-          } else {
-            insertMemoryEffects(effects);
-          }
-        } else if (auto memOp = dyn_cast<MemoryEffectOpInterface>(op)) {
-          SmallVector<MemoryEffects::EffectInstance> memEffects;
-          memOp.getEffects(memEffects);
-          insertMemoryEffects(effects, memEffects);
-        } else if (!assume_no_memory_effects) { // Operation doesn't define
-                                                // memory effects
+        } else {
           insertMemoryEffects(effects);
         }
+      } else if (auto tcall = dyn_cast<triton_ext::TritonCallOp>(op)) {
+        if (tcall.getXlaSideEffectFreeAttr()) {
+          return WalkResult::advance();
+        } else {
+          insertMemoryEffects(effects);
+        }
+      } else if (auto ccall = dyn_cast<stablehlo::CustomCallOp>(op)) {
+        if (!ccall.getHasSideEffect()) {
+          return WalkResult::advance();
+        } else {
+          insertMemoryEffects(effects);
+        }
+      } else if (auto memOp = dyn_cast<MemoryEffectOpInterface>(op)) {
+        SmallVector<MemoryEffects::EffectInstance> memEffects;
+        memOp.getEffects(memEffects);
+        insertMemoryEffects(effects, memEffects);
+      } else if (!assume_no_memory_effects) { // Operation doesn't define
+                                              // memory effects
+        insertMemoryEffects(effects);
+      }
 
-        return WalkResult::advance();
-      });
-
-      auto symRef = getFullReference(funcOp);
-      funcEffects[symRef] = std::move(effects);
-      funcArgEffects[symRef] = std::move(argEffects);
-      symbolToFunc[symRef] = funcOp;
-    }
+      return WalkResult::advance();
+    });
+  }
 
-    auto propagate = [&](FunctionOpInterface funcOp, BitVector &effects) {
-      funcOp.walk([&](Operation *op) {
-        if (auto callOp = dyn_cast<CallOpInterface>(op)) {
-          if (auto calleeAttr = callOp.getCallableForCallee()) {
-            if (auto symRef = dyn_cast<SymbolRefAttr>(calleeAttr)) {
-
-              auto funcEffectsSymRef = funcEffects.lookup(symRef);
-              for (int i = 0; i < funcEffectsSymRef.size(); i++) {
-                if (funcEffectsSymRef[i])
-                  effects.set(i);
-              }
+  void propagate(FunctionOpInterface funcOp, BitVector &effects,
+                 DenseMap<SymbolRefAttr, BitVector> &funcEffects) {
+    funcOp.walk([&](Operation *op) {
+      if (auto callOp = dyn_cast<CallOpInterface>(op)) {
+        if (auto calleeAttr = callOp.getCallableForCallee()) {
+          if (auto symRef = dyn_cast<SymbolRefAttr>(calleeAttr)) {
+
+            auto funcEffectsSymRef = funcEffects.lookup(symRef);
+            for (int i = 0; i < funcEffectsSymRef.size(); i++) {
+              if (funcEffectsSymRef[i])
+                effects.set(i);
             }
           }
         }
-      });
-    };
-
-    if (hasCycle) {
-      // Cycles: fixpoint iterate
-      bool changed = true;
-      int32_t iteration = 0;
-      while (changed && iteration < max_iterations) {
-        changed = false;
-        iteration++;
-
-        for (CallGraphNode *node : llvm::reverse(topoOrder)) {
-          if (node->isExternal())
-            continue;
-
-          Region *region = node->getCallableRegion();
-          if (!region)
-            continue;
-
-          Operation *parentOp = region->getParentOp();
-          auto funcOp = dyn_cast<FunctionOpInterface>(parentOp);
-          if (!funcOp)
-            continue;
-
-          auto symRef = getFullReference(funcOp);
-          analyzeFunctionArgumentMemoryEffects(funcOp, funcArgEffects[symRef],
-                                               funcArgEffects);
-          auto &effects = funcEffects[symRef];
-          size_t before = getNumEffects(effects);
-          propagate(funcOp, effects);
-          changed = getNumEffects(effects) != before;
-        }
       }
+    });
+  }
 
-      // At this point if we haven't converged, we assume effects for all
-      if (changed) {
-        for (auto &[symbol, effects] : funcEffects)
-          insertMemoryEffects(effects);
+  void analyzeSCC(
+      ArrayRef<std::pair<const CallGraphNode *, FunctionOpInterface>> scc,
+      bool hasCycle, DenseMap<SymbolRefAttr, BitVector> &funcEffects,
+      DenseMap<SymbolRefAttr, SmallVector<BitVector>> &funcArgEffects) {
+    // First pass: collect direct effects
+    for (auto [node, funcOp] : scc) {
+      BitVector effects(4, 0);
+      collectDirectEffects(funcOp, effects);
+      auto symRef = getFullReference(funcOp);
+      funcEffects[symRef] = std::move(effects);
+      funcArgEffects[symRef] =
+          SmallVector<BitVector>(funcOp.getNumArguments(), BitVector(4, 0));
+    }
+
+    if (!hasCycle) {
+      auto funcOp = scc.front().second;
+      auto symRef = getFullReference(funcOp);
+      analyzeFunctionArgumentMemoryEffects(funcOp, funcArgEffects[symRef],
+                                           funcArgEffects);
+      propagate(funcOp, funcEffects[symRef], funcEffects);
+      return;
+    }
+
+    // Cycles: fixpoint iterate
+    bool changed = true;
+    int32_t iteration = 0;
+    while (changed && iteration < max_iterations) {
+      changed = false;
+      iteration++;
+
+      for (auto [node, funcOp] : scc) {
+        auto symRef = getFullReference(funcOp);
+        auto &argEffects = funcArgEffects[symRef];
+        auto &effects = funcEffects[symRef];
+        auto countEffects = [&]() {
+          size_t count = getNumEffects(effects);
+          for (auto &argEffect : argEffects)
+            count += getNumEffects(argEffect);
+          return count;
+        };
+        size_t before = countEffects();
+        analyzeFunctionArgumentMemoryEffects(funcOp, argEffects,
+                                             funcArgEffects);
+        propagate(funcOp, effects, funcEffects);
+        changed |= countEffects() != before;
       }
-    } else {
-      for (CallGraphNode *node : topoOrder) {
-        if (node->isExternal())
-          continue;
+    }
+
+    // At this point if we haven't converged, we assume effects for all
+    if (changed) {
+      for (auto [node, funcOp] : scc)
+        insertMemoryEffects(funcEffects[getFullReference(funcOp)]);
+    }
+  }
+
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    auto *ctx = module->getContext();
+    OpBuilder builder(ctx);
+
+    DenseMap<SymbolRefAttr, BitVector> funcEffects;
+    DenseMap<SymbolRefAttr, SmallVector<BitVector>> funcArgEffects;
+    DenseMap<SymbolRefAttr, FunctionOpInterface> symbolToFunc;
+
+    CallGraph callGraph(module);
 
-        Region *region = node->getCallableRegion();
-        if (!region)
+    // Visit the SCCs of the call graph bottom-up, so the summaries of the
+    // callees outside of an SCC are final when it is analyzed.
+    for (auto sccIt = llvm::scc_begin<const CallGraph *>(&callGraph);
+         !sccIt.isAtEnd(); ++sccIt) {
+      SmallVector<std::pair<const CallGraphNode *, FunctionOpInterface>> scc;
+      for (const CallGraphNode *node : *sccIt) {
+        if (node->isExternal())
           continue;
 
-        Operation *parentOp = region->getParentOp();
+        Operation *parentOp = node->getCallableRegion()->getParentOp();
         auto funcOp = dyn_cast<FunctionOpInterface>(parentOp);
         if (!funcOp)
-          continue;
-
-        auto symRef = getFullReference(funcOp);
-        analyzeFunctionArgumentMemoryEffects(funcOp, funcArgEffects[symRef],
-                                             funcArgEffects);
-        auto &effects = funcEffects[symRef];
-        propagate(funcOp, effects);
+          return signalPassFailure();
+        scc.emplace_back(node, funcOp);
       }
+      if (scc.empty())
+        continue;
+
+      analyzeSCC(scc, sccIt.hasCycle(), funcEffects, funcArgEffects);
+
+      for (auto [node, funcOp] : scc)
+        symbolToFunc[getFullReference(funcOp)] = funcOp;
     }
 
     // Finally, attach attributes
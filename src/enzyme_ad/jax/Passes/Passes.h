@@ -42,6 +42,11 @@ void populateLibDeviceFuncsToOpsPatterns(MLIRContext *context,
 
 void addSingleIter(mlir::RewritePatternSet &patterns, mlir::MLIRContext *ctx);
 
+// Splits the aggregate llvm.alloca/memref.alloca slots nested in `op` into
+// their fields and promotes the resulting slots to SSA values. Returns true if
+// anything changed.
+bool destructureAndPromoteMemorySlots(Operation *op);
+
 mlir::AffineExpr recreateExpr(mlir::AffineExpr expr);
 mlir::AffineMap recreateExpr(mlir::AffineMap expr);
 mlir::IntegerSet recreateExpr(mlir::IntegerSet expr);
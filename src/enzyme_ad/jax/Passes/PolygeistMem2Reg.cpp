@@ -22,8 +22,11 @@
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
 #include "mlir/IR/Dominance.h"
+#include "mlir/Interfaces/DataLayoutInterfaces.h"
 #include "mlir/Support/LLVM.h"
+#include "mlir/Transforms/Mem2Reg.h"
 #include "mlir/Transforms/Passes.h"
+#include "mlir/Transforms/SROA.h"
 #include "src/enzyme_ad/jax/Dialect/Ops.h"
 #include "src/enzyme_ad/jax/Passes/Passes.h"
 #include "src/enzyme_ad/jax/Utils.h"
@@ -1944,6 +1947,37 @@ std::vector<std::vector<Offset>> getLastStored(mlir::Value AI) {
   return todo;
 }
 
+bool mlir::enzyme::destructureAndPromoteMemorySlots(Operation *op) {
+  DataLayout dataLayout = DataLayout::closest(op);
+  DominanceInfo dominance(op);
+  bool changed = false;
+  for (Region &region : op->getRegions()) {
+    if (region.empty())
+      continue;
+    OpBuilder builder(&region.front(), region.front().begin());
+
+    // Split struct and array slots whose fields are only accessed through
+    // constant-index GEPs/subviews, so that each field can be promoted
+    // separately.
+    SmallVector<DestructurableAllocationOpInterface> destructurable;
+    region.walk([&](DestructurableAllocationOpInterface allocator) {
+      if (isa<LLVM::AllocaOp, memref::AllocaOp>(allocator))
+        destructurable.push_back(allocator);
+    });
+    changed |= succeeded(
+        tryToDestructureMemorySlots(destructurable, builder, dataLayout));
+
+    SmallVector<PromotableAllocationOpInterface> promotable;
+    region.walk([&](PromotableAllocationOpInterface allocator) {
+      if (isa<LLVM::AllocaOp, memref::AllocaOp>(allocator))
+        promotable.push_back(allocator);
+    });
+    changed |= succeeded(
+        tryToPromoteMemorySlots(promotable, builder, dataLayout, dominance));
+  }
+  return changed;
+}
+
 void PolygeistMem2Reg::runOnOperation() {
   auto *f = getOperation();
 
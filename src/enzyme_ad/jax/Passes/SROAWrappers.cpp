@@ -18,12 +18,16 @@
 #include "mlir/Dialect/Math/IR/Math.h"
 #include "mlir/IR/IRMapping.h"
 #include "mlir/IR/SymbolTable.h"
+#include "mlir/IR/Threading.h"
 #include "mlir/Pass/PassManager.h"
 #include "mlir/Target/LLVMIR/Export.h"
 #include "mlir/Target/LLVMIR/ModuleImport.h"
 
+#include "llvm/ADT/StringSet.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Transforms/IPO/Attributor.h"
 #include "llvm/Transforms/InstCombine/InstCombine.h"
 #include "llvm/Transforms/Scalar/InstSimplifyPass.h"
@@ -56,57 +60,227 @@ struct SROAWrappersPass
     : public mlir::enzyme::impl::SROAWrappersPassBase<SROAWrappersPass> {
   using SROAWrappersPassBase::SROAWrappersPassBase;
 
+  // A subset of the module translated to LLVM IR and optimized on its own.
+  // Partition 0 owns every top-level LLVM op except the function definitions
+  // assigned to other partitions, which only see declarations of everything
+  // they do not define.
+  struct Partition {
+    mlir::OwningOpRef<mlir::ModuleOp> toTranslate;
+    llvm::SmallVector<mlir::Operation *> toOpt;
+    mlir::OwningOpRef<mlir::ModuleOp> translated;
+    // The requested LLVM IR dumps, printed in partition order once all
+    // partitions are optimized.
+    std::string dumps;
+  };
+
+  // Function definitions are split into contiguous chunks of this size, so
+  // that neither the output nor the dumps depend on the number of threads.
+  static constexpr size_t kFunctionsPerPartition = 16;
+
+  // Top-level ops end up private unless they are definitions which should
+  // keep their visibility.
+  void setVisibility(mlir::Operation &op) {
+    if (auto func = llvm::dyn_cast<mlir::LLVM::LLVMFuncOp>(op)) {
+      if (set_private || func.getBody().empty() ||
+          func.getLinkage() == mlir::LLVM::Linkage::Internal) {
+        func.setVisibility(mlir::SymbolTable::Visibility::Private);
+      }
+    } else if (auto glob = llvm::dyn_cast<mlir::LLVM::GlobalOp>(op)) {
+      glob.setVisibility(mlir::SymbolTable::Visibility::Private);
+    }
+  }
+
   void runOnOperation() override {
     mlir::ModuleOp m = getOperation();
 
-    mlir::OpBuilder b(m);
+    // The attributor works on the whole call graph and instcombine may create
+    // new globals (e.g. when simplifying library calls), so only the purely
+    // function local optimizations can run on independent partitions.
+    bool functionLocal = !attributor && !instcombine;
 
-    auto mToTranslate = b.cloneWithoutRegions(m);
+    llvm::SmallVector<mlir::LLVM::LLVMFuncOp> definitions;
+    for (auto func : m.getBody()->getOps<mlir::LLVM::LLVMFuncOp>())
+      if (!func.getBody().empty())
+        definitions.push_back(func);
 
-    llvm::SmallVector<mlir::Operation *> toOpt;
-    for (auto [oldRegion, newRegion] :
-         llvm::zip(m->getRegions(), mToTranslate->getRegions())) {
-      for (auto &oldBlock : oldRegion.getBlocks()) {
-        assert(oldBlock.getNumArguments() == 0);
-        b.createBlock(&newRegion, newRegion.end());
-        for (auto &op : oldBlock) {
-          // Working around bug in upstream llvm which was fixed in 800593a0
-          if (llvm::isa<mlir::LLVM::ModuleFlagsOp>(op))
+    // Functions whose allocas are all promoted by the MLIR SROA and mem2reg
+    // do not need to round trip through LLVM IR at all.
+    llvm::SmallVector<mlir::LLVM::LLVMFuncOp> promoted;
+    if (native && sroa && functionLocal) {
+      mlir::parallelForEach(&getContext(), definitions,
+                            [](mlir::LLVM::LLVMFuncOp func) {
+                              destructureAndPromoteMemorySlots(func);
+                            });
+      llvm::erase_if(definitions, [&](mlir::LLVM::LLVMFuncOp func) {
+        bool hasAlloca = func.walk([](mlir::LLVM::AllocaOp) {
+                               return mlir::WalkResult::interrupt();
+                             }).wasInterrupted();
+        if (!hasAlloca)
+          promoted.push_back(func);
+        return !hasAlloca;
+      });
+      LLVM_DEBUG(llvm::dbgs() << "promoted " << promoted.size()
+                              << " functions natively, " << definitions.size()
+                              << " left for LLVM\n");
+      if (definitions.empty()) {
+        for (auto &op : *m.getBody())
+          if (llvm::isa<mlir::LLVM::LLVMDialect>(op.getDialect()))
+            setVisibility(op);
+        return;
+      }
+    }
+
+    size_t chunkSize = std::max<size_t>(1, definitions.size());
+    if (functionLocal && getContext().isMultithreadingEnabled())
+      chunkSize = kFunctionsPerPartition;
+    size_t numPartitions =
+        std::max<size_t>(1, llvm::divideCeil(definitions.size(), chunkSize));
+
+    // Functions which were already promoted natively are owned by no
+    // partition, so they are only declared in the translated modules. As the
+    // chunks are contiguous and merged in order, definitions keep their
+    // original order.
+    llvm::DenseMap<mlir::Operation *, size_t> partitionOf;
+    llvm::DenseSet<mlir::StringAttr> definedElsewhere;
+    for (auto [i, func] : llvm::enumerate(definitions)) {
+      partitionOf[func] = i / chunkSize;
+      if (i / chunkSize != 0)
+        definedElsewhere.insert(func.getSymNameAttr());
+    }
+    for (auto func : promoted) {
+      partitionOf[func] = numPartitions;
+      definedElsewhere.insert(func.getSymNameAttr());
+      setVisibility(*func.getOperation());
+    }
+
+    llvm::SmallVector<Partition> partitions(numPartitions);
+    for (auto [i, partition] : llvm::enumerate(partitions))
+      if (failed(clonePartition(m, i, partitionOf, partition))) {
+        signalPassFailure();
+        return;
+      }
+
+    auto optimized = mlir::failableParallelForEach(
+        &getContext(), partitions,
+        [&](Partition &partition) { return optimizePartition(partition); });
+    for (auto &partition : partitions)
+      llvm::errs() << partition.dumps;
+    if (failed(optimized)) {
+      signalPassFailure();
+      return;
+    }
+
+    for (auto &partition : partitions)
+      for (auto op : partition.toOpt)
+        op->erase();
+
+    mlir::OpBuilder b(m);
+    llvm::StringSet<> symbols;
+    for (auto [i, partition] : llvm::enumerate(partitions)) {
+      mlir::ModuleOp newM = *partition.translated;
+      if (i == 1)
+        for (auto &op : *m.getBody())
+          if (auto sym = llvm::dyn_cast<mlir::SymbolOpInterface>(op))
+            symbols.insert(sym.getName());
+
+      b.setInsertionPointToEnd(m.getBody());
+      for (auto &op : *newM.getBody()) {
+        // Working around bug in upstream llvm which was fixed in 800593a0
+        if (llvm::isa<mlir::LLVM::ModuleFlagsOp>(op))
+          continue;
+        auto func = llvm::dyn_cast<mlir::LLVM::LLVMFuncOp>(op);
+        if (i == 0) {
+          if (func && definedElsewhere.contains(func.getSymNameAttr()))
             continue;
-          // FIXME in reality, this check should be whether the entirety
-          // (all nested ops with all (transitively) used symbol as well) of
-          // the op is translatable to llvm ir.
-          // FIXME we also need to mark them `used` so the llvm optimizer
-          // does not get rid of them.
-          if (llvm::isa<mlir::LLVM::LLVMDialect>(op.getDialect())) {
-            // There should be no need for mapping because all top level
-            // operations in the module should be isolated from above
+          if (llvm::isa<mlir::LLVM::ComdatOp>(op)) {
             b.clone(op);
-            toOpt.push_back(&op);
+            continue;
           }
+        } else if (!func || (func.getBody().empty() &&
+                             !symbols.insert(func.getSymName()).second)) {
+          // Everything but the definitions of this partition and new
+          // declarations (e.g. of intrinsics) is owned by partition 0.
+          continue;
+        }
+        assert(op.hasTrait<mlir::OpTrait::IsIsolatedFromAbove>() ||
+               op.getNumRegions() == 0);
+        assert(llvm::isa<mlir::LLVM::LLVMDialect>(op.getDialect()));
+        setVisibility(op);
+        // There should be no need for mapping because all top level
+        // operations in the module should be isolated from above
+        b.clone(op);
+      }
+    }
+  }
+
+  // Clones the top-level LLVM ops of `m` which partition `idx` needs and
+  // converts the remaining non-LLVM ops in their bodies to the LLVM dialect.
+  mlir::LogicalResult
+  clonePartition(mlir::ModuleOp m, size_t idx,
+                 const llvm::DenseMap<mlir::Operation *, size_t> &partitionOf,
+                 Partition &partition) {
+    mlir::OpBuilder b(&getContext());
+    partition.toTranslate = b.cloneWithoutRegions(m);
+    mlir::ModuleOp mToTranslate = *partition.toTranslate;
+
+    b.createBlock(&mToTranslate.getBodyRegion());
+    for (auto &op : *m.getBody()) {
+      // Working around bug in upstream llvm which was fixed in 800593a0
+      if (llvm::isa<mlir::LLVM::ModuleFlagsOp>(op))
+        continue;
+      // FIXME in reality, this check should be whether the entirety
+      // (all nested ops with all (transitively) used symbol as well) of
+      // the op is translatable to llvm ir.
+      // FIXME we also need to mark them `used` so the llvm optimizer
+      // does not get rid of them.
+      if (!llvm::isa<mlir::LLVM::LLVMDialect>(op.getDialect()))
+        continue;
+
+      auto it = partitionOf.find(&op);
+      size_t owner = it == partitionOf.end() ? 0 : it->second;
+      if (owner == idx) {
+        // There should be no need for mapping because all top level
+        // operations in the module should be isolated from above
+        b.clone(op);
+        partition.toOpt.push_back(&op);
+        continue;
+      }
+
+      if (auto func = llvm::dyn_cast<mlir::LLVM::LLVMFuncOp>(op)) {
+        if (!func.getBody().empty()) {
+          // Only declare functions defined by other partitions. Declarations
+          // cannot have local linkage nor be part of a comdat.
+          auto decl = b.cloneWithoutRegions(func);
+          decl.setLinkage(mlir::LLVM::Linkage::External);
+          decl.removeComdatAttr();
+          continue;
         }
       }
+      // Globals and declarations are owned by partition 0, but other
+      // partitions may reference them.
+      b.clone(op);
     }
 
-    mlir::PassManager pm(mToTranslate.getContext());
+    mlir::PassManager pm(&getContext());
     pm.addPass(mlir::createConvertMathToLLVMPass());
     pm.addPass(mlir::createArithToLLVMConversionPass());
     pm.addPass(mlir::createConvertNVVMToLLVMPass());
-    auto subres = pm.run(mToTranslate);
-    if (!subres.succeeded()) {
-      signalPassFailure();
-      return;
-    }
+    return pm.run(mToTranslate);
+  }
 
+  // Round trips a partition through LLVM IR, running the requested LLVM
+  // optimizations in between. Only touches the ops of `partition`, so
+  // partitions can be optimized concurrently.
+  mlir::LogicalResult optimizePartition(Partition &partition) {
     llvm::LLVMContext llvmCtx;
-    auto llvmModule = mlir::translateModuleToLLVMIR(mToTranslate, llvmCtx);
-    if (!llvmModule) {
-      signalPassFailure();
-      return;
-    }
+    auto llvmModule =
+        mlir::translateModuleToLLVMIR(*partition.toTranslate, llvmCtx);
+    if (!llvmModule)
+      return mlir::failure();
 
+    llvm::raw_string_ostream dumps(partition.dumps);
     if (dump_prellvm)
-      llvm::errs() << "sroa pre llvm\n" << *llvmModule << "\n";
+      dumps << "sroa pre llvm\n" << *llvmModule << "\n";
     {
       using namespace llvm;
       PipelineTuningOptions PTO;
@@ -146,49 +320,14 @@ struct SROAWrappersPass
       MPM.run(*llvmModule, MAM);
     }
     if (dump_postllvm)
-      llvm::errs() << "sroa post_llvm\n" << *llvmModule << "\n";
-    auto translatedFromLLVMIR = mlir::translateLLVMIRToModule(
-        std::move(llvmModule), m->getContext(), /*emitExpensiveWarnings*/ true,
+      dumps << "sroa post_llvm\n" << *llvmModule << "\n";
+    partition.translated = mlir::translateLLVMIRToModule(
+        std::move(llvmModule), &getContext(), /*emitExpensiveWarnings*/ true,
         /*dropDICompositeTypeElements*/ false, /*loadAllDialects*/ false);
-
-    b.setInsertionPoint(m);
-    mlir::ModuleOp newM = *translatedFromLLVMIR;
-
-    for (auto op : toOpt) {
-      op->erase();
-    }
-    for (auto [oldRegion, newRegion] :
-         llvm::zip(m->getRegions(), newM->getRegions())) {
-      for (auto [oldBlock, newBlock] :
-           llvm::zip(oldRegion.getBlocks(), newRegion.getBlocks())) {
-        b.setInsertionPointToEnd(&oldBlock);
-        for (auto &op : newBlock) {
-          // Working around bug in upstream llvm which was fixed in 800593a0
-          if (llvm::isa<mlir::LLVM::ModuleFlagsOp>(op))
-            continue;
-          if (llvm::isa<mlir::LLVM::ComdatOp>(op)) {
-            b.clone(op);
-            continue;
-          }
-          assert(op.hasTrait<mlir::OpTrait::IsIsolatedFromAbove>() ||
-                 op.getNumRegions() == 0);
-          assert(llvm::isa<mlir::LLVM::LLVMDialect>(op.getDialect()));
-          if (auto func = llvm::dyn_cast<mlir::LLVM::LLVMFuncOp>(op)) {
-            if (set_private || func.getBody().empty() ||
-                func.getLinkage() == mlir::LLVM::Linkage::Internal) {
-              func.setVisibility(mlir::SymbolTable::Visibility::Private);
-            }
-          } else if (auto glob = llvm::dyn_cast<mlir::LLVM::GlobalOp>(op)) {
-            glob.setVisibility(mlir::SymbolTable::Visibility::Private);
-          }
-          // There should be no need for mapping because all top level
-          // operations in the module should be isolated from above
-          b.clone(op);
-        }
-      }
-    }
-
-    mToTranslate->erase();
+    partition.toTranslate = nullptr;
+    if (!partition.translated)
+      return mlir::failure();
+    return mlir::success();
   }
 };
 
@@ -163,6 +163,20 @@ void ApplyIotaLICMPatterns::populatePatterns(RewritePatternSet &patterns) {
   addIotaLICM(patterns, getParameter(), *getContext(),
               PatternBenefit(getBenefit().value_or(1)));
 }
+void ApplyRegionLICMPatterns::populatePatterns(RewritePatternSet &patterns) {
+  addRegionLICM(patterns, getParameter(), *getContext(),
+                PatternBenefit(getBenefit().value_or(1)));
+}
+void ApplyWhileScanToReduceWindowPatterns::populatePatterns(
+    RewritePatternSet &patterns) {
+  addWhileScanToReduceWindow(patterns, getParameter(), *getContext(),
+                             PatternBenefit(getBenefit().value_or(1)));
+}
+void ApplyWhileBoundaryPeelPatterns::populatePatterns(
+    RewritePatternSet &patterns) {
+  addWhileBoundaryPeel(patterns, getParameter(), *getContext(),
+                       PatternBenefit(getBenefit().value_or(1)));
+}
 void ApplyIotaSimplifyPatterns::populatePatterns(RewritePatternSet &patterns) {
   addIotaSimplify(patterns, getParameter(), *getContext(),
                   PatternBenefit(getBenefit().value_or(1)));
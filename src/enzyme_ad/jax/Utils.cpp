@@ -1912,6 +1912,169 @@ std::optional<PaddedTensor> detectPaddedTensor(DenseElementsAttr attr) {
   return std::nullopt;
 }
 
+StructuredConstant StructuredConstant::getSplat(RankedTensorType type,
+                                                TypedAttr value) {
+  StructuredConstant result;
+  result.kind = Kind::Splat;
+  result.type = type;
+  result.value = value;
+  return result;
+}
+
+std::optional<StructuredConstant>
+StructuredConstant::broadcastInDim(ArrayRef<int64_t> dims,
+                                   RankedTensorType resultType) const {
+  switch (kind) {
+  case Kind::Splat:
+    return getSplat(resultType, value);
+  case Kind::Iota: {
+    StructuredConstant result = *this;
+    result.type = resultType;
+    result.iota.dimension = dims[iota.dimension];
+    result.iota.tensorType = resultType;
+    return result;
+  }
+  case Kind::Padded: {
+    StructuredConstant result = *this;
+    result.type = resultType;
+    result.lowPadding.assign(resultType.getRank(), 0);
+    result.highPadding.assign(resultType.getRank(), 0);
+    result.interiorPadding.assign(resultType.getRank(), 0);
+    for (auto [i, dim] : llvm::enumerate(dims)) {
+      // An expanded size-1 dimension cannot carry any padding.
+      if (type.getDimSize(i) != resultType.getDimSize(dim)) {
+        if (lowPadding[i] || highPadding[i] || interiorPadding[i])
+          return std::nullopt;
+        continue;
+      }
+      result.lowPadding[dim] = lowPadding[i];
+      result.highPadding[dim] = highPadding[i];
+      result.interiorPadding[dim] = interiorPadding[i];
+    }
+    return result;
+  }
+  }
+  llvm_unreachable("unknown structured constant kind");
+}
+
+std::optional<StructuredConstant>
+StructuredConstant::pad(TypedAttr padding, ArrayRef<int64_t> low,
+                        ArrayRef<int64_t> high, ArrayRef<int64_t> interior,
+                        RankedTensorType resultType) const {
+  auto isNegative = [](int64_t v) { return v < 0; };
+  if (llvm::any_of(low, isNegative) || llvm::any_of(high, isNegative))
+    return std::nullopt;
+
+  if (kind == Kind::Splat) {
+    if (value == padding || type.getNumElements() == 0)
+      return getSplat(resultType, padding);
+    StructuredConstant result;
+    result.kind = Kind::Padded;
+    result.type = resultType;
+    result.value = value;
+    result.paddingValue = padding;
+    result.lowPadding.assign(low.begin(), low.end());
+    result.highPadding.assign(high.begin(), high.end());
+    result.interiorPadding.assign(interior.begin(), interior.end());
+    return result;
+  }
+
+  // Two pads with the same value merge as long as neither pads the interior.
+  auto isNonZero = [](int64_t v) { return v != 0; };
+  if (kind == Kind::Padded && paddingValue == padding &&
+      !llvm::any_of(interior, isNonZero) &&
+      !llvm::any_of(interiorPadding, isNonZero)) {
+    StructuredConstant result = *this;
+    result.type = resultType;
+    for (auto [i, lo, hi] : llvm::enumerate(low, high)) {
+      result.lowPadding[i] += lo;
+      result.highPadding[i] += hi;
+    }
+    return result;
+  }
+
+  return std::nullopt;
+}
+
+Value StructuredConstant::materialize(OpBuilder &builder, Location loc) const {
+  auto splatConstant = [&](RankedTensorType ty, TypedAttr attr) -> Value {
+    return stablehlo::ConstantOp::create(builder, loc,
+                                         SplatElementsAttr::get(ty, attr));
+  };
+
+  switch (kind) {
+  case Kind::Splat:
+    return splatConstant(type, value);
+  case Kind::Iota: {
+    Value result =
+        stablehlo::IotaOp::create(builder, loc, type, iota.dimension);
+    if (!isOneAttr(iota.scale))
+      result = stablehlo::MulOp::create(builder, loc, result,
+                                        splatConstant(type, iota.scale));
+    if (!isZeroAttr(iota.start))
+      result = stablehlo::AddOp::create(builder, loc, result,
+                                        splatConstant(type, iota.start));
+    return result;
+  }
+  case Kind::Padded: {
+    SmallVector<int64_t> innerShape;
+    for (int64_t d = 0; d < type.getRank(); d++) {
+      int64_t size = type.getDimSize(d) - lowPadding[d] - highPadding[d];
+      innerShape.push_back((size + interiorPadding[d]) /
+                           (interiorPadding[d] + 1));
+    }
+    auto elemType = type.getElementType();
+    auto inner =
+        splatConstant(RankedTensorType::get(innerShape, elemType), value);
+    auto padding =
+        splatConstant(RankedTensorType::get({}, elemType), paddingValue);
+    return stablehlo::PadOp::create(
+        builder, loc, type, inner, padding,
+        builder.getDenseI64ArrayAttr(lowPadding),
+        builder.getDenseI64ArrayAttr(highPadding),
+        builder.getDenseI64ArrayAttr(interiorPadding));
+  }
+  }
+  llvm_unreachable("unknown structured constant kind");
+}
+
+std::optional<StructuredConstant> detectStructuredConstant(Value value) {
+  auto type = dyn_cast<RankedTensorType>(value.getType());
+  if (!type || !type.hasStaticShape())
+    return std::nullopt;
+
+  SplatElementsAttr splat;
+  if (matchPattern(value, m_Constant(&splat)))
+    return StructuredConstant::getSplat(type,
+                                        splat.getSplatValue<TypedAttr>());
+
+  if (auto padOp = value.getDefiningOp<stablehlo::PadOp>()) {
+    SplatElementsAttr inner, padding;
+    if (!matchPattern(padOp.getOperand(), m_Constant(&inner)) ||
+        !matchPattern(padOp.getPaddingValue(), m_Constant(&padding)))
+      return std::nullopt;
+    auto innerConstant = StructuredConstant::getSplat(
+        cast<RankedTensorType>(padOp.getOperand().getType()),
+        inner.getSplatValue<TypedAttr>());
+    return innerConstant.pad(padding.getSplatValue<TypedAttr>(),
+                             padOp.getEdgePaddingLow(),
+                             padOp.getEdgePaddingHigh(),
+                             padOp.getInteriorPadding(), type);
+  }
+
+  auto iota = detectIotaLikeTensor(value);
+  if (!iota)
+    return std::nullopt;
+  // An iota along a unit dimension is just its start value.
+  if (type.getDimSize(iota->dimension) == 1)
+    return StructuredConstant::getSplat(type, iota->start);
+  StructuredConstant result;
+  result.kind = StructuredConstant::Kind::Iota;
+  result.type = type;
+  result.iota = *iota;
+  return result;
+}
+
 bool allAccessesAreOnMainDiagonalPostReshape(stablehlo::ReshapeOp op,
                                              stablehlo::SliceOp sliceOp) {
   auto reshapeInTy = cast<RankedTensorType>(op.getOperand().getType());
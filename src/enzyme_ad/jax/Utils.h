@@ -1088,6 +1088,46 @@ inline mlir::TypedAttr createAttrFromDouble(mlir::MLIRContext *ctx,
   return nullptr;
 }
 
+// A constant tensor described by its structure rather than by its elements,
+// so that folders can handle constants too large to materialize:
+//   Splat:  every element is `value`
+//   Iota:   `iota.start + index[iota.dimension] * iota.scale`
+//   Padded: a splat of `value` padded with `paddingValue`
+struct StructuredConstant {
+  enum class Kind { Splat, Iota, Padded };
+
+  Kind kind;
+  mlir::RankedTensorType type;
+  mlir::TypedAttr value;        // Splat and Padded
+  IotaLikeTensor iota;          // Iota
+  mlir::TypedAttr paddingValue; // Padded
+  llvm::SmallVector<int64_t> lowPadding;
+  llvm::SmallVector<int64_t> highPadding;
+  llvm::SmallVector<int64_t> interiorPadding;
+
+  static StructuredConstant getSplat(mlir::RankedTensorType type,
+                                     mlir::TypedAttr value);
+
+  // Structure of broadcast_in_dim(this) into `resultType`.
+  std::optional<StructuredConstant>
+  broadcastInDim(llvm::ArrayRef<int64_t> dims,
+                 mlir::RankedTensorType resultType) const;
+
+  // Structure of pad(this, padding), where `padding` is a scalar.
+  std::optional<StructuredConstant>
+  pad(mlir::TypedAttr padding, llvm::ArrayRef<int64_t> low,
+      llvm::ArrayRef<int64_t> high, llvm::ArrayRef<int64_t> interior,
+      mlir::RankedTensorType resultType) const;
+
+  // Emits the constant as a splat, an iota chain or a pad of splats. None of
+  // these grow with the number of elements.
+  mlir::Value materialize(mlir::OpBuilder &builder, mlir::Location loc) const;
+};
+
+// Recognizes splat constants, iota-like values (see detectIotaLikeTensor) and
+// pads of splat constants without expanding them.
+std::optional<StructuredConstant> detectStructuredConstant(mlir::Value value);
+
 // TODO: we can do a full analysis and return if the access is on a specific set
 // of diagonals. Checks that all accesses for this Op and its users thereoff are
 // along the diagonal.
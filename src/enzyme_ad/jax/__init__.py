@@ -5,6 +5,7 @@ from enzyme_ad.jax.primitives import (
     enzyme_jax_ir,
     XLAPipeline,
     JaXPipeline,
+    compile_options,
     optimize_module,
     export,
     full_optimization_pass_pipeline,
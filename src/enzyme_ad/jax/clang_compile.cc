@@ -10,6 +10,7 @@
 #include "llvm/IRReader/IRReader.h"
 
 #include <cstring>
+#include <dlfcn.h>
 #include <iostream>
 #include <memory>
 #include <setjmp.h>
@@ -23,6 +24,8 @@
 #include "llvm-c/Core.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/AsmParser/LLLexer.h"
 #include "llvm/AsmParser/LLParser.h"
@@ -51,6 +54,7 @@
 #include "clang/Driver/Tool.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/FrontendActions.h"
 #include "clang/Frontend/FrontendOptions.h"
 #include "clang/Frontend/TextDiagnosticBuffer.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
@@ -63,8 +67,13 @@
 #include "llvm/CodeGen/CommandFlags.h"
 #include "llvm/Linker/Linker.h"
 #include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/Chrono.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBufferRef.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/xxhash.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/TargetParser/Host.h"
 
@@ -166,105 +175,8 @@ static TargetMachine *GetTargetMachine(llvm::Triple TheTriple, StringRef CPUStr,
       codegen::getExplicitRelocModel(), codegen::getExplicitCodeModel(), level);
 }
 
-std::unique_ptr<llvm::Module>
-GetLLVMFromJob(std::string filename, std::string filecontents, bool cpp,
-               ArrayRef<std::string> pyargv, LLVMContext *Context,
-               std::unique_ptr<llvm::Module> linkMod) {
-  const llvm::opt::InputArgList Args;
-  const char *binary = cpp ? "clang++" : "clang";
-  // Buffer diagnostics from argument parsing so that we can output them using a
-  // well formed diagnostic object.
-  DiagnosticOptions DiagOpts;
-  TextDiagnosticBuffer *DiagsBuffer = new TextDiagnosticBuffer;
-  auto *DiagsBuffer0 = new IgnoringDiagConsumer;
-
-  IntrusiveRefCntPtr<DiagnosticIDs> DiagID(new DiagnosticIDs());
-  DiagnosticsEngine Diags(DiagID, DiagOpts, DiagsBuffer);
-
-  DiagnosticOptions DiagOpts0;
-  IntrusiveRefCntPtr<DiagnosticIDs> DiagID0(new DiagnosticIDs());
-  DiagnosticsEngine Diags0(DiagID0, DiagOpts0, DiagsBuffer0);
-
-  const std::unique_ptr<clang::driver::Driver> driver(new clang::driver::Driver(
-      binary, llvm::sys::getDefaultTargetTriple(), Diags0));
-  ArgumentList Argv;
-
-  Argv.emplace_back(StringRef(filename));
-  for (auto v : pyargv)
-    Argv.emplace_back(v);
-
-  SmallVector<const char *> PreArgs;
-  PreArgs.push_back(binary);
-  PreArgs.append(Argv.getArguments());
-  PreArgs[1] = "-";
-  const std::unique_ptr<clang::driver::Compilation> compilation(
-      driver->BuildCompilation(PreArgs));
-
-  Argv.push_back("-emit-llvm");
-  Argv.push_back("-I/enzyme");
-  Argv.push_back("-O1");
-  Argv.push_back("-disable-llvm-passes");
-  // Parse additional include paths from environment variables.
-  // FIXME: We should probably sink the logic for handling these from the
-  // frontend into the driver. It will allow deleting 4 otherwise unused flags.
-  // CPATH - included following the user specified includes (but prior to
-  // builtin and standard includes).
-  clang::driver::tools::addDirectoryList(Args, Argv.getArguments(), "-I",
-                                         "CPATH");
-  // C_INCLUDE_PATH - system includes enabled when compiling C.
-  clang::driver::tools::addDirectoryList(Args, Argv.getArguments(),
-                                         "-c-isystem", "C_INCLUDE_PATH");
-  // CPLUS_INCLUDE_PATH - system includes enabled when compiling C++.
-  clang::driver::tools::addDirectoryList(Args, Argv.getArguments(),
-                                         "-cxx-isystem", "CPLUS_INCLUDE_PATH");
-  // OBJC_INCLUDE_PATH - system includes enabled when compiling ObjC.
-  clang::driver::tools::addDirectoryList(Args, Argv.getArguments(),
-                                         "-objc-isystem", "OBJC_INCLUDE_PATH");
-  // OBJCPLUS_INCLUDE_PATH - system includes enabled when compiling ObjC++.
-  clang::driver::tools::addDirectoryList(
-      Args, Argv.getArguments(), "-objcxx-isystem", "OBJCPLUS_INCLUDE_PATH");
-
-  auto &TC = compilation->getDefaultToolChain();
-  if (cpp) {
-    bool HasStdlibxxIsystem =
-        false; // Args.hasArg(options::OPT_stdlibxx_isystem);
-    HasStdlibxxIsystem
-        ? TC.AddClangCXXStdlibIsystemArgs(Args, Argv.getArguments())
-        : TC.AddClangCXXStdlibIncludeArgs(Args, Argv.getArguments());
-  }
-
-  TC.AddClangSystemIncludeArgs(Args, Argv.getArguments());
-
-  SmallVector<char, 1> outputvec;
-
-  std::unique_ptr<CompilerInstance> Clang(new CompilerInstance());
-
-  // Register the support for object-file-wrapped Clang modules.
-  // auto PCHOps = Clang->getPCHContainerOperations();
-  // PCHOps->registerWriter(std::make_unique<ObjectFilePCHContainerWriter>());
-  // PCHOps->registerReader(std::make_unique<ObjectFilePCHContainerReader>());
-
-  auto baseFS = createVFSFromCompilerInvocation(Clang->getInvocation(), Diags);
-
-  IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> fs(
-      new llvm::vfs::InMemoryFileSystem());
-
-  struct tm y2k = {};
-
-  y2k.tm_hour = 0;
-  y2k.tm_min = 0;
-  y2k.tm_sec = 0;
-  y2k.tm_year = 100;
-  y2k.tm_mon = 0;
-  y2k.tm_mday = 1;
-  time_t timer = mktime(&y2k);
-
-  fs->addFile(filename, timer,
-              llvm::MemoryBuffer::getMemBuffer(
-                  filecontents, filename, /*RequiresNullTerminator*/ false));
-  fs->addFile("/enzyme/enzyme/utils", timer,
-              llvm::MemoryBuffer::getMemBuffer(
-                  R"(
+static const char EnzymeUtilsHeader[] = R"(
+#pragma once
 namespace enzyme {
   template<typename RT=void, typename... Args>
   RT __enzyme_fwddiff(Args...);
@@ -284,11 +196,141 @@ extern "C" int enzyme_dupnoneed;
 extern "C" int enzyme_nooverwrite;
 extern "C" int enzyme_tape;
 extern "C" int enzyme_allocated;
-  )",
-                  "/enzyme/enzyme/utils", /*RequiresNullTerminator*/ false));
-  fs->addFile("/enzyme/enzyme/tensor", timer,
-              llvm::MemoryBuffer::getMemBuffer(
-                  R"(
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Provided by the runtime, runs body over chunks of [0, n), potentially on the
+// XLA intra-op thread pool.
+extern "C" void enzymexla_parallel_for(int64_t n,
+                                       void (*body)(int64_t, int64_t, void *),
+                                       void *closure);
+
+namespace enzyme {
+namespace detail {
+template <typename F>
+void parallel_for_chunk(int64_t begin, int64_t end, void *closure) {
+  F &body = *(F *)closure;
+  for (int64_t i = begin; i < end; i++)
+    body(i);
+}
+
+template <typename F>
+void parallel_for_iteration(int64_t i, F *body) {
+  (*body)(i);
+}
+
+// Every iteration is differentiated on its own, the augmented forward pass
+// stores one tape per iteration for the reverse pass.
+template <typename F>
+struct parallel_for_shadow {
+  F *body;
+  F *dbody;
+  char *tapes;
+  std::size_t tapesize;
+
+  void *tape(int64_t i) const {
+    return tapes ? (void *)(tapes + i * tapesize) : nullptr;
+  }
+};
+
+template <typename F>
+void parallel_for_fwd_chunk(int64_t begin, int64_t end, void *closure) {
+  auto &s = *(parallel_for_shadow<F> *)closure;
+  for (int64_t i = begin; i < end; i++)
+    __enzyme_fwddiff<void>(parallel_for_iteration<F>, enzyme_const, i,
+                           enzyme_dup, s.body, s.dbody);
+}
+
+template <typename F>
+void parallel_for_aug_chunk(int64_t begin, int64_t end, void *closure) {
+  auto &s = *(parallel_for_shadow<F> *)closure;
+  for (int64_t i = begin; i < end; i++)
+    __enzyme_augmentfwd<void *>(parallel_for_iteration<F>, enzyme_allocated,
+                                s.tapesize, enzyme_tape, s.tape(i),
+                                enzyme_const, i, enzyme_dup, s.body, s.dbody);
+}
+
+template <typename F>
+void parallel_for_rev_chunk(int64_t begin, int64_t end, void *closure) {
+  auto &s = *(parallel_for_shadow<F> *)closure;
+  for (int64_t i = begin; i < end; i++)
+    __enzyme_reverse<void>(parallel_for_iteration<F>, enzyme_allocated,
+                           s.tapesize, enzyme_tape, s.tape(i), enzyme_const, i,
+                           enzyme_dup, s.body, s.dbody);
+}
+
+template <typename F>
+std::size_t parallel_for_tapesize() {
+  return __enzyme_augmentsize(parallel_for_iteration<F>, enzyme_const,
+                              enzyme_dup);
+}
+
+template <typename F>
+__attribute__((noinline)) void parallel_for(int64_t n, F *body);
+
+template <typename F>
+void parallel_for_fwd(int64_t n, F *body, F *dbody) {
+  parallel_for_shadow<F> s = {body, dbody, nullptr, 0};
+  enzymexla_parallel_for(n, parallel_for_fwd_chunk<F>, &s);
+}
+
+template <typename F>
+void *parallel_for_aug(int64_t n, F *body, F *dbody) {
+  std::size_t tapesize = parallel_for_tapesize<F>();
+  char *tapes = nullptr;
+  if (n > 0 && tapesize != 0) {
+    tapes = (char *)calloc(n, tapesize);
+    if (!tapes)
+      abort();
+  }
+  parallel_for_shadow<F> s = {body, dbody, tapes, tapesize};
+  enzymexla_parallel_for(n, parallel_for_aug_chunk<F>, &s);
+  return tapes;
+}
+
+// Distinct iterations may read the same value and thus accumulate into the
+// same shadow, so the reverse pass runs sequentially.
+template <typename F>
+void parallel_for_rev(int64_t n, F *body, F *dbody, void *tape) {
+  parallel_for_shadow<F> s = {body, dbody, (char *)tape,
+                              parallel_for_tapesize<F>()};
+  parallel_for_rev_chunk<F>(0, n, &s);
+  free(tape);
+}
+
+template <typename F>
+__attribute__((used)) void *__enzyme_register_derivative_parallel_for[2] = {
+    (void *)parallel_for<F>, (void *)parallel_for_fwd<F>};
+
+template <typename F>
+__attribute__((used)) void *__enzyme_register_gradient_parallel_for[3] = {
+    (void *)parallel_for<F>, (void *)parallel_for_aug<F>,
+    (void *)parallel_for_rev<F>};
+
+template <typename F>
+__attribute__((noinline)) void parallel_for(int64_t n, F *body) {
+  (void)&__enzyme_register_derivative_parallel_for<F>;
+  (void)&__enzyme_register_gradient_parallel_for<F>;
+  enzymexla_parallel_for(n, parallel_for_chunk<F>, body);
+}
+} // namespace detail
+
+// Runs body(i) for every i in [begin, end), splitting the range over the XLA
+// intra-op thread pool. Iterations must be independent of each other.
+template <typename F>
+__attribute__((always_inline)) inline void parallel_for(int64_t begin,
+                                                        int64_t end,
+                                                        F &&body) {
+  auto shifted = [&](int64_t i) { body(begin + i); };
+  if (end > begin)
+    detail::parallel_for(end - begin, &shifted);
+}
+} // namespace enzyme
+  )";
+
+static const char EnzymeTensorHeader[] = R"(
+#pragma once
 #include <stdint.h>
 #include <tuple>
 namespace enzyme {
@@ -468,8 +510,321 @@ struct tensor<T, n0, N...>
 };
 
 }
-  )",
-                  "/enzyme/enzyme/tensor", /*RequiresNullTerminator*/ false));
+  )";
+
+// Includes the fixed header set that enzyme_call places in front of every
+// kernel, so that it can be precompiled once.
+static const char EnzymePreludeHeader[] = R"(
+#pragma once
+#include <cstdint>
+#include <enzyme/tensor>
+#include <enzyme/utils>
+  )";
+
+static const char EnzymePreludePath[] = "/enzyme/enzyme/prelude";
+static const char EnzymePCHPath[] = "/enzyme/prelude.pch";
+static const char EnzymePCHCheckPath[] = "/enzyme/prelude-check.cpp";
+
+static time_t getEnzymeHeaderTimestamp() {
+  static const time_t timer = [] {
+    struct tm y2k = {};
+
+    y2k.tm_hour = 0;
+    y2k.tm_min = 0;
+    y2k.tm_sec = 0;
+    y2k.tm_year = 100;
+    y2k.tm_mon = 0;
+    y2k.tm_mday = 1;
+    return mktime(&y2k);
+  }();
+  return timer;
+}
+
+// Returns the file system holding the /enzyme headers. It is built once and
+// never modified afterwards, so it is shared by all compilations.
+static IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> getEnzymeHeaderFS() {
+  static IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> headerFS = [] {
+    IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> fs(
+        new llvm::vfs::InMemoryFileSystem());
+    auto timer = getEnzymeHeaderTimestamp();
+    for (auto [path, contents] :
+         {std::make_pair("/enzyme/enzyme/utils", EnzymeUtilsHeader),
+          std::make_pair("/enzyme/enzyme/tensor", EnzymeTensorHeader),
+          std::make_pair(EnzymePreludePath, EnzymePreludeHeader)})
+      fs->addFile(path, timer,
+                  llvm::MemoryBuffer::getMemBuffer(
+                      contents, path, /*RequiresNullTerminator*/ false));
+    return fs;
+  }();
+  return headerFS;
+}
+
+// Runs `Act` on a frontend invocation built from `args`, discarding all
+// diagnostics. Returns true on success.
+static bool executeQuietly(const char *binary, ArrayRef<const char *> args,
+                           IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+                           FrontendAction &Act) {
+  DiagnosticOptions DiagOpts;
+  std::unique_ptr<CompilerInstance> Clang(new CompilerInstance());
+  Clang->createVirtualFileSystem(FS);
+  Clang->createFileManager();
+  Clang->setDiagnostics(
+      Clang->createDiagnostics(*FS, DiagOpts, new IgnoringDiagConsumer));
+
+  if (!CompilerInvocation::CreateFromArgs(Clang->getInvocation(), args,
+                                          Clang->getDiagnostics(), binary))
+    return false;
+  if (Clang->getHeaderSearchOpts().UseBuiltinIncludes &&
+      Clang->getHeaderSearchOpts().ResourceDir.empty())
+    Clang->getHeaderSearchOpts().ResourceDir = clang::GetResourcesPath(binary);
+  return Clang->ExecuteAction(Act);
+}
+
+// Describes the compiler and the system headers that a PCH built from `args`
+// depends on. Clang does not validate system headers when it loads a PCH, so
+// a PCH stored on disk must not be reused once the library embedding the
+// compiler or any of the system include directories changed.
+static void appendBuildEnvironment(raw_ostream &os, const char *binary,
+                                   ArrayRef<const char *> args,
+                                   llvm::vfs::FileSystem &FS) {
+  auto addPath = [&](StringRef path) {
+    os << path << '\0';
+    if (auto status = FS.status(path))
+      os << llvm::sys::toTimeT(status->getLastModificationTime()) << ':'
+         << status->getSize();
+    os << '\0';
+  };
+
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void *>(&getEnzymeHeaderTimestamp), &info) &&
+      info.dli_fname)
+    addPath(info.dli_fname);
+  addPath(clang::GetResourcesPath(binary));
+  for (auto [flag, value] : llvm::zip(args.drop_back(), args.drop_front())) {
+    StringRef name(flag);
+    if (name.ends_with("isystem") || name == "-resource-dir")
+      addPath(value);
+  }
+}
+
+// Returns true if a compilation with the given frontend arguments accepts the
+// PCH at `path`.
+static bool isPCHUsable(const char *binary, ArrayRef<const char *> args,
+                        IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+                        StringRef path) {
+  IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> checkFS(
+      new llvm::vfs::InMemoryFileSystem());
+  checkFS->addFile(EnzymePCHCheckPath, getEnzymeHeaderTimestamp(),
+                   llvm::MemoryBuffer::getMemBuffer("", EnzymePCHCheckPath));
+  IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> overlayFS(
+      new llvm::vfs::OverlayFileSystem(FS));
+  overlayFS->pushOverlay(checkFS);
+
+  std::string pathStr = path.str();
+  SmallVector<const char *> checkArgs(args.begin(), args.end());
+  checkArgs[0] = EnzymePCHCheckPath;
+  checkArgs.append({"-include-pch", pathStr.c_str()});
+  SyntaxOnlyAction Act;
+  return executeQuietly(binary, checkArgs, overlayFS, Act);
+}
+
+// Returns the precompiled prelude for a compilation with the given frontend
+// arguments, building it on first use, or nullptr if it cannot be built. A
+// PCH is only accepted by a compilation with the same language and target
+// options, so the cache is keyed on the full argument list. If
+// ENZYMEXLA_PCH_CACHE_DIR is set, built PCHs are also stored there and reused
+// by later processes; a stored PCH that fails to load is rebuilt.
+static const std::string *
+getPreludePCH(const char *binary, ArrayRef<const char *> args,
+              IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS) {
+  static llvm::sys::SmartMutex<true> mutex;
+  static llvm::StringMap<std::unique_ptr<std::string>> cache;
+
+  std::string key;
+  llvm::raw_string_ostream ks(key);
+  ks << getClangFullVersion() << '\0' << binary << '\0';
+  // The first argument is the input file, which the PCH does not depend on.
+  for (auto arg : args.drop_front())
+    ks << arg << '\0';
+
+  llvm::sys::SmartScopedLock<true> lock(mutex);
+  auto found = cache.find(key);
+  if (found != cache.end())
+    return found->second.get();
+  auto &entry = cache[key];
+
+  SmallString<128> path;
+  bool persistent = false;
+  if (auto dir = getenv("ENZYMEXLA_PCH_CACHE_DIR")) {
+    // The header contents and timestamp are validated when the PCH is loaded,
+    // so they are part of the on-disk name as well.
+    ks << EnzymeUtilsHeader << '\0' << EnzymeTensorHeader << '\0'
+       << getEnzymeHeaderTimestamp() << '\0';
+    appendBuildEnvironment(ks, binary, args, *FS);
+    path = dir;
+    llvm::sys::path::append(path, "prelude-" +
+                                      llvm::utohexstr(llvm::xxh3_64bits(key)) +
+                                      ".pch");
+    persistent = true;
+    if (llvm::sys::fs::exists(path) && isPCHUsable(binary, args, FS, path)) {
+      if (auto buffer = llvm::MemoryBuffer::getFile(path)) {
+        entry = std::make_unique<std::string>((*buffer)->getBuffer());
+        return entry.get();
+      }
+    }
+    llvm::sys::fs::create_directories(dir);
+  } else if (llvm::sys::fs::createTemporaryFile("enzymexla-prelude", "pch",
+                                                path)) {
+    return nullptr;
+  }
+
+  SmallVector<const char *> pchArgs(args.begin(), args.end());
+  pchArgs[0] = EnzymePreludePath;
+  pchArgs.append({"-x", "c++-header", "-emit-pch", "-o", path.c_str()});
+
+  // Failures are not reported here; the kernel is then compiled without the
+  // PCH and any error in the prelude shows up in that compilation.
+  GeneratePCHAction Act;
+  if (executeQuietly(binary, pchArgs, FS, Act)) {
+    if (auto buffer = llvm::MemoryBuffer::getFile(path))
+      entry = std::make_unique<std::string>((*buffer)->getBuffer());
+  }
+  if (!persistent || !entry)
+    llvm::sys::fs::remove(path);
+  return entry.get();
+}
+
+std::unique_ptr<llvm::Module>
+GetLLVMFromJob(std::string filename, std::string filecontents, bool cpp,
+               ArrayRef<std::string> pyargv, LLVMContext *Context,
+               std::unique_ptr<llvm::Module> linkMod, bool prelude,
+               const KernelCompileOptions &options) {
+  if (options.frontendOptLevel > 3 || options.optLevel > 3)
+    throw nanobind::value_error("optimization levels must be between 0 and 3");
+
+  // Resolve the target once so that clang, the functions linked in from
+  // linkMod and the target machine below all agree on it.
+  std::string targetCPU = options.targetCPU;
+  std::vector<std::string> targetFeatures;
+  if (targetCPU == "native") {
+    targetCPU = llvm::sys::getHostCPUName().str();
+    for (auto &feature : llvm::sys::getHostCPUFeatures())
+      targetFeatures.push_back((feature.getValue() ? "+" : "-") +
+                               feature.getKey().str());
+  }
+  for (auto feature : llvm::split(options.targetFeatures, ',')) {
+    feature = feature.trim();
+    if (feature.empty())
+      continue;
+    if (feature[0] != '+' && feature[0] != '-')
+      targetFeatures.push_back(("+" + feature).str());
+    else
+      targetFeatures.push_back(feature.str());
+  }
+
+  const llvm::opt::InputArgList Args;
+  const char *binary = cpp ? "clang++" : "clang";
+  // Buffer diagnostics from argument parsing so that we can output them using a
+  // well formed diagnostic object.
+  DiagnosticOptions DiagOpts;
+  TextDiagnosticBuffer *DiagsBuffer = new TextDiagnosticBuffer;
+  auto *DiagsBuffer0 = new IgnoringDiagConsumer;
+
+  IntrusiveRefCntPtr<DiagnosticIDs> DiagID(new DiagnosticIDs());
+  DiagnosticsEngine Diags(DiagID, DiagOpts, DiagsBuffer);
+
+  DiagnosticOptions DiagOpts0;
+  IntrusiveRefCntPtr<DiagnosticIDs> DiagID0(new DiagnosticIDs());
+  DiagnosticsEngine Diags0(DiagID0, DiagOpts0, DiagsBuffer0);
+
+  const std::unique_ptr<clang::driver::Driver> driver(new clang::driver::Driver(
+      binary, llvm::sys::getDefaultTargetTriple(), Diags0));
+  ArgumentList Argv;
+
+  Argv.emplace_back(StringRef(filename));
+  for (auto v : pyargv)
+    Argv.emplace_back(v);
+
+  SmallVector<const char *> PreArgs;
+  PreArgs.push_back(binary);
+  PreArgs.append(Argv.getArguments());
+  PreArgs[1] = "-";
+  const std::unique_ptr<clang::driver::Compilation> compilation(
+      driver->BuildCompilation(PreArgs));
+
+  Argv.push_back("-emit-llvm");
+  Argv.push_back("-I/enzyme");
+  Argv.emplace_back("-O" + std::to_string(options.frontendOptLevel));
+  Argv.push_back("-disable-llvm-passes");
+  if (!targetCPU.empty()) {
+    Argv.push_back("-target-cpu");
+    Argv.emplace_back(targetCPU);
+  }
+  for (auto &feature : targetFeatures) {
+    Argv.push_back("-target-feature");
+    Argv.emplace_back(feature);
+  }
+  if (options.fastMath) {
+    // The flags the driver expands -ffast-math into.
+    for (auto flag :
+         {"-ffast-math", "-menable-no-infs", "-menable-no-nans",
+          "-fapprox-func", "-funsafe-math-optimizations", "-fno-signed-zeros",
+          "-mreassociate", "-freciprocal-math", "-ffp-contract=fast"})
+      Argv.push_back(flag);
+  }
+  if (options.preferVectorWidth)
+    Argv.emplace_back("-mprefer-vector-width=" +
+                      std::to_string(options.preferVectorWidth));
+  // Parse additional include paths from environment variables.
+  // FIXME: We should probably sink the logic for handling these from the
+  // frontend into the driver. It will allow deleting 4 otherwise unused flags.
+  // CPATH - included following the user specified includes (but prior to
+  // builtin and standard includes).
+  clang::driver::tools::addDirectoryList(Args, Argv.getArguments(), "-I",
+                                         "CPATH");
+  // C_INCLUDE_PATH - system includes enabled when compiling C.
+  clang::driver::tools::addDirectoryList(Args, Argv.getArguments(),
+                                         "-c-isystem", "C_INCLUDE_PATH");
+  // CPLUS_INCLUDE_PATH - system includes enabled when compiling C++.
+  clang::driver::tools::addDirectoryList(Args, Argv.getArguments(),
+                                         "-cxx-isystem", "CPLUS_INCLUDE_PATH");
+  // OBJC_INCLUDE_PATH - system includes enabled when compiling ObjC.
+  clang::driver::tools::addDirectoryList(Args, Argv.getArguments(),
+                                         "-objc-isystem", "OBJC_INCLUDE_PATH");
+  // OBJCPLUS_INCLUDE_PATH - system includes enabled when compiling ObjC++.
+  clang::driver::tools::addDirectoryList(
+      Args, Argv.getArguments(), "-objcxx-isystem", "OBJCPLUS_INCLUDE_PATH");
+
+  auto &TC = compilation->getDefaultToolChain();
+  if (cpp) {
+    bool HasStdlibxxIsystem =
+        false; // Args.hasArg(options::OPT_stdlibxx_isystem);
+    HasStdlibxxIsystem
+        ? TC.AddClangCXXStdlibIsystemArgs(Args, Argv.getArguments())
+        : TC.AddClangCXXStdlibIncludeArgs(Args, Argv.getArguments());
+  }
+
+  TC.AddClangSystemIncludeArgs(Args, Argv.getArguments());
+
+  SmallVector<char, 1> outputvec;
+
+  std::unique_ptr<CompilerInstance> Clang(new CompilerInstance());
+
+  // Register the support for object-file-wrapped Clang modules.
+  // auto PCHOps = Clang->getPCHContainerOperations();
+  // PCHOps->registerWriter(std::make_unique<ObjectFilePCHContainerWriter>());
+  // PCHOps->registerReader(std::make_unique<ObjectFilePCHContainerReader>());
+
+  auto baseFS = createVFSFromCompilerInvocation(Clang->getInvocation(), Diags);
+
+  // Only the kernel source is specific to this compilation; the /enzyme
+  // headers come from the shared file system.
+  IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> fs(
+      new llvm::vfs::InMemoryFileSystem());
+
+  fs->addFile(filename, getEnzymeHeaderTimestamp(),
+              llvm::MemoryBuffer::getMemBuffer(
+                  filecontents, filename, /*RequiresNullTerminator*/ false));
 
   std::unique_ptr<llvm::raw_pwrite_stream> outputStream(
       new llvm::raw_svector_ostream(outputvec));
@@ -477,9 +832,20 @@ struct tensor<T, n0, N...>
 
   IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> fuseFS(
       new llvm::vfs::OverlayFileSystem(baseFS));
+  fuseFS->pushOverlay(getEnzymeHeaderFS());
   fuseFS->pushOverlay(fs);
   fuseFS->pushOverlay(baseFS);
 
+  if (prelude && cpp) {
+    if (auto pch = getPreludePCH(binary, Argv.getArguments(), fuseFS)) {
+      fs->addFile(EnzymePCHPath, getEnzymeHeaderTimestamp(),
+                  llvm::MemoryBuffer::getMemBuffer(
+                      *pch, EnzymePCHPath, /*RequiresNullTerminator*/ false));
+      Argv.push_back("-include-pch");
+      Argv.push_back(EnzymePCHPath);
+    }
+  }
+
   Clang->createVirtualFileSystem(fuseFS);
   Clang->createFileManager();
 
@@ -524,15 +890,33 @@ struct tensor<T, n0, N...>
     Linker::linkModules(*mod, std::move(linkMod));
   }
 
+  // clang already annotated its own functions, this covers the linked ones.
+  std::string targetFeaturesStr = llvm::join(targetFeatures, ",");
+  for (auto &f : *mod) {
+    if (f.isDeclaration())
+      continue;
+    if (!targetCPU.empty())
+      f.addFnAttr("target-cpu", targetCPU);
+    if (!targetFeaturesStr.empty())
+      f.addFnAttr("target-features", targetFeaturesStr);
+    if (options.preferVectorWidth)
+      f.addFnAttr("prefer-vector-width",
+                  std::to_string(options.preferVectorWidth));
+  }
+
   for (auto &f : *mod) {
     if (f.empty())
       continue;
-    if (f.getName() == "entry")
+    if (f.getName() == "entry" || f.getName() == "entry_tapesize")
       continue;
     f.setLinkage(Function::LinkageTypes::InternalLinkage);
   }
 
   PipelineTuningOptions PTO;
+  PTO.LoopVectorization = options.vectorize;
+  PTO.LoopInterleaving = options.vectorize;
+  // As clang does, only run the SLP vectorizer from -O2 on.
+  PTO.SLPVectorization = options.vectorize && options.optLevel > 1;
   LoopAnalysisManager LAM;
   FunctionAnalysisManager FAM;
   CGSCCAnalysisManager CGAM;
@@ -545,14 +929,18 @@ struct tensor<T, n0, N...>
       llvm::driver::createTLII(triple, Clang->getCodeGenOpts().getVecLib()));
   FAM.registerPass([&] { return TargetLibraryAnalysis(*TLII); });
 
-  auto level = CodeGenOptLevel::Aggressive; // OptimizationLevel::O3;
+  auto level = *CodeGenOpt::getLevel(options.optLevel);
 
   Triple ModuleTriple(mod->getTargetTriple());
   std::string CPUStr, FeaturesStr;
 
-  auto ETM =
-      llvm::orc::JITTargetMachineBuilder(llvm::Triple(mod->getTargetTriple()))
-          .createTargetMachine();
+  llvm::orc::JITTargetMachineBuilder JTMB(
+      llvm::Triple(mod->getTargetTriple()));
+  if (!targetCPU.empty())
+    JTMB.setCPU(targetCPU);
+  JTMB.addFeatures(targetFeatures);
+  JTMB.setCodeGenOptLevel(level);
+  auto ETM = JTMB.createTargetMachine();
   if (!ETM) {
     throw nanobind::value_error("failed to create targetmachine");
   }
@@ -572,7 +960,8 @@ struct tensor<T, n0, N...>
   PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
 
   ModulePassManager MPM;
-  if (Error Err = PB.parsePassPipeline(MPM, "default<O3>")) {
+  if (Error Err = PB.parsePassPipeline(
+          MPM, "default<O" + std::to_string(options.optLevel) + ">")) {
     throw nanobind::value_error(
         (Twine("failed to parse pass pipeline: ") + toString(std::move(Err)))
             .str()
@@ -12,10 +12,35 @@
 #include "llvm/IR/Module.h"
 #include <string>
 
+// Code generation options of a single kernel.
+struct KernelCompileOptions {
+  // Optimization level clang emits the IR at (-O<n>).
+  unsigned frontendOptLevel = 1;
+  // Level of the LLVM pipeline the IR is optimized with (default<O<n>>).
+  unsigned optLevel = 3;
+  // CPU to tune and generate code for. Empty selects the generic CPU of the
+  // host triple, "native" the host CPU together with all of its features.
+  std::string targetCPU;
+  // Comma-separated LLVM target features, e.g. "+avx2,+fma".
+  std::string targetFeatures;
+  // Emit IR with all fast-math flags, as with -ffast-math.
+  bool fastMath = false;
+  // Run the loop and SLP vectorizers.
+  bool vectorize = true;
+  // Preferred vector register width in bits, 0 for the target default.
+  unsigned preferVectorWidth = 0;
+};
+
+// Compiles `filecontents` to LLVM IR and optimizes it. When `prelude` is set,
+// the source is expected to start with the enzyme_call prelude
+// (<cstdint>, <enzyme/tensor> and <enzyme/utils>), which is then loaded from a
+// cached precompiled header instead of being parsed again.
 std::unique_ptr<llvm::Module>
 GetLLVMFromJob(std::string filename, std::string filecontents, bool cpp,
                llvm::ArrayRef<std::string> pyargv,
                llvm::LLVMContext *ctx = nullptr,
-               std::unique_ptr<llvm::Module> linkMod = nullptr);
+               std::unique_ptr<llvm::Module> linkMod = nullptr,
+               bool prelude = false,
+               const KernelCompileOptions &options = {});
 
 #endif // ENZYME_JAX_CLANG_COMPILE_H
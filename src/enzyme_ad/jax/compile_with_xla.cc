@@ -1,3 +1,4 @@
+#include <mutex>
 #include <string>
 
 #define protected public
@@ -16,8 +17,13 @@
 #include "xla/service/local_service_utils.h"
 
 #include "absl/status/statusor.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/ThreadPool.h"
 
+#include "mlir/Bytecode/BytecodeReader.h"
+#include "mlir/Bytecode/BytecodeWriter.h"
 #include "mlir/Conversion/ConvertToLLVM/ToLLVMPass.h"
 #include "mlir/Dialect/Arith/IR/Arith.h"
 #include "mlir/Dialect/Complex/IR/Complex.h"
@@ -96,30 +102,145 @@ updateSymbolAndAllUses(mlir::SymbolOpInterface op, mlir::ModuleOp target,
   return success();
 }
 
+static const mlir::DialectRegistry &getRegistry() {
+  static mlir::DialectRegistry registry;
+  static bool initialized = [] {
+    mlir::enzyme::prepareRegistry(registry);
+    mlir::enzyme::registerDialects(registry);
+    mlir::enzyme::registerInterfaces(registry);
+    return true;
+  }();
+  (void)initialized;
+  return registry;
+}
+
+namespace {
+// Modules handed over as text or bytecode are loaded into contexts taken from
+// a small pool, so that the registry is only built and its dialects only
+// loaded once per context rather than once per call. Attributes and types
+// uniqued in a context are only freed with it, so a context is retired once it
+// has parsed enough input. Calls running concurrently use distinct contexts,
+// which all share one thread pool.
+class ContextPool {
+  struct Entry {
+    std::unique_ptr<mlir::MLIRContext> context;
+    size_t numModules = 0;
+    size_t numBytes = 0;
+  };
+
+public:
+  // Bounds on the idle contexts kept around and on the input parsed in a
+  // context before it is retired.
+  static constexpr size_t kMaxIdleContexts = 4;
+  static constexpr size_t kMaxModulesPerContext = 256;
+  static constexpr size_t kMaxBytesPerContext = 256 << 20;
+
+  // A context taken from the pool, given back when released or destroyed.
+  // Diagnostic handlers are registered on the context while a module is
+  // processed, so it must only be used through its lease.
+  class Lease {
+  public:
+    explicit Lease(std::unique_ptr<Entry> entry) : entry(std::move(entry)) {}
+    Lease(Lease &&) = default;
+    ~Lease() { release(); }
+
+    mlir::MLIRContext &get() { return *entry->context; }
+
+    void release() {
+      if (entry)
+        getPool().giveBack(std::move(entry));
+    }
+
+  private:
+    std::unique_ptr<Entry> entry;
+  };
+
+  // Takes a context to parse `numBytes` bytes of input into.
+  static Lease acquire(size_t numBytes) {
+    std::unique_ptr<Entry> entry = getPool().take();
+    entry->numModules++;
+    entry->numBytes += numBytes;
+    return Lease(std::move(entry));
+  }
+
+private:
+  // Declared first so that it outlives the idle contexts using it.
+  llvm::DefaultThreadPool threadPool;
+  std::mutex mutex;
+  llvm::SmallVector<std::unique_ptr<Entry>> idle;
+
+  static ContextPool &getPool() {
+    static ContextPool pool;
+    return pool;
+  }
+
+  std::unique_ptr<Entry> take() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!idle.empty())
+        return idle.pop_back_val();
+    }
+    auto entry = std::make_unique<Entry>();
+    entry->context = std::make_unique<mlir::MLIRContext>(
+        getRegistry(), mlir::MLIRContext::Threading::DISABLED);
+    entry->context->setThreadPool(threadPool);
+    mlir::enzyme::loadAllRegisteredDialects(*entry->context);
+    return entry;
+  }
+
+  void giveBack(std::unique_ptr<Entry> entry) {
+    if (entry->numModules >= kMaxModulesPerContext ||
+        entry->numBytes >= kMaxBytesPerContext)
+      return;
+    // Contexts not kept are destroyed after the lock is released.
+    std::lock_guard<std::mutex> lock(mutex);
+    if (idle.size() < kMaxIdleContexts)
+      idle.push_back(std::move(entry));
+  }
+};
+} // namespace
+
+// Parses `pass_pipeline` into `pm`. Pipelines are only parsed the first time
+// they are seen, later requests get a copy of the cached pass manager.
+static mlir::LogicalResult
+parseCachedPassPipeline(llvm::StringRef pass_pipeline, mlir::OpPassManager &pm,
+                        llvm::raw_ostream &error_stream) {
+  static llvm::sys::SmartMutex<true> mutex;
+  static llvm::StringMap<std::unique_ptr<mlir::OpPassManager>> cache;
+
+  llvm::sys::SmartScopedLock<true> lock(mutex);
+  auto found = cache.find(pass_pipeline);
+  if (found == cache.end()) {
+    auto parsed = std::make_unique<mlir::OpPassManager>();
+    if (mlir::failed(
+            mlir::parsePassPipeline(pass_pipeline, *parsed, error_stream)))
+      return mlir::failure();
+    found = cache.try_emplace(pass_pipeline, std::move(parsed)).first;
+  }
+  // Copying clones the passes, so the cached ones are never run.
+  pm = *found->second;
+  return mlir::success();
+}
+
 void run_pass_pipeline(mlir::Operation *mod, const std::string &pass_pipeline) {
   using namespace llvm;
   using namespace mlir;
 
-  mlir::DialectRegistry registry;
-  mlir::enzyme::prepareRegistry(registry);
-  mlir::enzyme::registerDialects(registry);
-  mlir::enzyme::registerInterfaces(registry);
-  mod->getContext()->appendDialectRegistry(registry);
+  mod->getContext()->appendDialectRegistry(getRegistry());
   mlir::enzyme::loadAllRegisteredDialects(*mod->getContext());
 
   mlir::PassManager pm(mod->getContext());
   std::string error_message;
   llvm::raw_string_ostream error_stream(error_message);
   mlir::LogicalResult result =
-      mlir::parsePassPipeline(pass_pipeline, pm, error_stream);
+      parseCachedPassPipeline(pass_pipeline, pm, error_stream);
   if (mlir::failed(result)) {
     throw nanobind::value_error(error_message.c_str());
   }
 
-  DiagnosticEngine &engine = mod->getContext()->getDiagEngine();
   error_stream << "Pipeline failed:\n";
-  DiagnosticEngine::HandlerID id =
-      engine.registerHandler([&](Diagnostic &diag) -> LogicalResult {
+  ScopedDiagnosticHandler handler(
+      mod->getContext(), [&](Diagnostic &diag) -> LogicalResult {
         error_stream << diag << "\n";
         return failure();
       });
@@ -130,18 +251,16 @@ void run_pass_pipeline(mlir::Operation *mod, const std::string &pass_pipeline) {
 
 std::pair<std::string, std::string>
 run_pass_pipeline(const std::vector<std::string> &oldsym_vec,
-                  const std::string &mlir, const std::string &pass_pipeline) {
+                  llvm::StringRef mlir, const std::string &pass_pipeline,
+                  bool bytecode) {
   using namespace llvm;
   using namespace mlir;
 
   std::set<std::string> oldsyms(oldsym_vec.begin(), oldsym_vec.end());
 
-  // Parse MLIR.
-  mlir::DialectRegistry registry;
-  mlir::enzyme::prepareRegistry(registry);
-  mlir::enzyme::registerDialects(registry);
-  mlir::enzyme::registerInterfaces(registry);
-  MLIRContext context(registry);
+  // Parse MLIR, given either as text or as bytecode.
+  auto lease = ContextPool::acquire(mlir.size());
+  mlir::MLIRContext &context = lease.get();
   mlir::ParserConfig parser_config(&context);
   mlir::OwningOpRef<mlir::ModuleOp> parsed_module =
       mlir::parseSourceString<mlir::ModuleOp>(mlir, parser_config);
@@ -155,15 +274,14 @@ run_pass_pipeline(const std::vector<std::string> &oldsym_vec,
   llvm::raw_string_ostream error_stream(error_message);
   error_stream << "Failed to parse pipeline\n";
   mlir::LogicalResult result =
-      mlir::parsePassPipeline(pass_pipeline, pm, error_stream);
+      parseCachedPassPipeline(pass_pipeline, pm, error_stream);
   if (mlir::failed(result)) {
     throw nanobind::value_error(error_message.c_str());
   }
 
-  DiagnosticEngine &engine = context.getDiagEngine();
   error_stream << "Pipeline failed:\n";
-  DiagnosticEngine::HandlerID id =
-      engine.registerHandler([&](Diagnostic &diag) -> LogicalResult {
+  ScopedDiagnosticHandler handler(
+      &context, [&](Diagnostic &diag) -> LogicalResult {
         error_stream << diag << "\n";
         return failure();
       });
@@ -199,12 +317,49 @@ run_pass_pipeline(const std::vector<std::string> &oldsym_vec,
 
   std::string output;
   llvm::raw_string_ostream ss(output);
-  parsed_module->getOperation()->print(
-      ss, mlir::OpPrintingFlags().enableDebugInfo());
+  if (bytecode) {
+    if (failed(mlir::writeBytecodeToFile(*parsed_module, ss)))
+      throw nanobind::value_error("failed to write bytecode");
+  } else {
+    parsed_module->getOperation()->print(
+        ss, mlir::OpPrintingFlags().enableDebugInfo());
+  }
 
   return std::make_pair(entryfn.str(), ss.str());
 }
 
+std::string print_mlir_source(llvm::StringRef mlir) {
+  using namespace mlir;
+
+  if (!isBytecode(llvm::MemoryBufferRef(mlir, "source")))
+    return mlir.str();
+
+  auto lease = ContextPool::acquire(mlir.size());
+  MLIRContext &context = lease.get();
+  std::string diagnostics;
+  llvm::raw_string_ostream diag_stream(diagnostics);
+  ScopedDiagnosticHandler handler(&context,
+                                  [&](Diagnostic &diag) -> LogicalResult {
+                                    diag_stream << diag << "\n";
+                                    return success();
+                                  });
+  ParserConfig parser_config(&context);
+  OwningOpRef<ModuleOp> parsed_module =
+      parseSourceString<ModuleOp>(mlir, parser_config);
+
+  std::string output;
+  llvm::raw_string_ostream ss(output);
+  if (parsed_module) {
+    parsed_module->getOperation()->print(ss,
+                                         OpPrintingFlags().enableDebugInfo());
+  } else {
+    // Bytecode written by a different MLIR version may not be readable here.
+    ss << "<" << mlir.size() << " bytes of MLIR bytecode that could not be "
+       << "parsed: " << diag_stream.str() << ">";
+  }
+  return ss.str();
+}
+
 absl::StatusOr<std::unique_ptr<xla::Executable>>
 BuildExecutable(xla::Service *self, const xla::HloModuleProto &module_proto,
                 std::unique_ptr<xla::HloModuleConfig> module_config,
@@ -259,13 +414,11 @@ BuildExecutable(xla::Service *self, const xla::HloModuleProto &module_proto,
 std::unique_ptr<xla::LocalExecutable>
 compile_mhlo_to_llvm_with_xla(llvm::StringRef mhlo_text, std::string &output,
                               bool xla_runtime,
-                              const std::string &pass_pipeline) {
-  // Parse MLIR.
-  mlir::DialectRegistry registry;
-  mlir::enzyme::prepareRegistry(registry);
-  mlir::enzyme::registerDialects(registry);
-  mlir::enzyme::registerInterfaces(registry);
-  mlir::MLIRContext context(registry);
+                              const std::string &pass_pipeline,
+                              bool optimize_llvm) {
+  // Parse MLIR, given either as text or as bytecode.
+  auto lease = ContextPool::acquire(mhlo_text.size());
+  mlir::MLIRContext &context = lease.get();
   mlir::ParserConfig parser_config(&context);
   mlir::OwningOpRef<mlir::ModuleOp> parsed_module =
       mlir::parseSourceString<mlir::ModuleOp>(mhlo_text, parser_config);
@@ -289,7 +442,7 @@ compile_mhlo_to_llvm_with_xla(llvm::StringRef mhlo_text, std::string &output,
     std::string error_message;
     llvm::raw_string_ostream error_stream(error_message);
     error_stream << "Failed to parse pre stablehlo pipeline\n";
-    mlir::LogicalResult result = mlir::parsePassPipeline(pre, pm, error_stream);
+    mlir::LogicalResult result = parseCachedPassPipeline(pre, pm, error_stream);
     if (mlir::failed(result)) {
       throw nanobind::value_error(error_message.c_str());
     }
@@ -338,12 +491,16 @@ compile_mhlo_to_llvm_with_xla(llvm::StringRef mhlo_text, std::string &output,
     shape_pointers.push_back(&shape);
   }
 
+  // The rest only works on the HLO proto.
+  parsed_module = nullptr;
+  lease.release();
+
   // Compile with XLA, local client means targeting CPU.
   // XXX: this is using a debug feature of XLA to preserve LLVM IR. If the
   // feature ever disappears and is not recoverable with a local patch, this
   // will have to recreate the XLA pipeline. This may also be wiser in the long
-  // term so we don't waste compile time running LLVM optimizations and code
-  // generation only to throw away the binary.
+  // term so we don't waste compile time on code generation only to throw away
+  // the binary.
   absl::StatusOr<xla::LocalClient *> local_client_or_error =
       xla::ClientLibrary::GetOrCreateLocalClient();
   if (!local_client_or_error.ok()) {
@@ -354,6 +511,15 @@ compile_mhlo_to_llvm_with_xla(llvm::StringRef mhlo_text, std::string &output,
 
   xla::ExecutableBuildOptions build_options;
   build_options.mutable_debug_options()->set_xla_embed_ir_in_executable(true);
+  if (!optimize_llvm) {
+    // Only the emitted IR and the buffer assignment are used, and the IR is
+    // optimized again once it is linked into its Enzyme wrapper. Skip XLA's
+    // LLVM optimizations and generate the discarded binary at -O0.
+    build_options.mutable_debug_options()->set_xla_backend_optimization_level(
+        0);
+    build_options.mutable_debug_options()
+        ->set_xla_llvm_disable_expensive_passes(true);
+  }
 
   build_options.mutable_debug_options()
       ->mutable_xla_backend_extra_options()
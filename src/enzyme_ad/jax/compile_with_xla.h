@@ -5,15 +5,26 @@
 
 #include <utility>
 
-// Compile an MHLO module given as a string to LLVM IR using XLA.
+// Compile an MHLO module given as text or bytecode to LLVM IR using XLA. Unless
+// `optimize_llvm` is set, the IR is returned as emitted by XLA, without running
+// XLA's LLVM optimization pipeline on it.
 std::unique_ptr<xla::LocalExecutable>
 compile_mhlo_to_llvm_with_xla(llvm::StringRef mhlo_text, std::string &output,
                               bool xla_runtime,
-                              const std::string &pass_pipeline);
+                              const std::string &pass_pipeline,
+                              bool optimize_llvm = false);
 
+// Runs `pass_pipeline` on a module given as text or bytecode and renames its
+// symbols apart from `oldsyms`. Returns the name of the entry function and the
+// resulting module, as bytecode if `bytecode` is set and as text otherwise.
 std::pair<std::string, std::string>
 run_pass_pipeline(const std::vector<std::string> &oldsyms,
-                  const std::string &mlir, const std::string &pass_pipeline);
+                  llvm::StringRef mlir, const std::string &pass_pipeline,
+                  bool bytecode = false);
+
+// Returns a module given as text or bytecode as MLIR assembly, for error
+// messages. Bytecode that cannot be parsed is replaced by a short description.
+std::string print_mlir_source(llvm::StringRef mlir);
 
 namespace mlir {
 class Operation;
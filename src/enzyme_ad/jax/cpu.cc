@@ -1,6 +1,7 @@
-#include "xla/service/custom_call_status.h"
-#include "xla/service/custom_call_target_registry.h"
-#include <cstring>
+#include "xla/ffi/api/ffi.h"
+#include "xla/ffi/ffi_api.h"
+#include <string_view>
+#include <vector>
 
 #if (defined(_WIN32) || defined(__CYGWIN__)) &&                                \
     !defined(MLIR_CAPI_ENABLE_WINDOWS_DLL_DECLSPEC)
@@ -28,26 +29,51 @@ template <> struct CallInfo<true> {
   char *(*run)(const void **);
 };
 
+namespace ffi = xla::ffi;
+
+// The results alias the arguments, so only the arguments are forwarded.
 template <bool withError>
-void forwarding_custom_call(void *out, const void **in, const void *opaque_ptr,
-                            size_t opaque_len, XlaCustomCallStatus *status) {
-  const CallInfo<withError> *opaque =
-      static_cast<const CallInfo<withError> *>(opaque_ptr);
+ffi::Error execute(ffi::RemainingArgs args, ffi::RemainingRets rets,
+                   std::string_view attr) {
+  auto *cinfo = reinterpret_cast<const CallInfo<withError> *>(attr.data());
+
+  size_t numargs = args.size();
+  std::vector<void *> ptrs(numargs);
+  for (size_t i = 0; i < numargs; i++) {
+    auto buffer = args.get<ffi::AnyBuffer>(i);
+    if (buffer.has_error())
+      return buffer.error();
+    ptrs[i] = buffer->untyped_data();
+  }
+
+  const void **const_ptrs = const_cast<const void **>(ptrs.data());
 
   if constexpr (withError) {
-    char *err = opaque->run(in);
-    if (err) {
-      XlaCustomCallStatusSetFailure(status, err, strlen(err));
-    }
+    char *err = cinfo->run(const_ptrs);
+    if (err)
+      return ffi::Error(ffi::ErrorCode::kInternal, err);
   } else {
-    opaque->run(in);
+    cinfo->run(const_ptrs);
   }
+  return ffi::Error::Success();
 }
 
+XLA_FFI_DEFINE_HANDLER(kExecute, execute<false>,
+                       ffi::Ffi::Bind()
+                           .RemainingArgs()
+                           .RemainingRets()
+                           .Attr<std::string_view>("attr"));
+
+XLA_FFI_DEFINE_HANDLER(kExecuteWithError, execute<true>,
+                       ffi::Ffi::Bind()
+                           .RemainingArgs()
+                           .RemainingRets()
+                           .Attr<std::string_view>("attr"));
+
 extern "C" MLIR_CAPI_EXPORTED void RegisterEnzymeXLACPUHandler() {
-  xla::CustomCallTargetRegistry::Global()->Register(
-      "enzymexla_compile_cpu", (void *)&forwarding_custom_call<false>, "Host");
-  xla::CustomCallTargetRegistry::Global()->Register(
-      "enzymexla_compile_cpu_with_error", (void *)&forwarding_custom_call<true>,
-      "Host");
+  ffi::Ffi::RegisterStaticHandler(ffi::GetXlaFfiApi(), "enzymexla_compile_cpu",
+                                  "Host", kExecute);
+  ffi::Ffi::RegisterStaticHandler(ffi::GetXlaFfiApi(),
+                                  "enzymexla_compile_cpu_with_error", "Host",
+                                  kExecuteWithError);
 }
@@ -9,9 +9,13 @@
 #include "src/enzyme_ad/jax/Passes/Passes.h"
 #include "src/enzyme_ad/jax/TransformOps/TransformOps.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <functional>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <regex>
 #include <string>
@@ -19,7 +23,10 @@
 #include "absl/status/statusor.h"
 #include "clang_compile.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/Core.h"
 #include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
@@ -35,7 +42,9 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Mutex.h"
 #include "llvm/Support/RWMutex.h"
+#include "llvm/Support/SHA256.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/raw_ostream.h"
@@ -62,6 +71,8 @@
 #include "xla/mlir_hlo/transforms/passes.h"
 
 #include "compile_with_xla.h"
+#include "xla/ffi/api/ffi.h"
+#include "xla/ffi/ffi_api.h"
 #include "xla/hlo/ir/hlo_casting_utils.h"
 #include "xla/hlo/ir/hlo_instructions.h"
 #include "xla/service/cpu/cpu_executable.h"
@@ -76,11 +87,62 @@
 
 #include "stablehlo/transforms/Passes.h"
 
-enum class ABI { Primal, Forward, Augmented, Reverse, Tape };
+enum class ABI { Primal, Forward, Augmented, Reverse };
 
 enum class Language : int { CPP = 0, LLVM = 1, MHLO = 2 };
 
+extern "C" void enzymexla_parallel_for(int64_t n,
+                                       void (*body)(int64_t, int64_t, void *),
+                                       void *closure);
+
 namespace {
+// A string keyed cache that evicts its least recently used entry once it
+// holds more than `capacity` entries.
+template <typename T> class LRUCache {
+public:
+  explicit LRUCache(size_t capacity) : capacity(capacity) {}
+
+  T *lookup(llvm::StringRef key) {
+    auto found = entries.find(key);
+    if (found == entries.end())
+      return nullptr;
+    order.splice(order.begin(), order, found->second.second);
+    return &found->second.first;
+  }
+
+  T &insert(llvm::StringRef key, T value) {
+    auto [it, inserted] =
+        entries.try_emplace(key, std::move(value), order.end());
+    if (!inserted) {
+      order.splice(order.begin(), order, it->second.second);
+      return it->second.first;
+    }
+    order.push_front(it->getKey());
+    it->second.second = order.begin();
+    if (entries.size() > capacity) {
+      entries.erase(order.back());
+      order.pop_back();
+    }
+    return it->second.first;
+  }
+
+private:
+  size_t capacity;
+  // Most recently used first, the keys are owned by `entries`.
+  std::list<llvm::StringRef> order;
+  llvm::StringMap<std::pair<T, std::list<llvm::StringRef>::iterator>> entries;
+};
+
+// Cache key of a kernel: the digest of its (length prefixed) options followed
+// by its source, so that the caches do not hold on to a copy of every source.
+std::string getCacheKey(llvm::StringRef fields, llvm::StringRef source) {
+  llvm::SHA256 hasher;
+  hasher.update(fields);
+  hasher.update(source);
+  auto digest = hasher.final();
+  return std::string(digest.begin(), digest.end());
+}
+
 class CpuKernel {
   // static llvm::orc::ExecutionSession ES;
   static std::unique_ptr<llvm::DataLayout> DL;
@@ -107,15 +169,155 @@ public:
     return s + ">";
   }
 
+  // An MHLO module compiled by XLA, shared by every ABI variant and the
+  // temporary buffer size query of the same kernel.
+  struct XLACompilation {
+    std::unique_ptr<xla::LocalExecutable> executable;
+    std::string llvm_ir;
+  };
+
+  // A kernel compiled and differentiated by Enzyme. It is kept as bitcode so
+  // that every user gets its own module in a fresh context.
+  struct CompiledModule {
+    std::string bitcode;
+    size_t num_out;
+    size_t tmpBuf;
+  };
+
+  static llvm::SmallVector<std::string> getArgv(PyObject *pyargv) {
+    llvm::SmallVector<std::string> pyargv_strs;
+    assert(PySequence_Check(pyargv));
+    auto sz = PySequence_Size(pyargv);
+    for (Py_ssize_t i = 0; i < sz; ++i) {
+      PyObject *item = PySequence_GetItem(pyargv, i);
+#if PY_VERSION_HEX < 0x03000000
+      auto argv = PyString_AsString(item);
+#else
+      auto argv = PyUnicode_AsUTF8(item);
+#endif
+      Py_DECREF(item);
+      assert(argv);
+      pyargv_strs.emplace_back(argv);
+#if PY_VERSION_HEX < 0x03000000
+      free(argv);
+#else
+      // should not free py3+
+#endif
+    }
+    return pyargv_strs;
+  }
+
+  static std::shared_ptr<XLACompilation>
+  compileMHLO(llvm::StringRef source, bool xla_runtime,
+              const std::string &pass_pipeline) {
+    std::string fields;
+    llvm::raw_string_ostream ks(fields);
+    ks << xla_runtime << ";" << pass_pipeline.size() << ":" << pass_pipeline;
+    std::string key = getCacheKey(ks.str(), source);
+    {
+      llvm::sys::SmartScopedLock<true> lock(cache_mutex);
+      if (auto *found = xla_cache.lookup(key))
+        return *found;
+    }
+
+    // Compile without holding the lock, racing compilations of the same
+    // module are wasteful but harmless.
+    auto compiled = std::make_shared<XLACompilation>();
+    compiled->executable = compile_mhlo_to_llvm_with_xla(
+        source, compiled->llvm_ir, xla_runtime, pass_pipeline);
+    llvm::sys::SmartScopedLock<true> lock(cache_mutex);
+    return xla_cache.insert(key, std::move(compiled));
+  }
+
+  // Returns the module of a kernel, compiling and differentiating it only the
+  // first time it is requested with the same source, shapes and options.
+  static std::tuple<std::unique_ptr<llvm::Module>,
+                    std::unique_ptr<llvm::LLVMContext>, size_t, size_t>
+  getLLVMMod(std::string fn, llvm::StringRef source,
+             llvm::ArrayRef<llvm::SmallVector<int64_t>> out_shapes,
+             llvm::ArrayRef<std::string> out_names,
+             llvm::ArrayRef<llvm::SmallVector<int64_t>> in_shapes,
+             llvm::ArrayRef<std::string> in_names, PyObject *pyargv, ABI mode,
+             Language lang, bool xla_runtime, const std::string &pass_pipeline,
+             const KernelCompileOptions &options) {
+    auto argv = getArgv(pyargv);
+
+    std::string fields;
+    llvm::raw_string_ostream ks(fields);
+    auto addField = [&](llvm::StringRef str) {
+      ks << str.size() << ":" << str;
+    };
+    auto addTensors = [&](llvm::ArrayRef<llvm::SmallVector<int64_t>> shapes,
+                          llvm::ArrayRef<std::string> names) {
+      ks << shapes.size() << ";";
+      for (auto [shape, name] : llvm::zip_equal(shapes, names)) {
+        addField(name);
+        ks << shape.size();
+        for (auto dim : shape)
+          ks << "," << dim;
+        ks << ";";
+      }
+    };
+    ks << (int)mode << ";" << (int)lang << ";" << xla_runtime << ";";
+    addField(pass_pipeline);
+    addField(fn);
+    addTensors(out_shapes, out_names);
+    addTensors(in_shapes, in_names);
+    ks << argv.size() << ";";
+    for (auto &arg : argv)
+      addField(arg);
+    ks << options.frontendOptLevel << ";" << options.optLevel << ";";
+    addField(options.targetCPU);
+    addField(options.targetFeatures);
+    ks << options.fastMath << ";" << options.vectorize << ";"
+       << options.preferVectorWidth << ";";
+    std::string key = getCacheKey(ks.str(), source);
+
+    {
+      llvm::sys::SmartScopedLock<true> lock(cache_mutex);
+      if (auto *found = module_cache.lookup(key)) {
+        auto &cached = *found;
+        auto llvm_ctx = std::make_unique<llvm::LLVMContext>();
+        auto mod = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(cached.bitcode, "<cached>"), *llvm_ctx);
+        if (!mod) {
+          llvm::errs() << mod.takeError() << "\n";
+          throw nanobind::value_error("failed to load cached kernel");
+        }
+        return std::make_tuple(std::move(mod.get()), std::move(llvm_ctx),
+                               cached.num_out, cached.tmpBuf);
+      }
+    }
+
+    auto [mod, llvm_ctx, num_out, tmpBuf] =
+        createLLVMMod(fn, source, out_shapes, out_names, in_shapes, in_names,
+                      argv, mode, lang, xla_runtime, pass_pipeline, options);
+
+    CompiledModule compiled;
+    compiled.num_out = num_out;
+    compiled.tmpBuf = tmpBuf;
+    llvm::raw_string_ostream bs(compiled.bitcode);
+    llvm::WriteBitcodeToFile(*mod, bs);
+    bs.flush();
+    {
+      llvm::sys::SmartScopedLock<true> lock(cache_mutex);
+      module_cache.insert(key, std::move(compiled));
+    }
+    return std::make_tuple(std::move(mod), std::move(llvm_ctx), num_out,
+                           tmpBuf);
+  }
+
   static std::tuple<std::unique_ptr<llvm::Module>,
                     std::unique_ptr<llvm::LLVMContext>, size_t, size_t>
   createLLVMMod(std::string fn, llvm::StringRef source,
                 llvm::ArrayRef<llvm::SmallVector<int64_t>> out_shapes,
                 llvm::ArrayRef<std::string> out_names,
                 llvm::ArrayRef<llvm::SmallVector<int64_t>> in_shapes,
-                llvm::ArrayRef<std::string> in_names, PyObject *pyargv,
-                ABI mode, Language lang, bool xla_runtime,
-                const std::string &pass_pipeline) {
+                llvm::ArrayRef<std::string> in_names,
+                llvm::ArrayRef<std::string> pyargv_strs, ABI mode,
+                Language lang, bool xla_runtime,
+                const std::string &pass_pipeline,
+                const KernelCompileOptions &options) {
     auto llvm_ctx = std::make_unique<llvm::LLVMContext>();
 
     std::string input;
@@ -125,8 +327,8 @@ public:
     ss << "#include <enzyme/utils>\n";
 
     std::unique_ptr<llvm::Module> linkMod;
-    std::unique_ptr<xla::LocalExecutable> local_executable;
-    std::string stringbuf;
+    std::shared_ptr<XLACompilation> compiled;
+    xla::LocalExecutable *local_executable = nullptr;
 
     size_t tmpBuf = 0;
     llvm::StringRef origSource = source;
@@ -136,8 +338,8 @@ public:
       break;
 
     case Language::MHLO: {
-      local_executable = compile_mhlo_to_llvm_with_xla(
-          source, stringbuf, xla_runtime, pass_pipeline);
+      compiled = compileMHLO(source, xla_runtime, pass_pipeline);
+      local_executable = compiled->executable.get();
       auto *cpu_executable = static_cast<xla::cpu::CpuExecutable *>(
           local_executable->executable());
       auto &assignment = cpu_executable->buffer_assignment();
@@ -152,10 +354,9 @@ public:
           std::string err_str;
           llvm::raw_string_ostream ss(err_str);
           ss << assignment.ToString() << "\n";
-          ss << source << "\n";
           ss << " Number of mhlo inputs (" << num_in
              << ") != number of jax inputs (" << in_shapes.size() << "):\n";
-          ss << source << "\n";
+          ss << print_mlir_source(source) << "\n";
           throw nanobind::value_error(ss.str().c_str());
         }
         for (size_t i = 0; i < in_shapes.size(); i++) {
@@ -173,12 +374,12 @@ public:
             llvm::raw_string_ostream ss(err_str);
             ss << " Could not find input parameter (" << i
                << ") as hlo parameter:\n";
-            ss << source << "\n";
+            ss << print_mlir_source(source) << "\n";
             throw nanobind::value_error(ss.str().c_str());
           }
         }
       }
-      source = stringbuf;
+      source = compiled->llvm_ir;
       if (xla_runtime)
         tmpBuf = 0;
       else
@@ -219,8 +420,7 @@ public:
             // data. Otherwise invariant_load allows Enzyme to assume it need
             // not cache, and it is illegal for us to pass in nullptr as the
             // primal (since it may be needed).
-            if (mode == ABI::Augmented || mode == ABI::Reverse ||
-                mode == ABI::Tape) {
+            if (mode == ABI::Augmented || mode == ABI::Reverse) {
               for (auto &BB : F2)
                 for (auto &I : BB)
                   if (auto LI = llvm::dyn_cast<llvm::LoadInst>(&I))
@@ -523,7 +723,7 @@ public:
               std::string err;
               llvm::raw_string_ostream ess(err);
               ess << " Failed to compile mhlo, unknown buffer type\n";
-              ess << origSource << "\n";
+              ess << print_mlir_source(origSource) << "\n";
               ess << source << "\n";
               ess << local_executable->executable()->module().ToString()
                   << "\n";
@@ -613,11 +813,8 @@ public:
       ss << "}\n";
       fn = "entry_wrap";
     }
-    if (mode == ABI::Tape)
-      ss << "extern \"C\" std::size_t entry() {\n";
-    else
-      ss << "extern \"C\" void entry(void** __restrict__ outs, void** "
-            "__restrict__ ins) {\n";
+    ss << "extern \"C\" void entry(void** __restrict__ outs, void** "
+          "__restrict__ ins) {\n";
     size_t out_off = 0;
     size_t in_off = 0;
 
@@ -628,7 +825,7 @@ public:
     }
 
     for (size_t i = 0; i < out_shapes.size(); i++) {
-      if (mode != ABI::Reverse && mode != ABI::Tape) {
+      if (mode != ABI::Reverse) {
         ss << " " << make_type(out_names[i], out_shapes[i], false, lang)
            << "& out_" << i << " = "
            << "*(" << make_type(out_names[i], out_shapes[i], false, lang)
@@ -652,7 +849,7 @@ public:
     }
 
     for (size_t i = 0; i < in_shapes.size(); i++) {
-      if (mode != ABI::Reverse && mode != ABI::Tape) {
+      if (mode != ABI::Reverse) {
         ss << " " << make_type(in_names[i], in_shapes[i], true, lang) << "& in_"
            << i << " = "
            << "*(" << make_type(in_names[i], in_shapes[i], true, lang)
@@ -679,7 +876,7 @@ public:
          << "*(void**)outs[" << out_off << "];\n";
       out_off++;
     }
-    if (mode != ABI::Tape && mode != ABI::Reverse && tmpBuf != 0) {
+    if (mode != ABI::Reverse && tmpBuf != 0) {
       ss << " enzyme::tensor<char, " << tmpBuf << ">& tmpBuf = "
          << "*(enzyme::tensor<char, " << tmpBuf << ">*)outs[" << out_off
          << "];\n";
@@ -819,10 +1016,16 @@ public:
         ss << "(void*)&dout_" << i;
       }
       ss << ");\n";
-    } else if (mode == ABI::Tape) {
-      // outs, tapeout
-      // ins
-      ss << "  std::size_t tapesize = enzyme::__enzyme_augmentsize(" << fn;
+    } else {
+      assert(0 && "unhandled mode");
+    }
+    ss << "}\n";
+
+    // Also export the tape size of the augmented forward pass, so that the
+    // tape size query and the augmented kernel share one compilation.
+    if (mode == ABI::Augmented) {
+      ss << "extern \"C\" std::size_t entry_tapesize() {\n";
+      ss << "  return enzyme::__enzyme_augmentsize(" << fn;
       for (size_t i = 0; i < out_shapes.size(); i++) {
         ss << ", enzyme_dup";
       }
@@ -833,34 +1036,12 @@ public:
         ss << ", enzyme_dup";
       }
       ss << ");\n";
-      ss << "  return tapesize;\n";
-    } else {
-      assert(0 && "unhandled mode");
-    }
-    ss << "}\n";
-
-    llvm::SmallVector<std::string> pyargv_strs;
-    assert(PySequence_Check(pyargv));
-    auto sz = PySequence_Size(pyargv);
-    for (Py_ssize_t i = 0; i < sz; ++i) {
-      PyObject *item = PySequence_GetItem(pyargv, i);
-#if PY_VERSION_HEX < 0x03000000
-      auto argv = PyString_AsString(item);
-#else
-      auto argv = PyUnicode_AsUTF8(item);
-#endif
-      Py_DECREF(item);
-      assert(argv);
-      pyargv_strs.emplace_back(argv);
-#if PY_VERSION_HEX < 0x03000000
-      free(argv);
-#else
-      // should not free py3+
-#endif
+      ss << "}\n";
     }
 
     auto mod = GetLLVMFromJob("/enzyme_call/source.cpp", ss.str(), /*cpp*/ true,
-                              pyargv_strs, llvm_ctx.get(), std::move(linkMod));
+                              pyargv_strs, llvm_ctx.get(), std::move(linkMod),
+                              /*prelude*/ true, options);
     if (!mod) {
       llvm::errs() << "Source:\n" << ss.str() << "\n";
       throw nanobind::value_error("failed to compile C++");
@@ -876,12 +1057,13 @@ public:
                   llvm::ArrayRef<llvm::SmallVector<int64_t>> in_shapes,
                   llvm::ArrayRef<std::string> in_names, PyObject *pyargv,
                   Language lang, bool xla_runtime,
-                  const std::string &pass_pipeline) {
-    auto mode = ABI::Tape;
+                  const std::string &pass_pipeline,
+                  const KernelCompileOptions &options) {
+    auto mode = ABI::Augmented;
     auto [mod, llvm_ctx, num_out, tmpBuf] =
-        createLLVMMod(fn, source, out_shapes, out_names, in_shapes, in_names,
-                      pyargv, mode, lang, xla_runtime, pass_pipeline);
-    auto lfn = mod->getFunction("entry");
+        getLLVMMod(fn, source, out_shapes, out_names, in_shapes, in_names,
+                   pyargv, mode, lang, xla_runtime, pass_pipeline, options);
+    auto lfn = mod->getFunction("entry_tapesize");
     auto RI =
         llvm::cast<llvm::ReturnInst>(lfn->getEntryBlock().getTerminator());
     auto val = llvm::cast<llvm::ConstantInt>(RI->getReturnValue());
@@ -895,11 +1077,9 @@ public:
                          bool xla_runtime, const std::string &pass_pipeline) {
     switch (lang) {
     case Language::MHLO: {
-      std::string llvm_ir;
-      auto local_executable = compile_mhlo_to_llvm_with_xla(
-          source, llvm_ir, xla_runtime, pass_pipeline);
+      auto compiled = compileMHLO(source, xla_runtime, pass_pipeline);
       auto *cpu_executable = static_cast<xla::cpu::CpuExecutable *>(
-          local_executable->executable());
+          compiled->executable->executable());
       auto &assignment = cpu_executable->buffer_assignment();
       return assignment.temp_allocation_total_size();
     }
@@ -915,15 +1095,15 @@ public:
          llvm::ArrayRef<llvm::SmallVector<int64_t>> in_shapes,
          llvm::ArrayRef<std::string> in_names, PyObject *pyargv, ABI mode,
          Language lang, bool xla_runtime, const std::string &pass_pipeline,
-         const std::string &platform) {
+         const KernelCompileOptions &options, const std::string &platform) {
     if (platform != "cpu")
       return std::make_tuple(UNKNOWN_PLATFORM, 0);
     llvm::sys::SmartScopedWriter<true> lock(kernel_mutex);
     size_t identifier = last_identifier++;
 
     auto [mod, llvm_ctx, num_out, tmpBuf] =
-        createLLVMMod(fn, source, out_shapes, out_names, in_shapes, in_names,
-                      pyargv, mode, lang, xla_runtime, pass_pipeline);
+        getLLVMMod(fn, source, out_shapes, out_names, in_shapes, in_names,
+                   pyargv, mode, lang, xla_runtime, pass_pipeline, options);
 
     if (!JIT) {
       DL = std::make_unique<llvm::DataLayout>(mod->getDataLayoutStr());
@@ -956,6 +1136,17 @@ public:
       }
       JIT = std::move(tJIT.get());
       assert(JIT);
+
+      // Runtime functions used by the <enzyme/utils> prelude.
+      llvm::orc::SymbolMap runtime;
+      runtime[JIT->mangleAndIntern("enzymexla_parallel_for")] = {
+          llvm::orc::ExecutorAddr::fromPtr(&enzymexla_parallel_for),
+          llvm::JITSymbolFlags::Exported};
+      if (auto Err = JIT->getMainJITDylib().define(
+              llvm::orc::absoluteSymbols(std::move(runtime)))) {
+        llvm::errs() << " error " << Err << "\n";
+        throw nanobind::value_error("failed to define runtime symbols");
+      }
     }
 
     auto LibA = JIT->createJITDylib("enzymedl_" + std::to_string(identifier));
@@ -994,11 +1185,7 @@ public:
     return it->getSecond().get();
   }
 
-  void call(void *out, void **ins) const {
-    void **outs = num_out > 1 ? reinterpret_cast<void **>(out) : &out;
-    for (int i = 0; i < num_out; i++) {
-      void *data = outs[i];
-    }
+  void call(void **outs, void **ins) const {
     auto fn = (void (*)(void **outs, void **ins))addr;
     fn(outs, ins);
   }
@@ -1007,35 +1194,171 @@ private:
   static llvm::DenseMap<int64_t, std::unique_ptr<CpuKernel>> kernels;
   static size_t last_identifier;
   static llvm::sys::SmartRWMutex<true> kernel_mutex;
+  // Bounds on the number of cached compilations, so that a long running
+  // process tracing many distinct kernels does not grow without limit.
+  static constexpr size_t XLA_CACHE_SIZE = 64;
+  static constexpr size_t MODULE_CACHE_SIZE = 256;
+  static LRUCache<std::shared_ptr<XLACompilation>> xla_cache;
+  static LRUCache<CompiledModule> module_cache;
+  static llvm::sys::SmartMutex<true> cache_mutex;
 };
 
 llvm::DenseMap<int64_t, std::unique_ptr<CpuKernel>> CpuKernel::kernels;
 size_t CpuKernel::last_identifier = 1;
 llvm::sys::SmartRWMutex<true> CpuKernel::kernel_mutex;
+LRUCache<std::shared_ptr<CpuKernel::XLACompilation>>
+    CpuKernel::xla_cache(CpuKernel::XLA_CACHE_SIZE);
+LRUCache<CpuKernel::CompiledModule>
+    CpuKernel::module_cache(CpuKernel::MODULE_CACHE_SIZE);
+llvm::sys::SmartMutex<true> CpuKernel::cache_mutex;
 std::unique_ptr<llvm::DataLayout> CpuKernel::DL;
 std::unique_ptr<llvm::orc::LLJIT> CpuKernel::JIT = nullptr;
 // llvm::orc::ExecutionSession
 // CpuKernel::ES(std::move(*llvm::orc::SelfExecutorProcessControl::Create()));
 } // namespace
 
-void Callback(void *out, void **ins, void *opaque, size_t opaque_len,
-              void *status) {
-  int64_t identifier = *reinterpret_cast<int64_t *>(ins[0]);
-  CpuKernel *kernel = CpuKernel::get(identifier);
-  if (!kernel) {
-    if (identifier == CpuKernel::UNKNOWN_PLATFORM) {
-      throw nanobind::value_error(
-          "Unknown platform callback could not be executed");
+namespace ffi = xla::ffi;
+
+// The kernel run by a jaxzyme custom call, bound when XLA instantiates the
+// call rather than looked up on every execution.
+struct KernelState {
+  static ffi::TypeId id;
+  CpuKernel *kernel;
+};
+
+ffi::TypeId KernelState::id = {};
+
+XLA_FFI_REGISTER_TYPE(ffi::GetXlaFfiApi(), "enzymexla_cpu_kernel",
+                      &KernelState::id);
+
+// The intra-op thread pool of the custom call running on this thread.
+static thread_local ffi::ThreadPool *current_thread_pool = nullptr;
+
+namespace {
+// A parallel loop shared by the calling thread and the pool tasks helping it.
+// Chunks are claimed from `next`, so the loop completes even if none of the
+// scheduled tasks ever gets to run, e.g. when the pool is busy running the
+// callers of other parallel loops.
+struct ParallelForState {
+  int64_t n;
+  int64_t numChunks;
+  void (*body)(int64_t, int64_t, void *);
+  void *closure;
+  std::atomic<int64_t> next{0};
+  std::atomic<int64_t> remaining;
+  std::mutex mutex;
+  std::condition_variable done;
+
+  // Runs unclaimed chunks until none is left. Loops nested in a chunk run
+  // sequentially.
+  void runChunks() {
+    ffi::ThreadPool *pool = current_thread_pool;
+    current_thread_pool = nullptr;
+    for (int64_t chunk = next++; chunk < numChunks; chunk = next++) {
+      body(n * chunk / numChunks, n * (chunk + 1) / numChunks, closure);
+      if (--remaining == 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.notify_one();
+      }
     }
-    // TODO: find a way to fail more gracefully.
-    llvm::report_fatal_error("couldn't find enzyme kernel");
+    current_thread_pool = pool;
+  }
+};
+} // namespace
+
+// Splits [0, n) into one chunk per thread of the intra-op thread pool. The
+// calling thread runs chunks itself until all are claimed and then waits only
+// for the chunks other threads already started. Outside of a custom call, and
+// within a chunk, the loop runs sequentially.
+extern "C" void enzymexla_parallel_for(int64_t n,
+                                       void (*body)(int64_t, int64_t, void *),
+                                       void *closure) {
+  ffi::ThreadPool *pool = current_thread_pool;
+  int64_t numChunks = pool ? std::min<int64_t>(n, pool->num_threads() + 1) : 1;
+  if (numChunks <= 1) {
+    body(0, n, closure);
+    return;
   }
-  kernel->call(out, ins + 1);
+
+  // Tasks may start after the loop has returned, so they share ownership.
+  auto state = std::make_shared<ParallelForState>();
+  state->n = n;
+  state->numChunks = numChunks;
+  state->body = body;
+  state->closure = closure;
+  state->remaining = numChunks;
+  for (int64_t task = 1; task < numChunks; task++)
+    pool->Schedule([state] { state->runChunks(); });
+  state->runChunks();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done.wait(lock, [&] { return state->remaining == 0; });
+}
+
+static ffi::ErrorOr<std::unique_ptr<KernelState>>
+KernelInstantiate(int64_t identifier) {
+  if (identifier == CpuKernel::UNKNOWN_PLATFORM)
+    return ffi::Unexpected(
+        ffi::Error(ffi::ErrorCode::kUnimplemented,
+                   "Unknown platform callback could not be executed"));
+  CpuKernel *kernel = CpuKernel::get(identifier);
+  if (!kernel)
+    return ffi::Unexpected(ffi::Error(ffi::ErrorCode::kNotFound,
+                                      "couldn't find enzyme kernel"));
+  return std::make_unique<KernelState>(KernelState{kernel});
 }
 
+static ffi::Error KernelExecute(ffi::ThreadPool thread_pool,
+                                KernelState *state, ffi::RemainingArgs args,
+                                ffi::RemainingRets rets) {
+  llvm::SmallVector<void *, 8> ins(args.size());
+  for (size_t i = 0; i < args.size(); i++) {
+    auto buffer = args.get<ffi::AnyBuffer>(i);
+    if (buffer.has_error())
+      return buffer.error();
+    ins[i] = buffer->untyped_data();
+  }
+  llvm::SmallVector<void *, 8> outs(rets.size());
+  for (size_t i = 0; i < rets.size(); i++) {
+    auto buffer = rets.get<ffi::AnyBuffer>(i);
+    if (buffer.has_error())
+      return buffer.error();
+    outs[i] = (*buffer)->untyped_data();
+  }
+
+  current_thread_pool = &thread_pool;
+  state->kernel->call(outs.data(), ins.data());
+  current_thread_pool = nullptr;
+  return ffi::Error::Success();
+}
+
+XLA_FFI_DEFINE_HANDLER(kKernelInstantiate, KernelInstantiate,
+                       ffi::Ffi::BindInstantiate().Attr<int64_t>("identifier"));
+
+XLA_FFI_DEFINE_HANDLER(kKernelExecute, KernelExecute,
+                       ffi::Ffi::Bind()
+                           .Ctx<ffi::ThreadPool>()
+                           .Ctx<ffi::State<KernelState>>()
+                           .RemainingArgs()
+                           .RemainingRets());
+
 extern "C" void RegisterEnzymeXLAGPUHandler();
 extern "C" void RegisterEnzymeXLACPUHandler();
 
+// Kernel sources are either str (C++, LLVM IR or MLIR text) or bytes (MLIR
+// bytecode). The returned reference is valid as long as `source` is alive.
+static llvm::StringRef getSource(const nanobind::object &source) {
+  if (nanobind::isinstance<nanobind::bytes>(source)) {
+    auto bytes = nanobind::borrow<nanobind::bytes>(source);
+    return llvm::StringRef(bytes.c_str(), bytes.size());
+  }
+  Py_ssize_t size;
+  const char *data = PyUnicode_AsUTF8AndSize(source.ptr(), &size);
+  if (!data)
+    throw nanobind::python_error();
+  return llvm::StringRef(data, size);
+}
+
 NB_MODULE(enzyme_call, m) {
   llvm::InitializeAllTargets();
   llvm::InitializeAllTargetMCs();
@@ -1077,15 +1400,26 @@ NB_MODULE(enzyme_call, m) {
       .value("Primal", ABI::Primal)
       .value("Forward", ABI::Forward)
       .value("Augmented", ABI::Augmented)
-      .value("Reverse", ABI::Reverse)
-      .value("Tape", ABI::Tape);
+      .value("Reverse", ABI::Reverse);
+
+  nanobind::class_<KernelCompileOptions>(m, "KernelCompileOptions")
+      .def(nanobind::init<>())
+      .def_rw("frontend_opt_level", &KernelCompileOptions::frontendOptLevel)
+      .def_rw("opt_level", &KernelCompileOptions::optLevel)
+      .def_rw("target_cpu", &KernelCompileOptions::targetCPU)
+      .def_rw("target_features", &KernelCompileOptions::targetFeatures)
+      .def_rw("fast_math", &KernelCompileOptions::fastMath)
+      .def_rw("vectorize", &KernelCompileOptions::vectorize)
+      .def_rw("prefer_vector_width",
+              &KernelCompileOptions::preferVectorWidth);
 
   m.def("create_enzyme_kernel",
-        [](const std::string &source, const std::string &fn,
+        [](nanobind::object source, const std::string &fn,
            const nanobind::list &py_out_shapes,
            const nanobind::list &py_in_shapes, nanobind::object pyargv,
            ABI mode, Language lang, bool xla_runtime,
            const std::string &pass_pipeline,
+           const KernelCompileOptions &options,
            const std::string &platform) -> std::tuple<size_t, size_t> {
           llvm::SmallVector<llvm::SmallVector<int64_t>> out_shapes;
           out_shapes.reserve(nanobind::len(py_out_shapes));
@@ -1120,23 +1454,25 @@ NB_MODULE(enzyme_call, m) {
               target.push_back(nanobind::cast<int64_t>(nested_element));
             }
           }
-          return CpuKernel::create(fn, source, out_shapes, out_types, in_shapes,
-                                   in_types, pyargv.ptr(), mode, (Language)lang,
-                                   xla_runtime, pass_pipeline, platform);
+          return CpuKernel::create(fn, getSource(source), out_shapes,
+                                   out_types, in_shapes, in_types, pyargv.ptr(),
+                                   mode, (Language)lang, xla_runtime,
+                                   pass_pipeline, options, platform);
         });
 
   m.def("tmp_size",
-        [](const std::string &source, Language lang, bool xla_runtime,
+        [](nanobind::object source, Language lang, bool xla_runtime,
            const std::string &pass_pipeline) -> size_t {
-          return CpuKernel::tempSize(source, (Language)lang, xla_runtime,
-                                     pass_pipeline);
+          return CpuKernel::tempSize(getSource(source), (Language)lang,
+                                     xla_runtime, pass_pipeline);
         });
 
   m.def("compile_to_llvm",
-        [](const std::string outfile, const std::string &source,
+        [](const std::string outfile, nanobind::object source,
            const std::string &fn, const nanobind::list &py_out_shapes,
            const nanobind::list &py_in_shapes, nanobind::object pyargv,
-           Language lang, bool xla_runtime, const std::string &pass_pipeline) {
+           Language lang, bool xla_runtime, const std::string &pass_pipeline,
+           const KernelCompileOptions &options) {
           llvm::SmallVector<llvm::SmallVector<int64_t>> out_shapes;
           out_shapes.reserve(nanobind::len(py_out_shapes));
           llvm::SmallVector<llvm::SmallVector<int64_t>> in_shapes;
@@ -1174,9 +1510,10 @@ NB_MODULE(enzyme_call, m) {
           std::error_code EC;
           llvm::raw_fd_ostream ostream(outfile, EC);
 
-          auto [mod, llvm_ctx, num_out, tmpBuf] = CpuKernel::createLLVMMod(
-              fn, source, out_shapes, out_types, in_shapes, in_types,
-              pyargv.ptr(), ABI::Primal, lang, xla_runtime, pass_pipeline);
+          auto [mod, llvm_ctx, num_out, tmpBuf] = CpuKernel::getLLVMMod(
+              fn, getSource(source), out_shapes, out_types, in_shapes, in_types,
+              pyargv.ptr(), ABI::Primal, lang, xla_runtime, pass_pipeline,
+              options);
 
           ostream << *mod;
           ostream.close();
@@ -1184,11 +1521,11 @@ NB_MODULE(enzyme_call, m) {
         });
 
   m.def("tape_and_tmp_size",
-        [](const std::string &source, const std::string &fn,
+        [](nanobind::object source, const std::string &fn,
            const nanobind::list &py_out_shapes,
            const nanobind::list &py_in_shapes, nanobind::object pyargv,
-           Language lang, bool xla_runtime,
-           const std::string &pass_pipeline) -> std::pair<size_t, size_t> {
+           Language lang, bool xla_runtime, const std::string &pass_pipeline,
+           const KernelCompileOptions &options) -> std::pair<size_t, size_t> {
           llvm::SmallVector<llvm::SmallVector<int64_t>> out_shapes;
           out_shapes.reserve(nanobind::len(py_out_shapes));
           llvm::SmallVector<llvm::SmallVector<int64_t>> in_shapes;
@@ -1223,22 +1560,29 @@ NB_MODULE(enzyme_call, m) {
             }
           }
           return CpuKernel::tapeAndTempSize(
-              fn, source, out_shapes, out_types, in_shapes, in_types,
-              pyargv.ptr(), (Language)lang, xla_runtime, pass_pipeline);
+              fn, getSource(source), out_shapes, out_types, in_shapes, in_types,
+              pyargv.ptr(), (Language)lang, xla_runtime, pass_pipeline,
+              options);
         });
 
-  m.def("get_callback", []() {
-    return nanobind::capsule(reinterpret_cast<void *>(&Callback),
-                             "xla._CUSTOM_CALL_TARGET");
+  m.def("get_ffi_handlers", []() {
+    nanobind::dict handlers;
+    handlers["instantiate"] =
+        nanobind::capsule(reinterpret_cast<void *>(kKernelInstantiate));
+    handlers["execute"] =
+        nanobind::capsule(reinterpret_cast<void *>(kKernelExecute));
+    return handlers;
   });
 
   m.def("optimize_module",
         [](MlirModule cmod, const std::string &pass_pipeline) {
           run_pass_pipeline(unwrap(cmod), pass_pipeline);
         });
+  // The module is returned in the form it was given in: text for str and
+  // bytecode for bytes.
   m.def("run_pass_pipeline",
-        [](nanobind::object pyoldsyms, const std::string &mlir,
-           const std::string &pass_pipeline) {
+        [](nanobind::object pyoldsyms, nanobind::object mlir,
+           const std::string &pass_pipeline) -> nanobind::tuple {
           auto pyargv = pyoldsyms.ptr();
           std::vector<std::string> oldsyms;
           assert(PySequence_Check(pyargv));
@@ -1259,7 +1603,13 @@ NB_MODULE(enzyme_call, m) {
       // should not free py3+
 #endif
           }
-          return run_pass_pipeline(oldsyms, mlir, pass_pipeline);
+          bool bytecode = nanobind::isinstance<nanobind::bytes>(mlir);
+          auto [entryfn, output] = run_pass_pipeline(
+              oldsyms, getSource(mlir), pass_pipeline, bytecode);
+          if (bytecode)
+            return nanobind::make_tuple(
+                entryfn, nanobind::bytes(output.data(), output.size()));
+          return nanobind::make_tuple(entryfn, output);
         });
 
   m.def("register_enzymexla_cpu_handler",
@@ -1269,11 +1619,11 @@ NB_MODULE(enzyme_call, m) {
         []() { RegisterEnzymeXLAGPUHandler(); });
 
   m.def("compile_mhlo_to_llvm_with_xla",
-        [](const std::string &mhlo_text, bool xla_runtime,
+        [](nanobind::object mhlo, bool xla_runtime,
            const std::string &pass_pipeline) {
           std::string llvm_ir;
-          compile_mhlo_to_llvm_with_xla(mhlo_text, llvm_ir, xla_runtime,
-                                        pass_pipeline);
+          compile_mhlo_to_llvm_with_xla(getSource(mhlo), llvm_ir, xla_runtime,
+                                        pass_pipeline, /*optimize_llvm*/ true);
           return llvm_ir;
         });
 }
@@ -3,6 +3,7 @@
 from functools import partial
 from collections.abc import Callable, Sequence
 from typing import Any
+import io
 import itertools
 import os
 import tempfile
@@ -29,11 +30,40 @@ LANG_MHLO = enzyme_call.Language.MHLO
 Primitive = jax.extend.core.Primitive
 
 try:
-    register_custom_call_target = partial(jax.ffi.register_ffi_target, api_version=0)
+    register_ffi_target = partial(jax.ffi.register_ffi_target, api_version=1)
 except AttributeError:
     from jax.lib import xla_client
 
-    register_custom_call_target = xla_client.register_custom_call_target
+    register_ffi_target = partial(xla_client.register_custom_call_target, api_version=1)
+
+
+def kernel_config(identifier):
+    # The kernel is looked up once, when XLA instantiates the custom call.
+    i64_type = ir.IntegerType.get_signless(64)
+    return ir.DictAttr.get({"identifier": ir.IntegerAttr.get(i64_type, identifier)})
+
+
+def compile_options(
+    *,
+    opt_level: int = 3,
+    frontend_opt_level: int = 1,
+    target_cpu: str = "",
+    target_features: str = "",
+    fast_math: bool = False,
+    vectorize: bool = True,
+    prefer_vector_width: int = 0,
+):
+    # Code generation options of the CPU kernels. target_cpu="native" tunes for
+    # the host and enables all of its features (e.g. AVX-512).
+    options = enzyme_call.KernelCompileOptions()
+    options.opt_level = opt_level
+    options.frontend_opt_level = frontend_opt_level
+    options.target_cpu = target_cpu
+    options.target_features = target_features
+    options.fast_math = fast_math
+    options.vectorize = vectorize
+    options.prefer_vector_width = prefer_vector_width
+    return options
 
 
 class PipelineConfig:
@@ -60,10 +90,15 @@ class PipelineConfig:
     def export_llvm(self):
         raise NotImplementedError()
 
+    # Code generation options of the compiled kernels
+    def compile_options(self):
+        raise NotImplementedError()
+
 
 class XLAPipeline:
-    def __init__(self, name=None):
+    def __init__(self, name=None, compile_options=None):
         self.exportname = name
+        self.options = compile_options
 
     def xla_runtime(self):
         return False
@@ -80,10 +115,14 @@ class XLAPipeline:
     def export_llvm(self):
         return self.exportname
 
+    def compile_options(self):
+        return self.options if self.options is not None else compile_options()
+
 
 class JaXPipeline:
-    def __init__(self, passes=""):
+    def __init__(self, passes="", compile_options=None):
         self.passes = passes
+        self.options = compile_options
 
     def pass_pipeline(self):
         return self.passes
@@ -97,6 +136,9 @@ class JaXPipeline:
     def ad_level(self):
         return self.passes.count("enzyme-wrap")
 
+    def compile_options(self):
+        return self.options if self.options is not None else compile_options()
+
 
 def optimization_passes(
     *,
@@ -115,6 +157,8 @@ def optimization_passes(
     enable_concat_to_batch_passes: bool = True,
     enable_loop_raising_passes: bool = True,
     aggressive_propagation: bool = True,
+    reassociate_float: bool = False,
+    layout_assignment: bool = True,
 ):
     transform_passes_list = [
         "compare_op_canon<16>",
@@ -244,12 +288,15 @@ def optimization_passes(
         "while_deadresult",
         "while_idempotent_dus",
         "while_dus",
+        "while_fusion",
+        "while_condition_canonicalize",
         "while_op_induction_replacement",
         "dus_concat",
         "slice_dus_to_concat",
         "hoist_slice",
         "sink_dus",
         "while_induction_reduction",
+        f"while_scan_to_reduce_window({int(reassociate_float)})",
         "slice_broadcast",
         "associative_common_mul_op_reordering",
         "slice_select_to_select_slice",
@@ -474,6 +521,7 @@ def optimization_passes(
             "extend_licm(0)",
             "wrap_licm(0)",
             "rotate_licm(0)",
+            "region_licm(1024)",
         ]
 
     if enable_scatter_gather_optimization_passes:
@@ -669,7 +717,10 @@ def optimization_passes(
         ]
     )
 
-    func_passes = ",".join(["canonicalize", "cse", "canonicalize", transform_passes])
+    func_passes = ["canonicalize", "cse", "canonicalize", transform_passes]
+    if transpose_propagate == "up" and layout_assignment:
+        func_passes += ["enzyme-hlo-layout-assignment", "canonicalize"]
+    func_passes = ",".join(func_passes)
 
     if inline:
         func_passes = (
@@ -680,7 +731,7 @@ def optimization_passes(
 
 # TODO: implement options similar to ones in Reactant for benchmarking
 #       currently we mimic the `:all` option from Reactant
-def full_optimization_pass_pipeline(**kwargs):
+def full_optimization_pass_pipeline(*, schedule_search: bool = False, **kwargs):
     opt_passes = optimization_passes(**kwargs)
 
     enzyme_pass = 'enzyme{postpasses="arith-raise{stablehlo=true},enzyme-batch-to-stablehlo,canonicalize,cse,canonicalize,remove-unnecessary-enzyme-ops,enzyme-simplify-math,canonicalize,cse,canonicalize"}'
@@ -694,7 +745,7 @@ def full_optimization_pass_pipeline(**kwargs):
             **kwargs, transpose_propagate="down", reshape_propagate="down"
         )
 
-    return ",".join(
+    passes = ",".join(
         [
             "mark-func-memory-effects",
             opt_passes,
@@ -709,6 +760,9 @@ def full_optimization_pass_pipeline(**kwargs):
             propagate_down_passes,
         ]
     )
+    if schedule_search:
+        passes += ",enzyme-hlo-schedule-search"
+    return passes
 
 
 DefaultCPPPipeline = XLAPipeline()
@@ -905,7 +959,7 @@ def _enzyme_aug_abstract_eval(
         jit_options = dict(jit_options)
         lowered_func = lower(jax.jit(mfunc, **jit_options), avals_in, kwargs=avals_inkw)
         mhlo = lowered_func.compiler_ir(dialect="stablehlo")
-        source = mhlo.operation.get_asm(enable_debug_info=True)
+        source = module_bytecode(mhlo)
         kept = lowered_func.compile()._executable._kept_var_idx
         in_shapes = [shape for (i, shape) in enumerate(in_shapes) if i in kept]
 
@@ -920,6 +974,7 @@ def _enzyme_aug_abstract_eval(
         lang,
         pipeline_options.xla_runtime(),
         pipeline_options.pass_pipeline(),
+        pipeline_options.compile_options(),
     )
     res = tuple(prev_out_shapes) + (
         jax.core.ShapedArray((tapeSize,), (jax.numpy.int8)),
@@ -1005,6 +1060,26 @@ def ret_activity_from_pipeline(pass_pipeline):
     return pre_act, acts, post_act
 
 
+def module_bytecode(module):
+    # Modules are handed to enzyme_call as bytecode, which is much cheaper to
+    # write and parse than text for modules with large constants.
+    buffer = io.BytesIO()
+    module.operation.write_bytecode(buffer)
+    return buffer.getvalue()
+
+
+def _source_asm(source):
+    # Sources handed to enzyme_call may be bytecode, which is unreadable in
+    # error messages. Bytecode written by a different MLIR version may fail to
+    # parse, in which case only its size is reported.
+    if not isinstance(source, bytes):
+        return str(source)
+    try:
+        return ir.Module.parse(source).operation.get_asm(enable_debug_info=True)
+    except Exception as e:
+        return f"<{len(source)} bytes of unparseable MLIR bytecode: {e}>"
+
+
 def _dump_mlir_to_file(source, pass_pipeline):
     # bazel will zip up the outputs in this directory
     dump_mlir_dir = os.environ.get("TEST_UNDECLARED_OUTPUTS_DIR", None)
@@ -1016,7 +1091,7 @@ def _dump_mlir_to_file(source, pass_pipeline):
     )
     with open(tmpfile.name, "w") as f:
         f.write("// " + pass_pipeline + "\n")
-        f.write(str(source))
+        f.write(_source_asm(source))
 
     return tmpfile.name
 
@@ -1083,7 +1158,7 @@ def _enzyme_primal_lowering(
                 kwargs=avals_inkw,
             )
             mhlo = lowered_func.compiler_ir(dialect="stablehlo")
-            source = mhlo.operation.get_asm(enable_debug_info=True)
+            source = module_bytecode(mhlo)
             kept = lowered_func.compile()._executable._kept_var_idx
         in_args = tuple(
             arg
@@ -1128,13 +1203,13 @@ def _enzyme_primal_lowering(
                 logging.exception("Enzyme MLIR dumped to %s", filename)
                 raise e
 
+            nmod = ir.Module.parse(nmod)
+
             if print_mlir:
                 if not isinstance(print_mlir, bool):
-                    print_mlir.write(nmod)
+                    print_mlir.write(str(nmod))
                 else:
                     print(str(nmod), flush=True)
-
-            nmod = ir.Module.parse(nmod)
             fn = None
             pushtop = []
             for f in nmod.body:
@@ -1150,7 +1225,7 @@ def _enzyme_primal_lowering(
                     + " in post opt module "
                     + str(nmod)
                     + ", pre opt module was "
-                    + str(source)
+                    + _source_asm(source)
                     + ' pipeline was "'
                     + pass_pipeline
                     + '"'
@@ -1172,7 +1247,7 @@ def _enzyme_primal_lowering(
                 callop = func.CallOp(fn, list(in_args))
                 results = callop.results
             if len(results) != len(out_shapes):
-                print(source)
+                print(_source_asm(source))
                 print(pass_pipeline)
                 print(str(nmod))
                 print(out_shapes, "\n", results, "\n", nmod)
@@ -1189,12 +1264,11 @@ def _enzyme_primal_lowering(
                 lang,
                 pipeline_options.xla_runtime(),
                 pass_pipeline,
+                pipeline_options.compile_options(),
                 ctx.module_context.platforms[0],
             )
-            identifier_attr = jax_mlir.dense_int_elements([identifier])
-            identifier_op = stablehlo.ConstantOp(identifier_attr)
 
-            mlir_args = (identifier_op,) + in_args
+            mlir_args = in_args
 
             if tmpBuf != 0:
                 sa = ir.RankedTensorType.get((tmpBuf,), ir.IntegerType.get_signless(8))
@@ -1205,8 +1279,8 @@ def _enzyme_primal_lowering(
                 out_types,
                 mlir_args,
                 call_target_name="jaxzyme.primal",
-                backend_config=ir.StringAttr.get("backend"),
-                api_version=ir.IntegerAttr.get(i32_type, 3),
+                backend_config=kernel_config(identifier),
+                api_version=ir.IntegerAttr.get(i32_type, 4),
             )
             results = tuple(t for t in custom_call.results)
 
@@ -1241,12 +1315,11 @@ def _enzyme_primal_lowering(
             lang,
             pipeline_options.xla_runtime(),
             pass_pipeline,
+            pipeline_options.compile_options(),
             ctx.module_context.platforms[0],
         )
-        identifier_attr = jax_mlir.dense_int_elements([identifier])
-        identifier_op = stablehlo.ConstantOp(identifier_attr)
 
-        mlir_args = (identifier_op,) + in_args
+        mlir_args = in_args
 
         if tmpBuf != 0:
             sa = ir.RankedTensorType.get((tmpBuf,), ir.IntegerType.get_signless(8))
@@ -1257,8 +1330,8 @@ def _enzyme_primal_lowering(
             out_types,
             mlir_args,
             call_target_name="jaxzyme.primal",
-            backend_config=ir.StringAttr.get("backend"),
-            api_version=ir.IntegerAttr.get(i32_type, 3),
+            backend_config=kernel_config(identifier),
+            api_version=ir.IntegerAttr.get(i32_type, 4),
         )
 
         results = custom_call.results
@@ -1298,7 +1371,7 @@ def _enzyme_fwd_lowering(
         jit_options = dict(jit_options)
         lowered_func = lower(jax.jit(mfunc, **jit_options), avals_in, kwargs=avals_inkw)
         mhlo = lowered_func.compiler_ir(dialect="stablehlo")
-        source = mhlo.operation.get_asm(enable_debug_info=True)
+        source = module_bytecode(mhlo)
         kept = lowered_func.compile()._executable._kept_var_idx
         in_args = tuple(arg for (i, arg) in enumerate(in_args) if i // 2 in kept)
         in_shapes = [shape for (i, shape) in enumerate(in_shapes) if i in kept]
@@ -1315,12 +1388,11 @@ def _enzyme_fwd_lowering(
         lang,
         pipeline_options.xla_runtime(),
         pipeline_options.pass_pipeline(),
+        pipeline_options.compile_options(),
         ctx.module_context.platforms[0],
     )
-    identifier_attr = jax_mlir.dense_int_elements([identifier])
-    identifier_op = stablehlo.ConstantOp(identifier_attr)
 
-    mlir_args = (identifier_op,) + in_args
+    mlir_args = in_args
 
     if tmpBuf != 0:
         sa = ir.RankedTensorType.get((tmpBuf,), ir.IntegerType.get_signless(8))
@@ -1331,8 +1403,8 @@ def _enzyme_fwd_lowering(
         out_types,
         mlir_args,
         call_target_name="jaxzyme.fwd",
-        backend_config=ir.StringAttr.get("backend"),
-        api_version=ir.IntegerAttr.get(i32_type, 3),
+        backend_config=kernel_config(identifier),
+        api_version=ir.IntegerAttr.get(i32_type, 4),
     )
 
     results = custom_call.results
@@ -1370,7 +1442,7 @@ def _enzyme_aug_lowering(
         jit_options = dict(jit_options)
         lowered_func = lower(jax.jit(mfunc, **jit_options), avals_in, kwargs=avals_inkw)
         mhlo = lowered_func.compiler_ir(dialect="stablehlo")
-        source = mhlo.operation.get_asm(enable_debug_info=True)
+        source = module_bytecode(mhlo)
         kept = lowered_func.compile()._executable._kept_var_idx
         in_args = tuple(arg for (i, arg) in enumerate(in_args) if i in kept)
         in_shapes = [shape for (i, shape) in enumerate(in_shapes) if i in kept]
@@ -1387,24 +1459,23 @@ def _enzyme_aug_lowering(
         lang,
         pipeline_options.xla_runtime(),
         pipeline_options.pass_pipeline(),
+        pipeline_options.compile_options(),
         ctx.module_context.platforms[0],
     )
-    identifier_attr = jax_mlir.dense_int_elements([identifier])
-    identifier_op = stablehlo.ConstantOp(identifier_attr)
 
     if tmpBuf != 0:
         sa = ir.RankedTensorType.get((tmpBuf,), ir.IntegerType.get_signless(8))
         out_types = out_types + (sa,)
 
-    mlir_args = (identifier_op,) + in_args
+    mlir_args = in_args
 
     i32_type = ir.IntegerType.get_signless(32)
     custom_call = stablehlo.CustomCallOp(
         out_types,
         mlir_args,
         call_target_name="jaxzyme.aug",
-        backend_config=ir.StringAttr.get("backend"),
-        api_version=ir.IntegerAttr.get(i32_type, 3),
+        backend_config=kernel_config(identifier),
+        api_version=ir.IntegerAttr.get(i32_type, 4),
     )
 
     results = custom_call.results
@@ -1446,7 +1517,7 @@ def _enzyme_rev_lowering(
         jit_options = dict(jit_options)
         lowered_func = lower(jax.jit(mfunc, **jit_options), avals_in, kwargs=avals_inkw)
         mhlo = lowered_func.compiler_ir(dialect="stablehlo")
-        source = mhlo.operation.get_asm(enable_debug_info=True)
+        source = module_bytecode(mhlo)
         kept = lowered_func.compile()._executable._kept_var_idx
         # in_args = tuple(arg for (i, arg) in enumerate(in_args) if i in kept)
         in_shapes = [shape for (i, shape) in enumerate(in_shapes) if i in kept]
@@ -1466,12 +1537,11 @@ def _enzyme_rev_lowering(
         lang,
         pipeline_options.xla_runtime(),
         pipeline_options.pass_pipeline(),
+        pipeline_options.compile_options(),
         ctx.module_context.platforms[0],
     )
-    identifier_attr = jax_mlir.dense_int_elements([identifier])
-    identifier_op = stablehlo.ConstantOp(identifier_attr)
 
-    mlir_args = (identifier_op,) + in_args
+    mlir_args = in_args
 
     if tmpBuf != 0:
         sa = ir.RankedTensorType.get((tmpBuf,), ir.IntegerType.get_signless(8))
@@ -1482,8 +1552,8 @@ def _enzyme_rev_lowering(
         rev_return_types,
         mlir_args,
         call_target_name="jaxzyme.rev",
-        backend_config=ir.StringAttr.get("backend"),
-        api_version=ir.IntegerAttr.get(i32_type, 3),
+        backend_config=kernel_config(identifier),
+        api_version=ir.IntegerAttr.get(i32_type, 4),
     )
     results = custom_call.results
     if tmpBuf != 0:
@@ -1616,7 +1686,7 @@ _enzyme_primal_p.def_impl(_enzyme_primal_impl)
 _enzyme_primal_p.def_abstract_eval(_enzyme_primal_abstract_eval)
 jax_mlir.register_lowering(_enzyme_primal_p, _enzyme_primal_lowering)
 
-register_custom_call_target("jaxzyme.primal", enzyme_call.get_callback())
+register_ffi_target("jaxzyme.primal", enzyme_call.get_ffi_handlers())
 
 _enzyme_fwd_p = Primitive("enzyme_fwd")
 _enzyme_fwd_p.multiple_results = True
@@ -1624,7 +1694,7 @@ _enzyme_fwd_p.def_impl(_enzyme_fwd_impl)
 _enzyme_fwd_p.def_abstract_eval(_enzyme_fwd_abstract_eval)
 jax_mlir.register_lowering(_enzyme_fwd_p, _enzyme_fwd_lowering)
 
-register_custom_call_target("jaxzyme.fwd", enzyme_call.get_callback())
+register_ffi_target("jaxzyme.fwd", enzyme_call.get_ffi_handlers())
 
 
 def enzyme_jvp(arg_primals, arg_tangents, **kwargs):
@@ -1683,7 +1753,9 @@ def enzyme_jvp(arg_primals, arg_tangents, **kwargs):
                 newpasses = prev_passes + afterad + newpasses + oldpasses[end:]
             else:
                 newpasses = newpasses + "," + oldpasses
-        pipeline_options = JaXPipeline(newpasses)
+        pipeline_options = JaXPipeline(
+            newpasses, pipeline_options.compile_options()
+        )
         outshapes2 = []
         for o in outshapes:
             outshapes2.append(o)
@@ -1742,10 +1814,10 @@ _enzyme_aug_p.def_impl(_enzyme_aug_impl)
 _enzyme_aug_p.def_abstract_eval(_enzyme_aug_abstract_eval)
 jax_mlir.register_lowering(_enzyme_aug_p, _enzyme_aug_lowering)
 
-register_custom_call_target("jaxzyme.aug", enzyme_call.get_callback(), platform="cpu")
-register_custom_call_target("jaxzyme.aug", enzyme_call.get_callback(), platform="CUDA")
-register_custom_call_target("jaxzyme.aug", enzyme_call.get_callback(), platform="ROCM")
-register_custom_call_target("jaxzyme.aug", enzyme_call.get_callback(), platform="tpu")
+register_ffi_target("jaxzyme.aug", enzyme_call.get_ffi_handlers(), platform="cpu")
+register_ffi_target("jaxzyme.aug", enzyme_call.get_ffi_handlers(), platform="CUDA")
+register_ffi_target("jaxzyme.aug", enzyme_call.get_ffi_handlers(), platform="ROCM")
+register_ffi_target("jaxzyme.aug", enzyme_call.get_ffi_handlers(), platform="tpu")
 
 _enzyme_shadow_aug_p = Primitive("enzyme_shadow_aug")
 _enzyme_shadow_aug_p.multiple_results = True
@@ -1758,10 +1830,10 @@ _enzyme_rev_p.def_impl(_enzyme_rev_impl)
 _enzyme_rev_p.def_abstract_eval(_enzyme_rev_abstract_eval)
 jax_mlir.register_lowering(_enzyme_rev_p, _enzyme_rev_lowering)
 
-register_custom_call_target("jaxzyme.rev", enzyme_call.get_callback(), platform="cpu")
-register_custom_call_target("jaxzyme.rev", enzyme_call.get_callback(), platform="CUDA")
-register_custom_call_target("jaxzyme.rev", enzyme_call.get_callback(), platform="ROCM")
-register_custom_call_target("jaxzyme.rev", enzyme_call.get_callback(), platform="tpu")
+register_ffi_target("jaxzyme.rev", enzyme_call.get_ffi_handlers(), platform="cpu")
+register_ffi_target("jaxzyme.rev", enzyme_call.get_ffi_handlers(), platform="CUDA")
+register_ffi_target("jaxzyme.rev", enzyme_call.get_ffi_handlers(), platform="ROCM")
+register_ffi_target("jaxzyme.rev", enzyme_call.get_ffi_handlers(), platform="tpu")
 
 
 def fwd_partial_eval(trace, *args, **kwargs):
@@ -1834,7 +1906,7 @@ def primal_partial_eval(trace, *args, **kwargs):
     post_passes = passes[end + 1 :]
     newpasses = prev_passes + post_passes[1:]
 
-    pipeline_options = JaXPipeline(newpasses)
+    pipeline_options = JaXPipeline(newpasses, pipeline_options.compile_options())
 
     outmap2 = {k // 2: v for k, v in out_idx_map.items() if k % 2 == 0}
     source = (in_tree, tuple(avals.items()), tuple(outmap2.items()), mfunc, jit_options)
@@ -1901,7 +1973,9 @@ def enzyme_vjp(shadow_rets, *prim_args, **kwargs):
             + post_passes
         )
 
-        pipeline_options = JaXPipeline(newpasses)
+        pipeline_options = JaXPipeline(
+            newpasses, pipeline_options.compile_options()
+        )
 
         in_tree, in_idx_map, out_idx_map, mfunc, jit_options = kwargs["source"]
         in_idx_map = dict(in_idx_map)
@@ -1969,7 +2043,10 @@ def enzyme_vjp(shadow_rets, *prim_args, **kwargs):
 ad.primitive_transposes[_enzyme_shadow_aug_p] = enzyme_vjp
 
 
-def export(outfile, func, *args, argv=(), jit_options={}):
+def export(outfile, func, *args, argv=(), jit_options={}, compile_options=None):
+    if compile_options is None:
+        compile_options = DefaultJaXPipeline.compile_options()
+
     def zero_like(arg):
         if arg.dtype == jax.float0:
             return arg
@@ -1988,7 +2065,7 @@ def export(outfile, func, *args, argv=(), jit_options={}):
     )
     lowered_func = lower(jitres, avals_in)
     mhlo = lowered_func.compiler_ir(dialect="stablehlo")
-    source = mhlo.operation.get_asm(enable_debug_info=True)
+    source = module_bytecode(mhlo)
     kept = lowered_func.compile()._executable._kept_var_idx
     in_shapes = [shape for (i, shape) in enumerate(in_shapes) if i in kept]
     xla_runtime = False
@@ -2004,6 +2081,7 @@ def export(outfile, func, *args, argv=(), jit_options={}):
         lang,
         xla_runtime,
         pass_pipeline,
+        compile_options,
     )
     return
 
@@ -21,6 +21,7 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
 
 #include "src/enzyme_ad/jax/RegistryUtils.h"
 #include "llvm/Support/TargetSelect.h"
@@ -54,7 +55,18 @@ extern "C" std::string runLLVMToMLIRRoundTrip(std::string input,
   mlir::enzyme::registerInterfaces(registry);
   mlir::enzyme::initializePasses();
 
-  mlir::MLIRContext context(registry);
+  // Function-local raising passes run in parallel on the context thread pool.
+  // REACTANT_RAISE_THREADS limits its size, 1 disables multithreading.
+  unsigned numThreads = 0;
+  if (auto threads = getenv("REACTANT_RAISE_THREADS"))
+    numThreads = atoi(threads);
+  std::unique_ptr<llvm::DefaultThreadPool> threadPool;
+  mlir::MLIRContext context(registry, mlir::MLIRContext::Threading::DISABLED);
+  if (numThreads != 1) {
+    threadPool = std::make_unique<llvm::DefaultThreadPool>(
+        llvm::hardware_concurrency(numThreads));
+    context.setThreadPool(*threadPool);
+  }
   auto mod = mlir::translateLLVMIRToModule(std::move(llvmModule), &context,
                                            /*emitExpensiveWarnings*/ false,
                                            /*dropDICompositeElements*/ false);
@@ -84,7 +96,8 @@ extern "C" std::string runLLVMToMLIRRoundTrip(std::string input,
   // clang-format off
   std::string pass_pipeline =
       "inline{default-pipeline=canonicalize "
-      "max-iterations=4},sroa-wrappers{set_private=false attributor=false},"
+      "max-iterations=4},"
+      "sroa-wrappers{set_private=false attributor=false native=true},"
       "tessera-annotation-to-attribute,func-attr-to-tessera-attr,gpu-launch-"
       "recognition{backend=";
   pass_pipeline += backend;
@@ -96,24 +109,30 @@ extern "C" std::string runLLVMToMLIRRoundTrip(std::string input,
     pass_pipeline += "parallel-lower{wrapParallelOps=false},";
   else
     pass_pipeline += "parallel-lower{wrapParallelOps=true},";
-  pass_pipeline += "llvm-to-"
-      "memref-access,polygeist-mem2reg,canonicalize,convert-llvm-to-cf,"
-      "canonicalize,polygeist-mem2reg,canonicalize,enzyme-lift-cf-to-scf,"
-      "canonicalize,"
-      "func.func(canonicalize-loops),"
-      "llvm.func(canonicalize-loops),"
-      "canonicalize-scf-for,"
-      "canonicalize,affine-cfg,canonicalize,"
-      "func.func(canonicalize-loops),"
-      "llvm.func(canonicalize-loops),"
-      "canonicalize,llvm-to-affine-access,"
-      "canonicalize,delinearize-indexing,canonicalize,simplify-affine-exprs,"
-      "affine-cfg,canonicalize,llvm-to-affine-access,canonicalize,"
-      "func.func(affine-loop-invariant-code-motion),"
-      "canonicalize,sort-memory,";
+  pass_pipeline += "llvm-to-memref-access,";
+  // The remaining raising passes are local to a function, so they are nested
+  // to let the pass manager process independent functions (e.g. the kernels
+  // of a large library) in parallel. canonicalize-scf-for is kept at module
+  // level since it also erases llvm.func declarations.
+  auto nestFunctionPasses = [](StringRef passes) {
+    return ("func.func(" + passes + "),llvm.func(" + passes + "),").str();
+  };
+  pass_pipeline += nestFunctionPasses(
+      "polygeist-mem2reg,canonicalize,convert-llvm-to-cf,canonicalize,"
+      "polygeist-mem2reg,canonicalize,enzyme-lift-cf-to-scf,canonicalize,"
+      "canonicalize-loops");
+  pass_pipeline += "canonicalize-scf-for,";
+  pass_pipeline += nestFunctionPasses(
+      "canonicalize,affine-cfg,canonicalize,canonicalize-loops,canonicalize,"
+      "llvm-to-affine-access,canonicalize,delinearize-indexing,canonicalize,"
+      "simplify-affine-exprs,affine-cfg,canonicalize,llvm-to-affine-access,"
+      "canonicalize");
+  pass_pipeline += "func.func(affine-loop-invariant-code-motion,canonicalize,"
+      "sort-memory),llvm.func(sort-memory),";
   if (StringRef(backend).starts_with("xla")) {
       pass_pipeline += "raise-affine-to-stablehlo{prefer_while_raising=false "
-      "dump_failed_lockstep=true},canonicalize,arith-raise{stablehlo=true},"
+      "dump_failed_lockstep=true use_isl_dependences=true},canonicalize,"
+      "arith-raise{stablehlo=true},"
       "symbol-dce";
       if (outfile.size() && getenv("EXPORT_REACTANT")) {
         pass_pipeline += ",print{filename="+outfile+".mlir}";
@@ -165,6 +184,8 @@ extern "C" std::string runLLVMToMLIRRoundTrip(std::string input,
     llvm::errs() << " passes to run: " << pass_pipeline << "\n";
   }
   mlir::PassManager pm(mod->getContext());
+  if (getenv("REACTANT_RAISE_TIMING"))
+    pm.enableTiming();
   std::string error_message;
   llvm::raw_string_ostream error_stream(error_message);
   mlir::LogicalResult result =
@@ -0,0 +1,21 @@
+// RUN: enzymexlamlir-opt --convert-all-constants-to-splatted-constant %s | FileCheck %s
+
+func.func @main() -> (tensor<4xf32>, tensor<3xi1>) {
+    %c = stablehlo.constant dense_resource<floats> : tensor<4xf32>
+    %c1 = stablehlo.constant dense_resource<bools> : tensor<3xi1>
+    return %c, %c1 : tensor<4xf32>, tensor<3xi1>
+}
+
+{-#
+  dialect_resources: {
+    builtin: {
+      floats: "0x0400000000000040000040400000A0400000E040",
+      bools: "0x01000000010001"
+    }
+  }
+#-}
+
+// CHECK: func.func @main() -> (tensor<4xf32>, tensor<3xi1>) {
+// CHECK-DAG:     %[[F:.+]] = stablehlo.constant dense<2.000000e+00> : tensor<4xf32>
+// CHECK-DAG:     %[[B:.+]] = stablehlo.constant dense<true> : tensor<3xi1>
+// CHECK:     return %[[F]], %[[B]] : tensor<4xf32>, tensor<3xi1>
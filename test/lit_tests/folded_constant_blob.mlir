@@ -0,0 +1,25 @@
+// RUN: enzymexlamlir-opt %s --enzyme-hlo-opt=out_of_line_constant_bytes=8 | FileCheck %s
+
+module {
+  func.func @main() -> (tensor<4xf32>, tensor<2xf32>) {
+    %a = stablehlo.constant dense<[1.0, 2.0, 3.0, 4.0]> : tensor<4xf32>
+    %b = stablehlo.constant dense<[1.0, 1.0, 1.0, 1.0]> : tensor<4xf32>
+    %c = stablehlo.constant dense<[2.0, 2.0, 2.0, 3.0]> : tensor<4xf32>
+    %0 = stablehlo.add %a, %b : tensor<4xf32>
+    %1 = stablehlo.multiply %0, %c : tensor<4xf32>
+    %d = stablehlo.constant dense<[1.0, 2.0]> : tensor<2xf32>
+    %2 = stablehlo.negate %d : tensor<2xf32>
+    return %1, %2 : tensor<4xf32>, tensor<2xf32>
+  }
+}
+
+// CHECK:  func.func @main() -> (tensor<4xf32>, tensor<2xf32>) {
+// CHECK-DAG:     %[[A:.+]] = stablehlo.constant dense_resource<[[BLOB:enzyme_hlo_folded[_0-9]*]]> : tensor<4xf32>
+// CHECK-DAG:     %[[B:.+]] = stablehlo.constant dense<[-1.000000e+00, -2.000000e+00]> : tensor<2xf32>
+// CHECK:         return %[[A]], %[[B]] : tensor<4xf32>, tensor<2xf32>
+// CHECK-NEXT:  }
+
+// CHECK:      dialect_resources: {
+// CHECK-NEXT:   builtin: {
+// CHECK-NEXT:     [[BLOB]]: "0x10000000000080400000C0400000004100007041"
+// CHECK-NOT:    enzyme_hlo_folded
@@ -0,0 +1,121 @@
+// RUN: enzymexlamlir-opt --enzyme-hlo-layout-assignment --split-input-file %s | FileCheck %s
+
+// CHECK-LABEL: func.func @elementwise
+// CHECK-NOT:     stablehlo.transpose
+// CHECK:         %[[E:.+]] = stablehlo.exponential %arg0 : tensor<4x8xf32>
+// CHECK-NEXT:    %[[M:.+]] = stablehlo.multiply %[[E]], %[[E]] : tensor<4x8xf32>
+// CHECK-NEXT:    return %[[M]]
+func.func @elementwise(%a: tensor<4x8xf32>) -> tensor<4x8xf32> {
+  %t = stablehlo.transpose %a, dims = [1, 0] : (tensor<4x8xf32>) -> tensor<8x4xf32>
+  %e = stablehlo.exponential %t : tensor<8x4xf32>
+  %m = stablehlo.multiply %e, %e : tensor<8x4xf32>
+  %r = stablehlo.transpose %m, dims = [1, 0] : (tensor<8x4xf32>) -> tensor<4x8xf32>
+  return %r : tensor<4x8xf32>
+}
+
+// -----
+
+// The ordering is propagated through the loop-carried value.
+
+// CHECK-LABEL: func.func @loop
+// CHECK-NOT:     stablehlo.transpose
+// CHECK:         %[[W:.+]]:2 = stablehlo.while(%{{.+}} = %{{.+}}, %[[X:.+]] = %arg0) : tensor<i64>, tensor<4x8xf32>
+// CHECK:         } do {
+// CHECK:           stablehlo.exponential %[[X]] : tensor<4x8xf32>
+// CHECK:         return %[[W]]#1 : tensor<4x8xf32>
+func.func @loop(%a: tensor<4x8xf32>) -> tensor<4x8xf32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c10 = stablehlo.constant dense<10> : tensor<i64>
+  %t = stablehlo.transpose %a, dims = [1, 0] : (tensor<4x8xf32>) -> tensor<8x4xf32>
+  %0:2 = stablehlo.while(%i = %c0, %x = %t) : tensor<i64>, tensor<8x4xf32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %c10 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %y = stablehlo.exponential %x : tensor<8x4xf32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %y : tensor<i64>, tensor<8x4xf32>
+  }
+  %r = stablehlo.transpose %0#1, dims = [1, 0] : (tensor<8x4xf32>) -> tensor<4x8xf32>
+  return %r : tensor<4x8xf32>
+}
+
+// -----
+
+// The returned value fixes the ordering, so removing the transpose of the
+// input would only move it to the output.
+
+// CHECK-LABEL: func.func @boundary
+// CHECK-NEXT:    %[[T:.+]] = stablehlo.transpose %arg0, dims = [1, 0]
+// CHECK-NEXT:    %[[E:.+]] = stablehlo.exponential %[[T]] : tensor<8x4xf32>
+// CHECK-NEXT:    return %[[E]]
+func.func @boundary(%a: tensor<4x8xf32>) -> tensor<8x4xf32> {
+  %t = stablehlo.transpose %a, dims = [1, 0] : (tensor<4x8xf32>) -> tensor<8x4xf32>
+  %e = stablehlo.exponential %t : tensor<8x4xf32>
+  return %e : tensor<8x4xf32>
+}
+
+// -----
+
+// The use of %e by the return keeps the original ordering while the transpose
+// user folds away, and only the former gets a transpose back.
+
+// CHECK-LABEL: func.func @mixed_users
+// CHECK-NEXT:    %[[E:.+]] = stablehlo.exponential %arg0 : tensor<4x8xf32>
+// CHECK-NEXT:    %[[T:.+]] = stablehlo.transpose %[[E]], dims = [1, 0] : (tensor<4x8xf32>) -> tensor<8x4xf32>
+// CHECK-NEXT:    return %[[T]], %[[E]] : tensor<8x4xf32>, tensor<4x8xf32>
+func.func @mixed_users(%a: tensor<4x8xf32>) -> (tensor<8x4xf32>, tensor<4x8xf32>) {
+  %t = stablehlo.transpose %a, dims = [1, 0] : (tensor<4x8xf32>) -> tensor<8x4xf32>
+  %e = stablehlo.exponential %t : tensor<8x4xf32>
+  %r = stablehlo.transpose %e, dims = [1, 0] : (tensor<8x4xf32>) -> tensor<4x8xf32>
+  return %e, %r : tensor<8x4xf32>, tensor<4x8xf32>
+}
+
+// -----
+
+// dot_general reads its lhs in the ordering of the group by remapping its
+// contracting dimension.
+
+// CHECK-LABEL: func.func @dot
+// CHECK-NEXT:    %[[E:.+]] = stablehlo.exponential %arg0 : tensor<4x8xf32>
+// CHECK-NEXT:    %[[D:.+]] = stablehlo.dot_general %[[E]], %arg1, contracting_dims = [1] x [0] : (tensor<4x8xf32>, tensor<8x16xf32>) -> tensor<4x16xf32>
+// CHECK-NEXT:    return %[[D]]
+func.func @dot(%a: tensor<4x8xf32>, %b: tensor<8x16xf32>) -> tensor<4x16xf32> {
+  %t = stablehlo.transpose %a, dims = [1, 0] : (tensor<4x8xf32>) -> tensor<8x4xf32>
+  %e = stablehlo.exponential %t : tensor<8x4xf32>
+  %d = stablehlo.dot_general %e, %b, contracting_dims = [0] x [0] : (tensor<8x4xf32>, tensor<8x16xf32>) -> tensor<4x16xf32>
+  return %d : tensor<4x16xf32>
+}
+
+// -----
+
+// CHECK-LABEL: func.func @dot_batch
+// CHECK-NEXT:    %[[E:.+]] = stablehlo.exponential %arg0 : tensor<4x2x8xf32>
+// CHECK-NEXT:    %[[D:.+]] = stablehlo.dot_general %[[E]], %arg1, batching_dims = [1] x [0], contracting_dims = [2] x [1] : (tensor<4x2x8xf32>, tensor<2x8x16xf32>) -> tensor<2x4x16xf32>
+// CHECK-NEXT:    return %[[D]]
+func.func @dot_batch(%a: tensor<4x2x8xf32>, %b: tensor<2x8x16xf32>) -> tensor<2x4x16xf32> {
+  %t = stablehlo.transpose %a, dims = [1, 2, 0] : (tensor<4x2x8xf32>) -> tensor<2x8x4xf32>
+  %e = stablehlo.exponential %t : tensor<2x8x4xf32>
+  %d = stablehlo.dot_general %e, %b, batching_dims = [0] x [0], contracting_dims = [1] x [1] : (tensor<2x8x4xf32>, tensor<2x8x16xf32>) -> tensor<2x4x16xf32>
+  return %d : tensor<2x4x16xf32>
+}
+
+// -----
+
+// The reduction of the reordered input produces its result transposed, which
+// is the ordering its transpose user asks for. Both groups are reordered
+// together.
+
+// CHECK-LABEL: func.func @reduce
+// CHECK:         %[[E:.+]] = stablehlo.exponential %arg0 : tensor<4x8x16xf32>
+// CHECK-NEXT:    %[[R:.+]] = stablehlo.reduce(%[[E]] init: %{{.+}}) applies stablehlo.add across dimensions = [1] : (tensor<4x8x16xf32>, tensor<f32>) -> tensor<4x16xf32>
+// CHECK-NEXT:    return %[[R]]
+func.func @reduce(%a: tensor<4x8x16xf32>) -> tensor<4x16xf32> {
+  %zero = stablehlo.constant dense<0.000000e+00> : tensor<f32>
+  %t = stablehlo.transpose %a, dims = [2, 1, 0] : (tensor<4x8x16xf32>) -> tensor<16x8x4xf32>
+  %e = stablehlo.exponential %t : tensor<16x8x4xf32>
+  %r = stablehlo.reduce(%e init: %zero) applies stablehlo.add across dimensions = [1] : (tensor<16x8x4xf32>, tensor<f32>) -> tensor<16x4xf32>
+  %s = stablehlo.transpose %r, dims = [1, 0] : (tensor<16x4xf32>) -> tensor<4x16xf32>
+  return %s : tensor<4x16xf32>
+}
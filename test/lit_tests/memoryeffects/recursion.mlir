@@ -0,0 +1,26 @@
+// RUN: enzymexlamlir-opt --pass-pipeline="builtin.module(mark-func-memory-effects{assume_no_memory_effects=true})" %s | FileCheck %s
+
+// The effects of mutually recursive functions are propagated through their
+// call graph SCC.
+
+// CHECK: func.func @even(%arg0: memref<4xf32> {enzymexla.memory_effects = ["read", "write"], llvm.nofree}, %arg1: index {enzymexla.memory_effects = []}) attributes {enzymexla.memory_effects = ["read", "write"]} {
+func.func @even(%m: memref<4xf32>, %i: index) {
+  %c = arith.constant 1.000000e+00 : f32
+  memref.store %c, %m[%i] : memref<4xf32>
+  func.call @odd(%m, %i) : (memref<4xf32>, index) -> ()
+  return
+}
+
+// CHECK: func.func @odd(%arg0: memref<4xf32> {enzymexla.memory_effects = ["read", "write"], llvm.nofree}, %arg1: index {enzymexla.memory_effects = []}) attributes {enzymexla.memory_effects = ["read", "write"]} {
+func.func @odd(%m: memref<4xf32>, %i: index) {
+  %v = memref.load %m[%i] : memref<4xf32>
+  func.call @even(%m, %i) : (memref<4xf32>, index) -> ()
+  return
+}
+
+// CHECK: func.func @main(%arg0: memref<4xf32> {enzymexla.memory_effects = ["read", "write"], llvm.nofree}) attributes {enzymexla.memory_effects = ["read", "write"]} {
+func.func @main(%m: memref<4xf32>) {
+  %c0 = arith.constant 0 : index
+  func.call @even(%m, %c0) : (memref<4xf32>, index) -> ()
+  return
+}
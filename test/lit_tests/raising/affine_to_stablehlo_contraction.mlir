@@ -0,0 +1,72 @@
+// RUN: enzymexlamlir-opt %s --raise-affine-to-stablehlo --canonicalize --split-input-file | FileCheck %s
+
+// CHECK-LABEL: func.func private @matmul_raised
+// CHECK-NOT: stablehlo.reduce_window
+// CHECK: stablehlo.dot_general %{{.*}}, %{{.*}}, contracting_dims = [1] x [0] : (tensor<4x3xf32>, tensor<3x5xf32>) -> tensor<4x5xf32>
+// CHECK-NOT: stablehlo.reduce_window
+
+module {
+  func.func private @matmul(%c: memref<4x5xf32>, %a: memref<4x3xf32>, %b: memref<3x5xf32>) {
+    affine.parallel (%i, %j) = (0, 0) to (4, 5) {
+      %init = affine.load %c[%i, %j] : memref<4x5xf32>
+      %r = affine.for %k = 0 to 3 iter_args(%acc = %init) -> (f32) {
+        %x = affine.load %a[%i, %k] : memref<4x3xf32>
+        %y = affine.load %b[%k, %j] : memref<3x5xf32>
+        %m = arith.mulf %x, %y : f32
+        %s = arith.addf %acc, %m : f32
+        affine.yield %s : f32
+      }
+      affine.store %r, %c[%i, %j] : memref<4x5xf32>
+    }
+    return
+  }
+}
+
+// -----
+
+// CHECK-LABEL: func.func private @batched_matvec_raised
+// CHECK: stablehlo.dot_general %{{.*}}, %{{.*}}, batching_dims = [0] x [0], contracting_dims = [1] x [1] : (tensor<2x8xf64>, tensor<2x8xf64>) -> tensor<2xf64>
+// CHECK: stablehlo.subtract
+
+module {
+  func.func private @batched_matvec(%c: memref<2xf64>, %a: memref<2x8xf64>, %b: memref<2x8xf64>) {
+    affine.parallel (%i) = (0) to (2) {
+      %init = affine.load %c[%i] : memref<2xf64>
+      %r = affine.for %k = 0 to 8 iter_args(%acc = %init) -> (f64) {
+        %x = affine.load %a[%i, %k] : memref<2x8xf64>
+        %y = affine.load %b[%i, %k] : memref<2x8xf64>
+        %m = arith.mulf %x, %y : f64
+        %s = arith.subf %acc, %m : f64
+        affine.yield %s : f64
+      }
+      affine.store %r, %c[%i] : memref<2xf64>
+    }
+    return
+  }
+}
+
+// -----
+
+// CHECK-LABEL: func.func private @conv1d_raised
+// CHECK: %[[IN:.+]] = stablehlo.slice %{{.*}} [0:2, 1:13] : (tensor<2x16xf32>) -> tensor<2x12xf32>
+// CHECK: %[[W:.+]] = stablehlo.reshape %{{.*}} : (tensor<3xf32>) -> tensor<3x1x1xf32>
+// CHECK: stablehlo.convolution(%{{.*}}, %[[W]]) dim_numbers = [b, 0, f]x[0, i, o]->[b, 0, f]
+// CHECK-SAME: (tensor<2x12x1xf32>, tensor<3x1x1xf32>) -> tensor<2x10x1xf32>
+// CHECK-NOT: stablehlo.reduce_window
+
+module {
+  func.func private @conv1d(%out: memref<2x10xf32>, %in: memref<2x16xf32>, %w: memref<3xf32>) {
+    affine.parallel (%b, %o) = (0, 0) to (2, 10) {
+      %init = affine.load %out[%b, %o] : memref<2x10xf32>
+      %r = affine.for %k = 0 to 3 iter_args(%acc = %init) -> (f32) {
+        %x = affine.load %in[%b, %o + %k + 1] : memref<2x16xf32>
+        %y = affine.load %w[%k] : memref<3xf32>
+        %m = arith.mulf %x, %y : f32
+        %s = arith.addf %acc, %m : f32
+        affine.yield %s : f32
+      }
+      affine.store %r, %out[%b, %o] : memref<2x10xf32>
+    }
+    return
+  }
+}
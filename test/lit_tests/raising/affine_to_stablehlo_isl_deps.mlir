@@ -0,0 +1,86 @@
+// RUN: enzymexlamlir-opt %s --raise-affine-to-stablehlo="use_isl_dependences=true" --split-input-file | FileCheck %s
+
+// The reduction through memory is promoted to an iter_arg and raised in
+// lockstep.
+
+// CHECK-LABEL: func.func private @memory_reduction_raised
+// CHECK-NOT: stablehlo.while
+// CHECK: stablehlo.reduce_window
+
+module {
+  func.func private @memory_reduction(%a: memref<10xf64>, %b: memref<10x20xf64>) {
+    affine.parallel (%j) = (0) to (10) {
+      affine.for %i = 0 to 20 {
+        %x = affine.load %b[%j, %i] : memref<10x20xf64>
+        %acc = affine.load %a[%j] : memref<10xf64>
+        %s = arith.addf %acc, %x : f64
+        affine.store %s, %a[%j] : memref<10xf64>
+      }
+    }
+    return
+  }
+}
+
+// -----
+
+// A prefix sum through memory is promoted to an iter_arg and raised to a
+// reduce_window scan.
+
+// CHECK-LABEL: func.func private @memory_scan_raised
+// CHECK-NOT: stablehlo.while
+// CHECK: stablehlo.reduce_window
+
+module {
+  func.func private @memory_scan(%a: memref<21xf64>, %b: memref<20xf64>) {
+    affine.for %i = 0 to 20 {
+      %x = affine.load %b[%i] : memref<20xf64>
+      %prev = affine.load %a[%i] : memref<21xf64>
+      %s = arith.addf %prev, %x : f64
+      affine.store %s, %a[%i + 1] : memref<21xf64>
+    }
+    return
+  }
+}
+
+// -----
+
+// The element written by the scan is read again in a later iteration, so the
+// recurrence cannot be promoted.
+
+// CHECK-LABEL: func.func private @memory_scan_reread_raised
+// CHECK: stablehlo.while
+
+module {
+  func.func private @memory_scan_reread(%a: memref<22xf64>, %b: memref<20xf64>) {
+    affine.for %i = 0 to 20 {
+      %x = affine.load %b[%i] : memref<20xf64>
+      %prev = affine.load %a[%i] : memref<22xf64>
+      %s = arith.addf %prev, %x : f64
+      affine.store %s, %a[%i + 1] : memref<22xf64>
+      %old = affine.load %a[%i + 2] : memref<22xf64>
+      affine.store %old, %b[%i] : memref<20xf64>
+    }
+    return
+  }
+}
+
+// -----
+
+// The outer loop contains a loop nest, which the affine lockstep analysis
+// does not handle, but carries no dependence.
+
+// CHECK-LABEL: func.func private @nested_parallel_raised
+// CHECK-NOT: stablehlo.while
+
+module {
+  func.func private @nested_parallel(%a: memref<10x20xf64>, %b: memref<10x20xf64>) {
+    affine.for %i = 0 to 10 {
+      affine.for %j = 0 to 20 {
+        %x = affine.load %b[%i, %j] : memref<10x20xf64>
+        %y = arith.mulf %x, %x : f64
+        affine.store %y, %a[%i, %j] : memref<10x20xf64>
+      }
+    }
+    return
+  }
+}
@@ -0,0 +1,78 @@
+// RUN: enzymexlamlir-opt --enzyme-hlo-generate-td="patterns=region_licm(1024)" --transform-interpreter --enzyme-hlo-remove-transform %s | FileCheck %s
+
+func.func @nested(%a: tensor<4x4xf32>, %b: tensor<4xf32>, %big: tensor<2048xf32>, %p: tensor<i1>) -> (tensor<4x4xf32>, tensor<2048xf32>) {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c8 = stablehlo.constant dense<8> : tensor<i64>
+  %0:4 = stablehlo.while(%i = %c0, %x = %a, %y = %b, %z = %big) : tensor<i64>, tensor<4x4xf32>, tensor<4xf32>, tensor<2048xf32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %c8 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %1:2 = stablehlo.while(%j = %c0, %acc = %x) : tensor<i64>, tensor<4x4xf32>
+     cond {
+      %cmp = stablehlo.compare LT, %j, %c8 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+      stablehlo.return %cmp : tensor<i1>
+    } do {
+      %two = stablehlo.constant dense<2.000000e+00> : tensor<4x4xf32>
+      %aa = stablehlo.multiply %a, %two : tensor<4x4xf32>
+      %s = stablehlo.add %acc, %aa : tensor<4x4xf32>
+      %next = stablehlo.add %j, %c1 : tensor<i64>
+      stablehlo.return %next, %s : tensor<i64>, tensor<4x4xf32>
+    }
+    %2:2 = "stablehlo.if"(%p) ({
+      %e = stablehlo.exponential %b : tensor<4xf32>
+      %t = stablehlo.add %y, %e : tensor<4xf32>
+      %l = stablehlo.log %big : tensor<2048xf32>
+      %u = stablehlo.add %z, %l : tensor<2048xf32>
+      stablehlo.return %t, %u : tensor<4xf32>, tensor<2048xf32>
+    }, {
+      stablehlo.return %y, %z : tensor<4xf32>, tensor<2048xf32>
+    }) : (tensor<i1>) -> (tensor<4xf32>, tensor<2048xf32>)
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %1#1, %2#0, %2#1 : tensor<i64>, tensor<4x4xf32>, tensor<4xf32>, tensor<2048xf32>
+  }
+  return %0#1, %0#3 : tensor<4x4xf32>, tensor<2048xf32>
+}
+
+// CHECK-LABEL: func.func @nested
+// CHECK:         %[[TWO:.+]] = stablehlo.constant dense<2.000000e+00> : tensor<4x4xf32>
+// CHECK-NEXT:    %[[AA:.+]] = stablehlo.multiply %arg0, %[[TWO]]
+// CHECK-NEXT:    %[[E:.+]] = stablehlo.exponential %arg1
+// CHECK-NEXT:    stablehlo.while
+// CHECK:           stablehlo.while
+// CHECK:             stablehlo.add %{{.+}}, %[[AA]]
+// CHECK:           "stablehlo.if"
+// CHECK-NEXT:        stablehlo.add %{{.+}}, %[[E]]
+// CHECK-NEXT:        stablehlo.log %arg2
+
+// Operations with regions and operations that are not speculatable stay in
+// the loop, which may not run at all.
+func.func @not_speculatable(%b: tensor<4xf32>, %d: tensor<?xf32>, %p: tensor<i1>, %n: tensor<i64>) -> (tensor<4xf32>, tensor<4xf32>) {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %0:3 = stablehlo.while(%i = %c0, %x = %b, %y = %b) : tensor<i64>, tensor<4xf32>, tensor<4xf32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %n : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %a = stablehlo.abs %d : (tensor<?xf32>) -> tensor<4xf32>
+    %s = stablehlo.add %x, %a : tensor<4xf32>
+    %2 = "stablehlo.if"(%p) ({
+      %e = stablehlo.negate %b : tensor<4xf32>
+      stablehlo.return %e : tensor<4xf32>
+    }, {
+      stablehlo.return %b : tensor<4xf32>
+    }) : (tensor<i1>) -> tensor<4xf32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %s, %2 : tensor<i64>, tensor<4xf32>, tensor<4xf32>
+  }
+  return %0#1, %0#2 : tensor<4xf32>, tensor<4xf32>
+}
+
+// CHECK-LABEL: func.func @not_speculatable
+// CHECK:         %[[NEG:.+]] = stablehlo.negate %arg0
+// CHECK-NEXT:    stablehlo.while
+// CHECK:           stablehlo.abs %arg1
+// CHECK:           "stablehlo.if"(%arg2)
+// CHECK-NEXT:        stablehlo.return %[[NEG]]
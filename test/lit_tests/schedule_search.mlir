@@ -0,0 +1,45 @@
+// RUN: enzymexlamlir-opt --enzyme-hlo-schedule-search="schedules=transpose_elementwise(0);transpose_transpose<16>" --split-input-file %s | FileCheck %s
+// RUN: enzymexlamlir-opt --enzyme-hlo-schedule-search="schedules=reshape_elementwise(1)|transpose_elementwise(0);transpose_transpose<16>" --split-input-file %s | FileCheck %s
+
+// Pushing the transpose above the add would transpose both operands, which
+// costs more than the single transpose of the result.
+
+// CHECK-LABEL: func.func @keep
+// CHECK-NEXT:    %[[ADD:.+]] = stablehlo.add %arg0, %arg1
+// CHECK-NEXT:    %[[T:.+]] = stablehlo.transpose %[[ADD]], dims = [1, 0]
+// CHECK-NEXT:    return %[[T]]
+func.func @keep(%a: tensor<4x8xf32>, %b: tensor<4x8xf32>) -> tensor<8x4xf32> {
+  %0 = stablehlo.add %a, %b : tensor<4x8xf32>
+  %1 = stablehlo.transpose %0, dims = [1, 0] : (tensor<4x8xf32>) -> tensor<8x4xf32>
+  return %1 : tensor<8x4xf32>
+}
+
+// -----
+
+// Here the pushed transposes cancel with the ones of the operands.
+
+// CHECK-LABEL: func.func @cancel
+// CHECK-NEXT:    %[[ADD:.+]] = stablehlo.add %arg0, %arg1 : tensor<8x4xf32>
+// CHECK-NEXT:    return %[[ADD]]
+func.func @cancel(%a: tensor<8x4xf32>, %b: tensor<8x4xf32>) -> tensor<8x4xf32> {
+  %0 = stablehlo.transpose %a, dims = [1, 0] : (tensor<8x4xf32>) -> tensor<4x8xf32>
+  %1 = stablehlo.transpose %b, dims = [1, 0] : (tensor<8x4xf32>) -> tensor<4x8xf32>
+  %2 = stablehlo.add %0, %1 : tensor<4x8xf32>
+  %3 = stablehlo.transpose %2, dims = [1, 0] : (tensor<4x8xf32>) -> tensor<8x4xf32>
+  return %3 : tensor<8x4xf32>
+}
+
+
+// -----
+
+// CHLO ops do not prevent the search.
+
+// CHECK-LABEL: func.func @chlo
+// CHECK-NEXT:    %[[E:.+]] = chlo.erf %arg0
+// CHECK-NEXT:    return %[[E]]
+func.func @chlo(%a: tensor<8x4xf32>) -> tensor<8x4xf32> {
+  %0 = stablehlo.transpose %a, dims = [1, 0] : (tensor<8x4xf32>) -> tensor<4x8xf32>
+  %1 = stablehlo.transpose %0, dims = [1, 0] : (tensor<4x8xf32>) -> tensor<8x4xf32>
+  %2 = chlo.erf %1 : tensor<8x4xf32> -> tensor<8x4xf32>
+  return %2 : tensor<8x4xf32>
+}
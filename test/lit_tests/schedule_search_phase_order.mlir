@@ -0,0 +1,21 @@
+// RUN: enzymexlamlir-opt --enzyme-hlo-schedule-search="schedules=transpose_transpose<16>|transpose_elementwise(0) time_budget_ms=0" %s | FileCheck %s
+// RUN: enzymexlamlir-opt --enzyme-hlo-schedule-search="schedules=transpose_transpose<16>|transpose_elementwise(0) time_budget_ms=0 max_rounds=1" %s | FileCheck %s --check-prefix=ONE
+
+// Pushing the outer transpose above the exponential does not change the
+// cost, but it lets the second schedule cancel both transposes. A single
+// round cannot find this.
+
+// CHECK-LABEL: func.func @phase_order
+// CHECK-NEXT:    %[[E:.+]] = stablehlo.exponential %arg0 : tensor<4x8xf32>
+// CHECK-NEXT:    return %[[E]]
+
+// ONE-LABEL: func.func @phase_order
+// ONE-NEXT:    stablehlo.transpose %arg0
+// ONE-NEXT:    stablehlo.exponential
+// ONE-NEXT:    stablehlo.transpose
+func.func @phase_order(%a: tensor<4x8xf32>) -> tensor<4x8xf32> {
+  %0 = stablehlo.transpose %a, dims = [1, 0] : (tensor<4x8xf32>) -> tensor<8x4xf32>
+  %1 = stablehlo.exponential %0 : tensor<8x4xf32>
+  %2 = stablehlo.transpose %1, dims = [1, 0] : (tensor<8x4xf32>) -> tensor<4x8xf32>
+  return %2 : tensor<4x8xf32>
+}
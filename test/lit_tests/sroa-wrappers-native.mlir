@@ -0,0 +1,28 @@
+// RUN: enzymexlamlir-opt %s --pass-pipeline="builtin.module(sroa-wrappers{native=true attributor=false},canonicalize)" | FileCheck %s
+
+// The field-wise accesses of the wrapper struct are split and promoted in
+// MLIR, so the wrapper never round trips through LLVM IR.
+
+module {
+  llvm.func @callee(%arg0: i64, %arg1: !llvm.ptr<1>) {
+    llvm.store %arg0, %arg1 : i64, !llvm.ptr<1>
+    llvm.return
+  }
+  llvm.func @wrapper(%arg0: i64, %arg1: !llvm.ptr<1>) {
+    %0 = llvm.mlir.constant(1 : i64) : i64
+    %1 = llvm.alloca %0 x !llvm.struct<(i64, ptr<1>)> : (i64) -> !llvm.ptr
+    %2 = llvm.getelementptr %1[0, 0] : (!llvm.ptr) -> !llvm.ptr, !llvm.struct<(i64, ptr<1>)>
+    llvm.store %arg0, %2 : i64, !llvm.ptr
+    %3 = llvm.getelementptr %1[0, 1] : (!llvm.ptr) -> !llvm.ptr, !llvm.struct<(i64, ptr<1>)>
+    llvm.store %arg1, %3 : !llvm.ptr<1>, !llvm.ptr
+    %4 = llvm.load %2 : !llvm.ptr -> i64
+    %5 = llvm.load %3 : !llvm.ptr -> !llvm.ptr<1>
+    llvm.call @callee(%4, %5) : (i64, !llvm.ptr<1>) -> ()
+    llvm.return
+  }
+}
+
+// CHECK:  llvm.func @wrapper(%arg0: i64, %arg1: !llvm.ptr<1>) attributes {sym_visibility = "private"} {
+// CHECK-NEXT:    llvm.call @callee(%arg0, %arg1) : (i64, !llvm.ptr<1>) -> ()
+// CHECK-NEXT:    llvm.return
+// CHECK-NEXT:  }
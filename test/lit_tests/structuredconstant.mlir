@@ -0,0 +1,76 @@
+// RUN: enzymexlamlir-opt %s --enzyme-hlo-opt --split-input-file | FileCheck %s
+
+// An iota along a unit dimension is a splat, even when it is too large to
+// expand.
+
+func.func @unit_iota() -> tensor<1x4096xf32> {
+  %0 = stablehlo.iota dim = 0 : tensor<1x4096xf32>
+  return %0 : tensor<1x4096xf32>
+}
+
+// CHECK:  func.func @unit_iota() -> tensor<1x4096xf32> {
+// CHECK-NEXT:    %[[C:.+]] = stablehlo.constant dense<0.000000e+00> : tensor<1x4096xf32>
+// CHECK-NEXT:    return %[[C]] : tensor<1x4096xf32>
+// CHECK-NEXT:  }
+
+// -----
+
+// Broadcasting a scaled and shifted iota yields the same chain on the larger
+// type instead of a dense constant.
+
+func.func @broadcast_iota_chain() -> tensor<8x2048xi32> {
+  %c3 = stablehlo.constant dense<3> : tensor<2048xi32>
+  %c5 = stablehlo.constant dense<5> : tensor<2048xi32>
+  %0 = stablehlo.iota dim = 0 : tensor<2048xi32>
+  %1 = stablehlo.multiply %0, %c3 : tensor<2048xi32>
+  %2 = stablehlo.add %1, %c5 : tensor<2048xi32>
+  %3 = stablehlo.broadcast_in_dim %2, dims = [1] : (tensor<2048xi32>) -> tensor<8x2048xi32>
+  return %3 : tensor<8x2048xi32>
+}
+
+// CHECK:  func.func @broadcast_iota_chain() -> tensor<8x2048xi32> {
+// CHECK-DAG:     %[[C3:.+]] = stablehlo.constant dense<3> : tensor<8x2048xi32>
+// CHECK-DAG:     %[[C5:.+]] = stablehlo.constant dense<5> : tensor<8x2048xi32>
+// CHECK-DAG:     %[[IOTA:.+]] = stablehlo.iota dim = 1 : tensor<8x2048xi32>
+// CHECK:         %[[MUL:.+]] = stablehlo.multiply %[[IOTA]], %[[C3]] : tensor<8x2048xi32>
+// CHECK-NEXT:    %[[ADD:.+]] = stablehlo.add %[[MUL]], %[[C5]] : tensor<8x2048xi32>
+// CHECK-NEXT:    return %[[ADD]] : tensor<8x2048xi32>
+// CHECK-NEXT:  }
+
+// -----
+
+// Padding a padded splat with the same value merges both pads.
+
+func.func @pad_padded_splat() -> tensor<2052xf32> {
+  %c1 = stablehlo.constant dense<1.000000e+00> : tensor<2048xf32>
+  %c0 = stablehlo.constant dense<0.000000e+00> : tensor<f32>
+  %0 = stablehlo.pad %c1, %c0, low = [1], high = [0], interior = [0] : (tensor<2048xf32>, tensor<f32>) -> tensor<2049xf32>
+  %1 = stablehlo.pad %0, %c0, low = [1], high = [2], interior = [0] : (tensor<2049xf32>, tensor<f32>) -> tensor<2052xf32>
+  return %1 : tensor<2052xf32>
+}
+
+// CHECK:  func.func @pad_padded_splat() -> tensor<2052xf32> {
+// CHECK-DAG:     %[[ONE:.+]] = stablehlo.constant dense<1.000000e+00> : tensor<2048xf32>
+// CHECK-DAG:     %[[ZERO:.+]] = stablehlo.constant dense<0.000000e+00> : tensor<f32>
+// CHECK:         %[[PAD:.+]] = stablehlo.pad %[[ONE]], %[[ZERO]], low = [2], high = [2], interior = [0] : (tensor<2048xf32>, tensor<f32>) -> tensor<2052xf32>
+// CHECK-NEXT:    return %[[PAD]] : tensor<2052xf32>
+// CHECK-NEXT:  }
+
+// -----
+
+// Broadcasting a padded splat pads the broadcast splat instead.
+
+func.func @broadcast_padded_splat() -> tensor<4x2050xf32> {
+  %c1 = stablehlo.constant dense<1.000000e+00> : tensor<2048xf32>
+  %c0 = stablehlo.constant dense<0.000000e+00> : tensor<f32>
+  %0 = stablehlo.pad %c1, %c0, low = [1], high = [1], interior = [0] : (tensor<2048xf32>, tensor<f32>) -> tensor<2050xf32>
+  %1 = stablehlo.broadcast_in_dim %0, dims = [1] : (tensor<2050xf32>) -> tensor<4x2050xf32>
+  return %1 : tensor<4x2050xf32>
+}
+
+// CHECK:  func.func @broadcast_padded_splat() -> tensor<4x2050xf32> {
+// CHECK-DAG:     %[[ONE:.+]] = stablehlo.constant dense<1.000000e+00> : tensor<4x2048xf32>
+// CHECK-DAG:     %[[ZERO:.+]] = stablehlo.constant dense<0.000000e+00> : tensor<f32>
+// CHECK:         %[[PAD:.+]] = stablehlo.pad %[[ONE]], %[[ZERO]], low = [0, 1], high = [0, 1], interior = [0, 0] : (tensor<4x2048xf32>, tensor<f32>) -> tensor<4x2050xf32>
+// CHECK-NEXT:    return %[[PAD]] : tensor<4x2050xf32>
+// CHECK-NEXT:  }
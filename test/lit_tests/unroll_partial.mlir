@@ -0,0 +1,118 @@
+// RUN: enzymexlamlir-opt --enzyme-hlo-unroll="unroll-factor=4" %s | FileCheck %s
+
+module {
+
+  func.func @constant(%a : tensor<2x2xf32>) -> tensor<2x2xf32> {
+    %start = stablehlo.constant dense<0> : tensor<i32>
+    %lim = stablehlo.constant dense<10> : tensor<i32>
+    %step = stablehlo.constant dense<1> : tensor<i32>
+    %w:2 = stablehlo.while(%iterArg = %a, %iterArg_0 = %start) : tensor<2x2xf32>, tensor<i32>
+     cond {
+      %c = stablehlo.compare  LT, %iterArg_0, %lim,  SIGNED : (tensor<i32>, tensor<i32>) -> tensor<i1>
+      stablehlo.return %c : tensor<i1>
+    } do {
+      %next = stablehlo.add %iterArg, %iterArg : tensor<2x2xf32>
+      %ni = stablehlo.add %iterArg_0, %step : tensor<i32>
+      stablehlo.return %next, %ni : tensor<2x2xf32>, tensor<i32>
+    }
+    return %w#0 : tensor<2x2xf32>
+  }
+
+  func.func @dynamic(%a : tensor<2x2xf32>, %n : tensor<i32>) -> tensor<2x2xf32> {
+    %start = stablehlo.constant dense<0> : tensor<i32>
+    %step = stablehlo.constant dense<1> : tensor<i32>
+    %w:2 = stablehlo.while(%iterArg = %a, %iterArg_0 = %start) : tensor<2x2xf32>, tensor<i32>
+     cond {
+      %c = stablehlo.compare  LT, %iterArg_0, %n,  SIGNED : (tensor<i32>, tensor<i32>) -> tensor<i1>
+      stablehlo.return %c : tensor<i1>
+    } do {
+      %next = stablehlo.add %iterArg, %iterArg : tensor<2x2xf32>
+      %ni = stablehlo.add %iterArg_0, %step : tensor<i32>
+      stablehlo.return %next, %ni : tensor<2x2xf32>, tensor<i32>
+    }
+    return %w#0 : tensor<2x2xf32>
+  }
+
+  func.func @loop_carried_limit(%a : tensor<2x2xf32>, %n : tensor<i32>) -> tensor<2x2xf32> {
+    %start = stablehlo.constant dense<0> : tensor<i32>
+    %step = stablehlo.constant dense<1> : tensor<i32>
+    %w:3 = stablehlo.while(%iterArg = %a, %iterArg_0 = %start, %iterArg_1 = %n) : tensor<2x2xf32>, tensor<i32>, tensor<i32>
+     cond {
+      %c = stablehlo.compare  LT, %iterArg_0, %iterArg_1,  SIGNED : (tensor<i32>, tensor<i32>) -> tensor<i1>
+      stablehlo.return %c : tensor<i1>
+    } do {
+      %next = stablehlo.add %iterArg, %iterArg : tensor<2x2xf32>
+      %ni = stablehlo.add %iterArg_0, %step : tensor<i32>
+      %nl = stablehlo.subtract %iterArg_1, %step : tensor<i32>
+      stablehlo.return %next, %ni, %nl : tensor<2x2xf32>, tensor<i32>, tensor<i32>
+    }
+    return %w#0 : tensor<2x2xf32>
+  }
+
+  func.func @unsigned(%a : tensor<2x2xf32>, %n : tensor<i32>) -> tensor<2x2xf32> {
+    %start = stablehlo.constant dense<0> : tensor<i32>
+    %step = stablehlo.constant dense<1> : tensor<i32>
+    %w:2 = stablehlo.while(%iterArg = %a, %iterArg_0 = %start) : tensor<2x2xf32>, tensor<i32>
+     cond {
+      %c = stablehlo.compare  LT, %iterArg_0, %n,  UNSIGNED : (tensor<i32>, tensor<i32>) -> tensor<i1>
+      stablehlo.return %c : tensor<i1>
+    } do {
+      %next = stablehlo.add %iterArg, %iterArg : tensor<2x2xf32>
+      %ni = stablehlo.add %iterArg_0, %step : tensor<i32>
+      stablehlo.return %next, %ni : tensor<2x2xf32>, tensor<i32>
+    }
+    return %w#0 : tensor<2x2xf32>
+  }
+}
+
+// Ten iterations run as two groups of four followed by two copies of the body.
+
+// CHECK-LABEL: func.func @constant
+// CHECK-DAG:     %[[LIM:.+]] = stablehlo.constant dense<8> : tensor<i32>
+// CHECK:         %[[W:.+]]:2 = stablehlo.while
+// CHECK:           stablehlo.compare {{.*}}LT, %{{.+}}, %[[LIM]]
+// CHECK:         } do {
+// CHECK-COUNT-4:   stablehlo.add %{{.+}}, %{{.+}} : tensor<2x2xf32>
+// CHECK:           stablehlo.return
+// CHECK-NEXT:    }
+// CHECK-NEXT:    %[[E0:.+]] = stablehlo.add %[[W]]#0, %[[W]]#0 : tensor<2x2xf32>
+// CHECK-NEXT:    %[[E1:.+]] = stablehlo.add %[[E0]], %[[E0]] : tensor<2x2xf32>
+// CHECK-NEXT:    return %[[E1]] : tensor<2x2xf32>
+
+// The unrolled loop stops three iterations early and the original loop runs
+// the rest.
+
+// CHECK-LABEL: func.func @dynamic
+// CHECK-DAG:     %[[OFF:.+]] = stablehlo.constant dense<3> : tensor<i32>
+// CHECK:         %[[LIM:.+]] = stablehlo.subtract %arg1, %[[OFF]] : tensor<i32>
+// CHECK:         %[[W:.+]]:2 = stablehlo.while
+// CHECK:           stablehlo.compare {{.*}}LT, %{{.+}}, %[[LIM]]
+// CHECK:         } do {
+// CHECK-COUNT-4:   stablehlo.add %{{.+}}, %{{.+}} : tensor<2x2xf32>
+// CHECK:         %[[T:.+]]:2 = stablehlo.while(%{{.+}} = %[[W]]#0, %{{.+}} = %[[W]]#1)
+// CHECK:           stablehlo.compare {{.*}}LT, %{{.+}}, %arg1
+// CHECK:         return %[[T]]#0 : tensor<2x2xf32>
+
+// A limit updated by the loop cannot be adjusted before it.
+
+// CHECK-LABEL: func.func @loop_carried_limit
+// CHECK:         stablehlo.while
+// CHECK:         } do {
+// CHECK-NEXT:      stablehlo.add %{{.+}}, %{{.+}} : tensor<2x2xf32>
+// CHECK-NEXT:      stablehlo.add
+// CHECK-NEXT:      stablehlo.subtract
+// CHECK-NEXT:      stablehlo.return
+// CHECK-NEXT:    }
+// CHECK-NEXT:    return
+
+// Subtracting from an unsigned limit could wrap around.
+
+// CHECK-LABEL: func.func @unsigned
+// CHECK-NOT:     stablehlo.subtract
+// CHECK:         stablehlo.while
+// CHECK:         } do {
+// CHECK-NEXT:      stablehlo.add %{{.+}}, %{{.+}} : tensor<2x2xf32>
+// CHECK-NEXT:      stablehlo.add
+// CHECK-NEXT:      stablehlo.return
+// CHECK-NEXT:    }
+// CHECK-NEXT:    return
@@ -0,0 +1,100 @@
+// RUN: enzymexlamlir-opt --enzyme-hlo-generate-td="patterns=while_boundary_peel(2)" --transform-interpreter --enzyme-hlo-remove-transform %s | FileCheck %s
+
+func.func @boundary(%a: tensor<8xf32>, %x: tensor<f32>) -> tensor<f32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c7 = stablehlo.constant dense<7> : tensor<i64>
+  %c8 = stablehlo.constant dense<8> : tensor<i64>
+  %zero = stablehlo.constant dense<0.000000e+00> : tensor<f32>
+  %0:2 = stablehlo.while(%i = %c0, %acc = %x) : tensor<i64>, tensor<f32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %c8 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %first = stablehlo.compare EQ, %i, %c0 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    %last = stablehlo.compare EQ, %i, %c7 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    %edge = stablehlo.or %first, %last : tensor<i1>
+    %s = stablehlo.dynamic_slice %a, %i, sizes = [1] : (tensor<8xf32>, tensor<i64>) -> tensor<1xf32>
+    %v = stablehlo.reshape %s : (tensor<1xf32>) -> tensor<f32>
+    %w = stablehlo.select %edge, %zero, %v : tensor<i1>, tensor<f32>
+    %sum = stablehlo.add %acc, %w : tensor<f32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %sum : tensor<i64>, tensor<f32>
+  }
+  return %0#1 : tensor<f32>
+}
+
+// The first and last iterations are peeled and the steady loop runs from 1
+// to 7 without any iteration-dependent compare.
+
+// CHECK-LABEL: func.func @boundary
+// CHECK:         stablehlo.add
+// CHECK:         stablehlo.while
+// CHECK:         cond {
+// CHECK:           stablehlo.compare LT, %{{.+}}, %{{.+}} : (tensor<i64>, tensor<i64>) -> tensor<i1>
+// CHECK:         } do {
+// CHECK-NOT:       stablehlo.compare
+// CHECK:           stablehlo.return
+// CHECK-NEXT:    }
+// CHECK:         stablehlo.add
+// CHECK:         return
+
+func.func @middle(%a: tensor<8xf32>, %x: tensor<f32>) -> tensor<f32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c4 = stablehlo.constant dense<4> : tensor<i64>
+  %c8 = stablehlo.constant dense<8> : tensor<i64>
+  %zero = stablehlo.constant dense<0.000000e+00> : tensor<f32>
+  %0:2 = stablehlo.while(%i = %c0, %acc = %x) : tensor<i64>, tensor<f32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %c8 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %mid = stablehlo.compare LT, %i, %c4 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    %s = stablehlo.dynamic_slice %a, %i, sizes = [1] : (tensor<8xf32>, tensor<i64>) -> tensor<1xf32>
+    %v = stablehlo.reshape %s : (tensor<1xf32>) -> tensor<f32>
+    %w = stablehlo.select %mid, %zero, %v : tensor<i1>, tensor<f32>
+    %sum = stablehlo.add %acc, %w : tensor<f32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %sum : tensor<i64>, tensor<f32>
+  }
+  return %0#1 : tensor<f32>
+}
+
+// The compare changes value in the middle of the iteration space, which would
+// need more than two peeled iterations.
+
+// CHECK-LABEL: func.func @middle
+// CHECK:         stablehlo.while
+// CHECK:         } do {
+// CHECK:           stablehlo.compare LT
+// CHECK:           stablehlo.select
+
+func.func @unsigned(%a: tensor<8xf32>, %x: tensor<f32>) -> tensor<f32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c8 = stablehlo.constant dense<8> : tensor<i64>
+  %zero = stablehlo.constant dense<0.000000e+00> : tensor<f32>
+  %0:2 = stablehlo.while(%i = %c0, %acc = %x) : tensor<i64>, tensor<f32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %c8 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %first = stablehlo.compare LT, %i, %c1, UNSIGNED : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    %s = stablehlo.dynamic_slice %a, %i, sizes = [1] : (tensor<8xf32>, tensor<i64>) -> tensor<1xf32>
+    %v = stablehlo.reshape %s : (tensor<1xf32>) -> tensor<f32>
+    %w = stablehlo.select %first, %zero, %v : tensor<i1>, tensor<f32>
+    %sum = stablehlo.add %acc, %w : tensor<f32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %sum : tensor<i64>, tensor<f32>
+  }
+  return %0#1 : tensor<f32>
+}
+
+// Only signed compares are evaluated.
+
+// CHECK-LABEL: func.func @unsigned
+// CHECK:         stablehlo.while
+// CHECK:         } do {
+// CHECK:           stablehlo.compare  LT, %{{.+}}, %{{.+}},  UNSIGNED
+// CHECK:           stablehlo.select
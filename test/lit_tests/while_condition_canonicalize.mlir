@@ -0,0 +1,116 @@
+// RUN: enzymexlamlir-opt --enzyme-hlo-generate-td="patterns=while_condition_canonicalize" --transform-interpreter --enzyme-hlo-remove-transform --split-input-file %s | FileCheck %s
+
+// CHECK-LABEL: func.func @swapped
+// CHECK:         cond {
+// CHECK-NEXT:      %[[C:.+]] = stablehlo.compare LT, %iterArg, %arg1
+// CHECK-NEXT:      stablehlo.return %[[C]]
+func.func @swapped(%x: tensor<f32>, %n: tensor<i64>) -> tensor<f32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %0:2 = stablehlo.while(%i = %c0, %acc = %x) : tensor<i64>, tensor<f32>
+   cond {
+    %cmp = stablehlo.compare GT, %n, %i : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %s = stablehlo.sine %acc : tensor<f32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %s : tensor<i64>, tensor<f32>
+  }
+  return %0#1 : tensor<f32>
+}
+
+// -----
+
+// CHECK-LABEL: func.func @less_equal
+// CHECK:         %[[LIM:.+]] = stablehlo.constant dense<10> : tensor<i64>
+// CHECK:         cond {
+// CHECK-NEXT:      %[[C:.+]] = stablehlo.compare LT, %iterArg, %[[LIM]]
+func.func @less_equal(%x: tensor<f32>) -> tensor<f32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c9 = stablehlo.constant dense<9> : tensor<i64>
+  %0:2 = stablehlo.while(%i = %c0, %acc = %x) : tensor<i64>, tensor<f32>
+   cond {
+    %cmp = stablehlo.compare LE, %i, %c9 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %s = stablehlo.sine %acc : tensor<f32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %s : tensor<i64>, tensor<f32>
+  }
+  return %0#1 : tensor<f32>
+}
+
+// -----
+
+// CHECK-LABEL: func.func @decreasing
+// CHECK:         %[[D:.+]] = stablehlo.subtract %arg2, %{{.+}} : tensor<i64>
+// CHECK:         %[[A:.+]] = stablehlo.add %[[D]], %{{.+}} : tensor<i64>
+// CHECK:         %[[Q:.+]] = stablehlo.divide %[[A]], %{{.+}} : tensor<i64>
+// CHECK:         %[[N:.+]] = stablehlo.maximum %[[Q]], %{{.+}} : tensor<i64>
+// CHECK:         stablehlo.while(%[[I:.+]] = %arg2, %[[ACC:.+]] = %arg0, %[[CTR:.+]] = %{{.+}})
+// CHECK:           stablehlo.compare LT, %[[CTR]], %[[N]]
+// CHECK:         } do {
+// CHECK:           %[[SCALED:.+]] = stablehlo.multiply %[[CTR]], %{{.+}} : tensor<i64>
+// CHECK:           %[[IV:.+]] = stablehlo.add %[[SCALED]], %arg2 : tensor<i64>
+// CHECK:           stablehlo.dynamic_slice %arg1, %[[IV]]
+func.func @decreasing(%x: tensor<f32>, %t: tensor<11xf32>, %n: tensor<i64>) -> tensor<f32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c2 = stablehlo.constant dense<2> : tensor<i64>
+  %0:2 = stablehlo.while(%i = %n, %acc = %x) : tensor<i64>, tensor<f32>
+   cond {
+    %cmp = stablehlo.compare GT, %i, %c0 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %v = stablehlo.dynamic_slice %t, %i, sizes = [1] : (tensor<11xf32>, tensor<i64>) -> tensor<1xf32>
+    %r = stablehlo.reshape %v : (tensor<1xf32>) -> tensor<f32>
+    %s = stablehlo.add %acc, %r : tensor<f32>
+    %next = stablehlo.subtract %i, %c2 : tensor<i64>
+    stablehlo.return %next, %s : tensor<i64>, tensor<f32>
+  }
+  return %0#1 : tensor<f32>
+}
+
+// -----
+
+// CHECK-LABEL: func.func @signed
+// CHECK:         cond {
+// CHECK-NEXT:      %[[C:.+]] = stablehlo.compare  LT, %iterArg, %arg1,  SIGNED
+// CHECK-NEXT:      stablehlo.return %[[C]]
+func.func @signed(%x: tensor<f32>, %n: tensor<i64>) -> tensor<f32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %0:2 = stablehlo.while(%i = %c0, %acc = %x) : tensor<i64>, tensor<f32>
+   cond {
+    %cmp = stablehlo.compare GT, %n, %i, SIGNED : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %s = stablehlo.sine %acc : tensor<f32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %s : tensor<i64>, tensor<f32>
+  }
+  return %0#1 : tensor<f32>
+}
+
+// -----
+
+// An unsigned comparison is left alone.
+
+// CHECK-LABEL: func.func @unsigned
+// CHECK:         cond {
+// CHECK-NEXT:      %[[C:.+]] = stablehlo.compare  GT, %arg1, %iterArg,  UNSIGNED
+// CHECK-NEXT:      stablehlo.return %[[C]]
+func.func @unsigned(%x: tensor<f32>, %n: tensor<i64>) -> tensor<f32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %0:2 = stablehlo.while(%i = %c0, %acc = %x) : tensor<i64>, tensor<f32>
+   cond {
+    %cmp = stablehlo.compare GT, %n, %i, UNSIGNED : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %s = stablehlo.sine %acc : tensor<f32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %s : tensor<i64>, tensor<f32>
+  }
+  return %0#1 : tensor<f32>
+}
@@ -0,0 +1,79 @@
+// RUN: enzymexlamlir-opt --enzyme-hlo-generate-td="patterns=while_fusion" --transform-interpreter --enzyme-hlo-remove-transform --split-input-file %s | FileCheck %s
+
+func.func @producer_consumer(%x: tensor<10xf32>, %out: tensor<10xf32>, %y: tensor<10xf32>) -> (tensor<10xf32>, tensor<10xf32>) {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c10 = stablehlo.constant dense<10> : tensor<i64>
+  %0:2 = stablehlo.while(%i = %c0, %acc = %out) : tensor<i64>, tensor<10xf32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %c10 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %xs = stablehlo.dynamic_slice %x, %i, sizes = [1] : (tensor<10xf32>, tensor<i64>) -> tensor<1xf32>
+    %s = stablehlo.sine %xs : tensor<1xf32>
+    %upd = stablehlo.dynamic_update_slice %acc, %s, %i : (tensor<10xf32>, tensor<1xf32>, tensor<i64>) -> tensor<10xf32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %upd : tensor<i64>, tensor<10xf32>
+  }
+  %1:2 = stablehlo.while(%j = %c0, %acc = %y) : tensor<i64>, tensor<10xf32>
+   cond {
+    %cmp = stablehlo.compare LT, %j, %c10 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %v = stablehlo.dynamic_slice %0#1, %j, sizes = [1] : (tensor<10xf32>, tensor<i64>) -> tensor<1xf32>
+    %m = stablehlo.multiply %v, %v : tensor<1xf32>
+    %upd = stablehlo.dynamic_update_slice %acc, %m, %j : (tensor<10xf32>, tensor<1xf32>, tensor<i64>) -> tensor<10xf32>
+    %next = stablehlo.add %j, %c1 : tensor<i64>
+    stablehlo.return %next, %upd : tensor<i64>, tensor<10xf32>
+  }
+  return %0#1, %1#1 : tensor<10xf32>, tensor<10xf32>
+}
+
+// CHECK-LABEL: func.func @producer_consumer
+// CHECK:         %[[W:.+]]:4 = stablehlo.while(%[[I:.+]] = %c, %[[A:.+]] = %arg1, %[[J:.+]] = %c, %[[B:.+]] = %arg2)
+// CHECK:         } do {
+// CHECK:           %[[S:.+]] = stablehlo.sine
+// CHECK:           %[[U:.+]] = stablehlo.dynamic_update_slice %[[A]], %[[S]], %[[I]]
+// CHECK-NOT:       stablehlo.dynamic_slice
+// CHECK:           %[[M:.+]] = stablehlo.multiply %[[S]], %[[S]]
+// CHECK:           stablehlo.dynamic_update_slice %[[B]], %[[M]], %[[J]]
+// CHECK:         }
+// CHECK-NOT:     stablehlo.while
+// CHECK:         return %[[W]]#1, %[[W]]#3
+
+// -----
+
+// The second loop reads an element that the first loop only writes in a later
+// iteration, so the loops cannot be fused.
+
+func.func @shifted_read(%x: tensor<10xf32>, %out: tensor<11xf32>, %y: tensor<10xf32>) -> tensor<10xf32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c10 = stablehlo.constant dense<10> : tensor<i64>
+  %0:2 = stablehlo.while(%i = %c0, %acc = %out) : tensor<i64>, tensor<11xf32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %c10 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %xs = stablehlo.dynamic_slice %x, %i, sizes = [1] : (tensor<10xf32>, tensor<i64>) -> tensor<1xf32>
+    %upd = stablehlo.dynamic_update_slice %acc, %xs, %i : (tensor<11xf32>, tensor<1xf32>, tensor<i64>) -> tensor<11xf32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %upd : tensor<i64>, tensor<11xf32>
+  }
+  %1:2 = stablehlo.while(%j = %c0, %acc = %y) : tensor<i64>, tensor<10xf32>
+   cond {
+    %cmp = stablehlo.compare LT, %j, %c10 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %jp = stablehlo.add %j, %c1 : tensor<i64>
+    %v = stablehlo.dynamic_slice %0#1, %jp, sizes = [1] : (tensor<11xf32>, tensor<i64>) -> tensor<1xf32>
+    %upd = stablehlo.dynamic_update_slice %acc, %v, %j : (tensor<10xf32>, tensor<1xf32>, tensor<i64>) -> tensor<10xf32>
+    %next = stablehlo.add %j, %c1 : tensor<i64>
+    stablehlo.return %next, %upd : tensor<i64>, tensor<10xf32>
+  }
+  return %1#1 : tensor<10xf32>
+}
+
+// CHECK-LABEL: func.func @shifted_read
+// CHECK:         stablehlo.while
+// CHECK:         stablehlo.while
@@ -0,0 +1,89 @@
+// RUN: enzymexlamlir-opt --enzyme-hlo-generate-td="patterns=while_scan_to_reduce_window(1)" --transform-interpreter --enzyme-hlo-remove-transform %s | FileCheck %s
+// RUN: enzymexlamlir-opt --enzyme-hlo-generate-td="patterns=while_scan_to_reduce_window(0)" --transform-interpreter --enzyme-hlo-remove-transform %s | FileCheck %s --check-prefix=STRICT
+
+func.func @cumsum(%a: tensor<11xf32>, %b: tensor<10xf32>) -> tensor<11xf32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c10 = stablehlo.constant dense<10> : tensor<i64>
+  %0:2 = stablehlo.while(%i = %c0, %acc = %a) : tensor<i64>, tensor<11xf32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %c10 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %prev = stablehlo.dynamic_slice %acc, %i, sizes = [1] : (tensor<11xf32>, tensor<i64>) -> tensor<1xf32>
+    %x = stablehlo.dynamic_slice %b, %i, sizes = [1] : (tensor<10xf32>, tensor<i64>) -> tensor<1xf32>
+    %s = stablehlo.add %prev, %x : tensor<1xf32>
+    %ip = stablehlo.add %i, %c1 : tensor<i64>
+    %upd = stablehlo.dynamic_update_slice %acc, %s, %ip : (tensor<11xf32>, tensor<1xf32>, tensor<i64>) -> tensor<11xf32>
+    stablehlo.return %ip, %upd : tensor<i64>, tensor<11xf32>
+  }
+  return %0#1 : tensor<11xf32>
+}
+
+// The scan of 10 elements pairs them up three times, down to a single one,
+// then interleaves the even and odd positions back.
+
+// CHECK-LABEL: func.func @cumsum
+// CHECK-DAG:     %[[ZERO:.+]] = stablehlo.constant dense<-0.000000e+00> : tensor<f32>
+// CHECK-DAG:     %[[WINDOW:.+]] = stablehlo.slice %arg1 [0:10] : (tensor<10xf32>) -> tensor<10xf32>
+// CHECK:         "stablehlo.reduce_window"(%[[WINDOW]], %[[ZERO]])
+// CHECK-SAME:    window_dimensions = array<i64: 2>, window_strides = array<i64: 2>
+// CHECK:           stablehlo.add
+// CHECK:         (tensor<10xf32>, tensor<f32>) -> tensor<5xf32>
+// CHECK:         "stablehlo.reduce_window"
+// CHECK:         (tensor<5xf32>, tensor<f32>) -> tensor<2xf32>
+// CHECK:         "stablehlo.reduce_window"
+// CHECK:         (tensor<2xf32>, tensor<f32>) -> tensor<1xf32>
+// CHECK-NOT:     "stablehlo.reduce_window"
+// CHECK:         %[[REST:.+]] = stablehlo.slice %[[WINDOW]] [2:10:2] : (tensor<10xf32>) -> tensor<4xf32>
+// CHECK:         %[[EVEN:.+]] = stablehlo.concatenate
+// CHECK:         %[[PEVEN:.+]] = stablehlo.pad %[[EVEN]], %[[ZERO]], low = [0], high = [1], interior = [1] : (tensor<5xf32>, tensor<f32>) -> tensor<10xf32>
+// CHECK:         %[[PODD:.+]] = stablehlo.pad %{{.+}}, %[[ZERO]], low = [1], high = [0], interior = [1] : (tensor<5xf32>, tensor<f32>) -> tensor<10xf32>
+// CHECK:         %[[SCAN:.+]] = stablehlo.add %[[PEVEN]], %[[PODD]] : tensor<10xf32>
+// CHECK:         %[[SEED:.+]] = stablehlo.slice %arg0 [0:1] : (tensor<11xf32>) -> tensor<1xf32>
+// CHECK:         %[[BCAST:.+]] = stablehlo.broadcast_in_dim %[[SEED]], dims = [0] : (tensor<1xf32>) -> tensor<10xf32>
+// CHECK:         %[[SUM:.+]] = stablehlo.add %[[BCAST]], %[[SCAN]]
+// CHECK:         %[[RES:.+]] = stablehlo.dynamic_update_slice %arg0, %[[SUM]], %{{.+}} : (tensor<11xf32>, tensor<10xf32>, tensor<i64>) -> tensor<11xf32>
+// CHECK:         stablehlo.while
+// CHECK:         return %[[RES]]
+
+// Without reassociation, floating-point sums are left sequential.
+
+// STRICT-LABEL: func.func @cumsum
+// STRICT-NOT:     stablehlo.reduce_window
+// STRICT:         %[[LOOP:.+]]:2 = stablehlo.while
+// STRICT:         return %[[LOOP]]#1
+
+func.func @cummax(%a: tensor<5xi32>, %b: tensor<4xi32>) -> tensor<5xi32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c4 = stablehlo.constant dense<4> : tensor<i64>
+  %0:2 = stablehlo.while(%i = %c0, %acc = %a) : tensor<i64>, tensor<5xi32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %c4 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %prev = stablehlo.dynamic_slice %acc, %i, sizes = [1] : (tensor<5xi32>, tensor<i64>) -> tensor<1xi32>
+    %x = stablehlo.dynamic_slice %b, %i, sizes = [1] : (tensor<4xi32>, tensor<i64>) -> tensor<1xi32>
+    %s = stablehlo.maximum %prev, %x : tensor<1xi32>
+    %ip = stablehlo.add %i, %c1 : tensor<i64>
+    %upd = stablehlo.dynamic_update_slice %acc, %s, %ip : (tensor<5xi32>, tensor<1xi32>, tensor<i64>) -> tensor<5xi32>
+    stablehlo.return %ip, %upd : tensor<i64>, tensor<5xi32>
+  }
+  return %0#1 : tensor<5xi32>
+}
+
+// Integer scans are exact, so they are rewritten either way.
+
+// CHECK-LABEL: func.func @cummax
+// CHECK:         stablehlo.constant dense<-2147483648> : tensor<i32>
+// CHECK:         "stablehlo.reduce_window"
+// CHECK:           stablehlo.maximum
+// CHECK:         %[[RES:.+]] = stablehlo.dynamic_update_slice %arg0
+// CHECK:         return %[[RES]]
+
+// STRICT-LABEL: func.func @cummax
+// STRICT:         "stablehlo.reduce_window"
+// STRICT:           stablehlo.maximum
+// STRICT:         %[[RES:.+]] = stablehlo.dynamic_update_slice %arg0
+// STRICT:         return %[[RES]]
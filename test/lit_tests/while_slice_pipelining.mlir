@@ -0,0 +1,33 @@
+// RUN: enzymexlamlir-opt --enzyme-hlo-generate-td="patterns=while_slice_pipelining" --transform-interpreter --enzyme-hlo-remove-transform %s | FileCheck %s
+
+func.func @layer_scan(%w: tensor<4x8x8xf32>, %h: tensor<8xf32>) -> tensor<8xf32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c4 = stablehlo.constant dense<4> : tensor<i64>
+  %0:3 = stablehlo.while(%i = %c0, %ws = %w, %acc = %h) : tensor<i64>, tensor<4x8x8xf32>, tensor<8xf32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %c4 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %slice = stablehlo.dynamic_slice %ws, %i, %c0, %c0, sizes = [1, 8, 8] : (tensor<4x8x8xf32>, tensor<i64>, tensor<i64>, tensor<i64>) -> tensor<1x8x8xf32>
+    %layer = stablehlo.reshape %slice : (tensor<1x8x8xf32>) -> tensor<8x8xf32>
+    %y = stablehlo.dot_general %layer, %acc, contracting_dims = [1] x [0] : (tensor<8x8xf32>, tensor<8xf32>) -> tensor<8xf32>
+    %t = stablehlo.tanh %y : tensor<8xf32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %ws, %t : tensor<i64>, tensor<4x8x8xf32>, tensor<8xf32>
+  }
+  return %0#2 : tensor<8xf32>
+}
+
+// CHECK-LABEL: func.func @layer_scan
+// CHECK:         %[[FIRST:.+]] = stablehlo.dynamic_slice %arg0, %c, %c, %c, sizes = [1, 8, 8]
+// CHECK:         %[[W:.+]]:4 = stablehlo.while(%[[I:.+]] = %c, %[[WS:.+]] = %arg0, %[[ACC:.+]] = %arg1, %[[BUF:.+]] = %[[FIRST]])
+// CHECK:         } do {
+// CHECK-NEXT:      %[[LAYER:.+]] = stablehlo.reshape %[[BUF]]
+// CHECK:           stablehlo.dot_general %[[LAYER]], %[[ACC]]
+// CHECK:           %[[NEXT:.+]] = stablehlo.add %[[I]], %c_0
+// CHECK:           %[[STEP:.+]] = stablehlo.constant dense<1>
+// CHECK-NEXT:      %[[IV:.+]] = stablehlo.add %[[I]], %[[STEP]]
+// CHECK-NEXT:      %[[PREFETCH:.+]] = stablehlo.dynamic_slice %[[WS]], %[[IV]], %c, %c, sizes = [1, 8, 8]
+// CHECK-NEXT:      stablehlo.return %[[NEXT]], %[[WS]], %{{.+}}, %[[PREFETCH]]
+// CHECK:         return %[[W]]#2
@@ -0,0 +1,63 @@
+// RUN: enzymexlamlir-opt --enzyme-hlo-generate-td="patterns=while_sliding_window_buffer" --transform-interpreter --enzyme-hlo-remove-transform --split-input-file %s | FileCheck %s
+
+func.func @conv1d(%x: tensor<16xf32>, %w: tensor<3xf32>, %out: tensor<14xf32>) -> tensor<14xf32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c14 = stablehlo.constant dense<14> : tensor<i64>
+  %0:2 = stablehlo.while(%i = %c0, %o = %out) : tensor<i64>, tensor<14xf32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %c14 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %win = stablehlo.dynamic_slice %x, %i, sizes = [3] : (tensor<16xf32>, tensor<i64>) -> tensor<3xf32>
+    %dot = stablehlo.dot_general %win, %w, contracting_dims = [0] x [0] : (tensor<3xf32>, tensor<3xf32>) -> tensor<f32>
+    %r = stablehlo.reshape %dot : (tensor<f32>) -> tensor<1xf32>
+    %upd = stablehlo.dynamic_update_slice %o, %r, %i : (tensor<14xf32>, tensor<1xf32>, tensor<i64>) -> tensor<14xf32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %upd : tensor<i64>, tensor<14xf32>
+  }
+  return %0#1 : tensor<14xf32>
+}
+
+// CHECK-LABEL: func.func @conv1d
+// CHECK:         %[[FIRST:.+]] = stablehlo.dynamic_slice %arg0, %{{.+}}, sizes = [3]
+// CHECK:         %[[W:.+]]:3 = stablehlo.while(%[[I:.+]] = %{{.+}}, %[[O:.+]] = %arg2, %[[BUF:.+]] = %[[FIRST]])
+// CHECK:         } do {
+// CHECK-NOT:       sizes = [3]
+// CHECK:           stablehlo.dot_general %[[BUF]], %arg1
+// CHECK:           %[[IV:.+]] = stablehlo.add %[[I]], %{{.+}}
+// CHECK:           %[[IDX:.+]] = stablehlo.add %[[IV]], %{{.+}}
+// CHECK-NEXT:      %[[NEW:.+]] = stablehlo.dynamic_slice %arg0, %[[IDX]], sizes = [1]
+// CHECK-NEXT:      %[[ROT:.+]] = "enzymexla.rotate"(%[[BUF]]) <{amount = 1 : si32, dimension = 0 : si32}>
+// CHECK:           %[[DUS:.+]] = stablehlo.dynamic_update_slice %[[ROT]], %[[NEW]], %{{.+}}
+// CHECK-NEXT:      stablehlo.return %{{.+}}, %{{.+}}, %[[DUS]]
+// CHECK:         return %[[W]]#1
+
+// -----
+
+// The last window would be clamped, so the slice is left alone.
+
+func.func @clamped(%x: tensor<16xf32>, %w: tensor<3xf32>, %out: tensor<15xf32>) -> tensor<15xf32> {
+  %c0 = stablehlo.constant dense<0> : tensor<i64>
+  %c1 = stablehlo.constant dense<1> : tensor<i64>
+  %c15 = stablehlo.constant dense<15> : tensor<i64>
+  %0:2 = stablehlo.while(%i = %c0, %o = %out) : tensor<i64>, tensor<15xf32>
+   cond {
+    %cmp = stablehlo.compare LT, %i, %c15 : (tensor<i64>, tensor<i64>) -> tensor<i1>
+    stablehlo.return %cmp : tensor<i1>
+  } do {
+    %win = stablehlo.dynamic_slice %x, %i, sizes = [3] : (tensor<16xf32>, tensor<i64>) -> tensor<3xf32>
+    %dot = stablehlo.dot_general %win, %w, contracting_dims = [0] x [0] : (tensor<3xf32>, tensor<3xf32>) -> tensor<f32>
+    %r = stablehlo.reshape %dot : (tensor<f32>) -> tensor<1xf32>
+    %upd = stablehlo.dynamic_update_slice %o, %r, %i : (tensor<15xf32>, tensor<1xf32>, tensor<i64>) -> tensor<15xf32>
+    %next = stablehlo.add %i, %c1 : tensor<i64>
+    stablehlo.return %next, %upd : tensor<i64>, tensor<15xf32>
+  }
+  return %0#1 : tensor<15xf32>
+}
+
+// CHECK-LABEL: func.func @clamped
+// CHECK:         stablehlo.while
+// CHECK:         } do {
+// CHECK-NEXT:      stablehlo.dynamic_slice %{{.+}}, %{{.+}}, sizes = [3]
+// CHECK-NOT:       enzymexla.rotate
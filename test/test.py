@@ -1,7 +1,7 @@
 from absl.testing import absltest
 import jax
 import jax.numpy as jnp
-from enzyme_ad.jax import cpp_call, enzyme_jax_ir
+from enzyme_ad.jax import cpp_call, enzyme_jax_ir, compile_options, XLAPipeline
 
 jax.config.update("jax_platforms", "cpu")
 
@@ -96,6 +96,72 @@ class EnzymeJax(absltest.TestCase):
             ).all()
         )
 
+    def test_parallel_for_cpp_kernel(self):
+        @jax.jit
+        def square(x):
+            shape = jax.core.ShapedArray(x.shape, x.dtype)
+            return cpp_call(
+                x,
+                out_shapes=[shape],
+                source="""
+        template<std::size_t N>
+        void square(enzyme::tensor<float, N>& out0,
+                    const enzyme::tensor<float, N>& in0) {
+          enzyme::parallel_for(0, N, [&](int64_t i) {
+            out0[i] = in0[i] * in0[i];
+          });
+        }
+        """,
+                fn="square",
+                argv=argv,
+            )[0]
+
+        x = jnp.arange(1024, dtype=jnp.float32)
+        self.assertTrue((square(x) == x * x).all())
+
+        primals, tangents = jax.jvp(square, (x,), (jnp.ones_like(x),))
+        self.assertTrue((primals == x * x).all())
+        self.assertTrue((tangents == 2 * x).all())
+
+        primals, f_vjp = jax.vjp(square, x)
+        (grads,) = f_vjp(jnp.ones_like(x))
+        self.assertTrue((grads == 2 * x).all())
+
+    def test_host_tuned_cpp_kernel(self):
+        options = compile_options(
+            target_cpu="native", fast_math=True, prefer_vector_width=512
+        )
+
+        @jax.jit
+        def axpy(x, y):
+            shape = jax.core.ShapedArray(x.shape, x.dtype)
+            return cpp_call(
+                x,
+                y,
+                out_shapes=[shape],
+                source="""
+        template<std::size_t N>
+        void axpy(enzyme::tensor<float, N>& out0,
+                  const enzyme::tensor<float, N>& in0,
+                  const enzyme::tensor<float, N>& in1) {
+          for (std::size_t i = 0; i < N; i++)
+            out0[i] = 2.0f * in0[i] + in1[i];
+        }
+        """,
+                fn="axpy",
+                argv=argv,
+                pipeline_options=XLAPipeline(compile_options=options),
+            )[0]
+
+        x = jnp.arange(1024, dtype=jnp.float32)
+        y = jnp.ones_like(x)
+        self.assertTrue((axpy(x, y) == 2 * x + y).all())
+
+        primals, f_vjp = jax.vjp(axpy, x, y)
+        grad_x, grad_y = f_vjp(jnp.ones_like(x))
+        self.assertTrue((grad_x == 2).all())
+        self.assertTrue((grad_y == 1).all())
+
     def test_enzyme_mlir_jit(self):
         @jax.jit
         @enzyme_jax_ir(argv=argv)